@@ -0,0 +1,164 @@
+#include <stdlib.h>  // for malloc(), free()
+#include <atomic>
+#include <new>
+#include "mysqlcb_arena.hpp"
+
+namespace mysqlcb {
+
+/** A block's header, followed by *size* bytes for allocations. */
+struct Arena::Block
+{
+   Block                  *next;
+   size_t                 size;
+   const IArena_Allocator *allocator;   ///< Where the block came from, to return it there
+};
+
+const size_t arena_alignment = 16;
+const size_t block_header = (sizeof(Arena::Block) + arena_alignment - 1) & ~(arena_alignment - 1);
+const size_t min_block_size = 64 * 1024;
+
+inline size_t align_arena(size_t bytes) { return (bytes + arena_alignment - 1) & ~(arena_alignment - 1); }
+inline char *block_data(Arena::Block *block) { return reinterpret_cast<char*>(block) + block_header; }
+
+class Malloc_Allocator : public IArena_Allocator
+{
+public:
+   virtual void *allocate(size_t bytes) const
+   {
+      void *block = malloc(bytes);
+      if (!block)
+         throw std::bad_alloc();
+      return block;
+   }
+   virtual void release(void *block, size_t) const { free(block); }
+};
+
+const Malloc_Allocator malloc_allocator;
+
+std::atomic<const IArena_Allocator*> arena_allocator(&malloc_allocator);
+std::atomic<size_t> stack_budget(64 * 1024);
+
+/** Bytes of stack budget taken by the Scratch objects of this thread. */
+thread_local size_t stack_in_use = 0;
+
+void set_arena_allocator(const IArena_Allocator *allocator)
+{
+   arena_allocator.store(allocator ? allocator : &malloc_allocator);
+}
+
+const IArena_Allocator *get_arena_allocator(void) { return arena_allocator.load(); }
+
+void set_stack_budget(size_t bytes) { stack_budget.store(bytes); }
+size_t get_stack_budget(void)       { return stack_budget.load(); }
+
+Arena::Arena()
+   : m_first(nullptr),
+     m_current(nullptr),
+     m_used(0),
+     m_reserved(0)
+{
+}
+
+Arena::~Arena()
+{
+   m_current = nullptr;
+   trim();
+}
+
+/**
+ * Takes *bytes* from the current block, or else from the next block.
+ * Blocks after the current one are not in use, so a next block too
+ * small for the request is released and replaced by a new one: the
+ * chain settles on blocks big enough for the thread's usual requests
+ * instead of growing.  A request larger than min_block_size gets a
+ * block of its own size.
+ */
+void *Arena::allocate(size_t bytes)
+{
+   bytes = align_arena(bytes ? bytes : 1);
+
+   if (m_current && bytes <= m_current->size - m_used)
+   {
+      void *memory = block_data(m_current) + m_used;
+      m_used += bytes;
+      return memory;
+   }
+
+   Block **link = m_current ? &m_current->next : &m_first;
+   while (*link && (*link)->size < bytes)
+   {
+      Block *small = *link;
+      *link = small->next;
+      m_reserved -= small->size;
+      small->allocator->release(small, block_header + small->size);
+   }
+
+   Block *next = *link;
+   if (!next)
+   {
+      const IArena_Allocator *allocator = get_arena_allocator();
+      size_t size = bytes > min_block_size ? bytes : min_block_size;
+
+      Block *block = new (allocator->allocate(block_header + size)) Block;
+      block->next = nullptr;
+      block->size = size;
+      block->allocator = allocator;
+
+      *link = block;
+      m_reserved += size;
+      next = block;
+   }
+
+   m_current = next;
+   m_used = bytes;
+   return block_data(next);
+}
+
+void Arena::rewind(const Mark &mark)
+{
+   m_current = mark.block;
+   m_used = mark.used;
+}
+
+void Arena::trim(void)
+{
+   Block **link = m_current ? &m_current->next : &m_first;
+   while (*link)
+   {
+      Block *block = *link;
+      *link = block->next;
+      m_reserved -= block->size;
+      block->allocator->release(block, block_header + block->size);
+   }
+}
+
+Arena &thread_arena(void)
+{
+   static thread_local Arena arena;
+   return arena;
+}
+
+Scratch::Scratch()
+   : m_arena(thread_arena()),
+     m_mark(m_arena.mark()),
+     m_stack(0)
+{
+}
+
+Scratch::~Scratch()
+{
+   stack_in_use -= m_stack;
+   m_arena.rewind(m_mark);
+}
+
+bool Scratch::take_stack(size_t bytes)
+{
+   if (stack_in_use + bytes > stack_budget.load(std::memory_order_relaxed))
+      return false;
+
+   stack_in_use += bytes;
+   m_stack += bytes;
+   return true;
+}
+
+}  // namespace
@@ -0,0 +1,495 @@
+#include <mysql.h>
+#include <string.h>     // for strlen()
+#include <errno.h>
+#include <unistd.h>     // for close()
+#include <sys/epoll.h>
+#include <stdexcept>
+#include "mysqlcb_async.hpp"
+
+#ifdef LIBMARIADB
+
+namespace mysqlcb {
+
+using Clock = std::chrono::steady_clock;
+
+Async_Connection::Async_Connection()
+   : m_loop(nullptr), m_prev(nullptr), m_next(nullptr),
+     m_mysql(),
+     m_stmt(nullptr),
+     m_state(ASYNC_CLOSED),
+     m_ret_mysql(nullptr), m_ret_int(0), m_ret_bool(0),
+     m_wait(0),
+     m_registered(false),
+     m_deadline(),
+     m_cb(nullptr), m_done(nullptr), m_params(nullptr),
+     m_memory(nullptr), m_meta(nullptr), m_binder(),
+     m_error(),
+     m_row_count(0), m_affected_rows(0)
+{
+}
+
+Async_Connection::~Async_Connection()
+{
+   close();
+}
+
+/** Closes the connection with blocking calls, abandoning any operation. */
+void Async_Connection::close(void)
+{
+   if (m_loop)
+      m_loop->detach(*this);
+
+   release_statement();
+
+   if (m_state!=ASYNC_CLOSED)
+   {
+      mysql_close(&m_mysql);
+      m_state = ASYNC_CLOSED;
+   }
+}
+
+void Async_Connection::release_statement(void)
+{
+   if (m_meta)
+      mysql_free_result(m_meta);
+   if (m_stmt)
+      mysql_stmt_close(m_stmt);
+   delete [] m_memory;
+
+   m_meta = nullptr;
+   m_stmt = nullptr;
+   m_memory = nullptr;
+}
+
+/**
+ * Ends the operation with an error.  A blocking call can finish a
+ * non-blocking connection's work, so the statement is simply closed.
+ */
+void Async_Connection::fail(const char *msg, const char *detail)
+{
+   m_error = msg;
+   m_error += " \"";
+   m_error += detail;
+   m_error += "\"";
+
+   release_statement();
+
+   if (m_state==ASYNC_CONNECTING)
+   {
+      if (m_loop)
+         m_loop->detach(*this);
+      mysql_close(&m_mysql);
+      m_state = ASYNC_CLOSED;
+   }
+   else
+      m_state = ASYNC_IDLE;
+}
+
+/** Continues the waiting call with the socket events in *status*. */
+int Async_Connection::resume(int status)
+{
+   switch(m_state)
+   {
+      case ASYNC_CONNECTING: return mysql_real_connect_cont(&m_ret_mysql, &m_mysql, status);
+      case ASYNC_PREPARING:  return mysql_stmt_prepare_cont(&m_ret_int, m_stmt, status);
+      case ASYNC_EXECUTING:  return mysql_stmt_execute_cont(&m_ret_int, m_stmt, status);
+      case ASYNC_FETCHING:   return mysql_stmt_fetch_cont(&m_ret_int, m_stmt, status);
+      case ASYNC_CLOSING:    return mysql_stmt_close_cont(&m_ret_bool, m_stmt, status);
+      default:               return 0;
+   }
+}
+
+int Async_Connection::start_close(void)
+{
+   m_state = ASYNC_CLOSING;
+   return mysql_stmt_close_start(&m_ret_bool, m_stmt);
+}
+
+/**
+ * Acts on the result of a completed call, usually by starting the next
+ * call of the operation, whose wait status is put in *wait*.  Returns
+ * false when the operation is finished.
+ */
+bool Async_Connection::complete(int &wait)
+{
+   switch(m_state)
+   {
+      case ASYNC_CONNECTING:
+         if (!m_ret_mysql)
+            fail("MySQL connection failed", mysql_error(&m_mysql));
+         else
+            m_state = ASYNC_IDLE;
+         return false;
+
+      case ASYNC_PREPARING:
+         if (m_ret_int)
+            fail("Failed to prepare statement", mysql_stmt_error(m_stmt));
+         else if (m_params && mysql_stmt_bind_param(m_stmt, m_params->binds))
+            fail("Failed to bind parameters", mysql_stmt_error(m_stmt));
+         else
+         {
+            m_state = ASYNC_EXECUTING;
+            wait = mysql_stmt_execute_start(&m_ret_int, m_stmt);
+            return true;
+         }
+         return false;
+
+      case ASYNC_EXECUTING:
+         if (m_ret_int)
+         {
+            fail("Failed to execute statement", mysql_stmt_error(m_stmt));
+            return false;
+         }
+
+         m_affected_rows = mysql_stmt_affected_rows(m_stmt);
+         if (mysql_stmt_field_count(m_stmt)==0)
+         {
+            wait = start_close();
+            return true;
+         }
+
+         m_meta = mysql_stmt_result_metadata(m_stmt);
+         if (!m_meta)
+         {
+            fail("Error getting result metadata", mysql_stmt_error(m_stmt));
+            return false;
+         }
+         else
+         {
+            // The Binder outlives this call, so it can't be on the stack:
+            uint32_t    num_fields = mysql_num_fields(m_meta);
+            MYSQL_FIELD *fields = mysql_fetch_fields(m_meta);
+
+            m_memory = new char[get_result_binds_size(fields, num_fields)];
+            set_result_binds(m_binder, m_memory, fields, num_fields);
+            m_binder.stmt = m_stmt;
+
+            if (mysql_stmt_bind_result(m_stmt, m_binder.binds))
+            {
+               fail("Failed to bind results", mysql_stmt_error(m_stmt));
+               return false;
+            }
+         }
+
+         m_state = ASYNC_FETCHING;
+         wait = mysql_stmt_fetch_start(&m_ret_int, m_stmt);
+         return true;
+
+      case ASYNC_FETCHING:
+         if (m_ret_int==0 || m_ret_int==MYSQL_DATA_TRUNCATED)
+         {
+            mark_truncations(m_binder, m_ret_int);
+            ++m_row_count;
+            (*m_cb)(m_binder);
+            wait = mysql_stmt_fetch_start(&m_ret_int, m_stmt);
+         }
+         else if (m_ret_int==MYSQL_NO_DATA)
+            wait = start_close();
+         else
+         {
+            fail("Failed to fetch row", mysql_stmt_error(m_stmt));
+            return false;
+         }
+         return true;
+
+      case ASYNC_CLOSING:
+         // The statement is closed even if the close reports an error:
+         m_stmt = nullptr;
+         release_statement();
+         m_state = ASYNC_IDLE;
+         return false;
+
+      default:
+         return false;
+   }
+}
+
+/**
+ * Runs the operation forward from a call that returned *wait*, until a
+ * call must wait on the socket or the operation is finished.
+ */
+void Async_Connection::proceed(int wait)
+{
+   try
+   {
+      while (!wait)
+      {
+         if (!complete(wait))
+         {
+            if (m_loop)
+               m_loop->unwait(*this);
+
+            // The callback may start the next operation on this connection:
+            const IAsync_Callback *done = m_done;
+            m_done = nullptr;
+            if (done)
+               (*done)(*this);
+            return;
+         }
+      }
+
+      m_loop->wait(*this, wait);
+   }
+   catch(...)
+   {
+      m_done = nullptr;
+      if (m_state==ASYNC_CONNECTING)
+         close();
+      else
+      {
+         if (m_loop)
+            m_loop->unwait(*this);
+         release_statement();
+         m_state = ASYNC_IDLE;
+      }
+      throw;
+   }
+}
+
+void Async_Connection::advance(int status)
+{
+   proceed(resume(status));
+}
+
+Async_Loop::Async_Loop()
+   : m_epoll(epoll_create1(EPOLL_CLOEXEC)),
+     m_pending(0),
+     m_attached(nullptr)
+{
+   if (m_epoll < 0)
+      throw std::runtime_error("Failed to create the epoll instance.");
+}
+
+Async_Loop::~Async_Loop()
+{
+   while (m_attached)
+      detach(*m_attached);
+   ::close(m_epoll);
+}
+
+void Async_Loop::attach(Async_Connection &conn)
+{
+   if (conn.m_loop==this)
+      return;
+   else if (conn.m_loop)
+      conn.m_loop->detach(conn);
+
+   conn.m_loop = this;
+   conn.m_prev = nullptr;
+   conn.m_next = m_attached;
+   if (m_attached)
+      m_attached->m_prev = &conn;
+   m_attached = &conn;
+}
+
+void Async_Loop::detach(Async_Connection &conn)
+{
+   unwait(conn);
+
+   if (conn.m_prev)
+      conn.m_prev->m_next = conn.m_next;
+   else
+      m_attached = conn.m_next;
+   if (conn.m_next)
+      conn.m_next->m_prev = conn.m_prev;
+
+   conn.m_prev = conn.m_next = nullptr;
+   conn.m_loop = nullptr;
+}
+
+/** Sets the epoll events and the timeout for a MYSQL_WAIT_* *status*. */
+void Async_Loop::wait(Async_Connection &conn, int status)
+{
+   epoll_event ev = {};
+   if (status & MYSQL_WAIT_READ)
+      ev.events |= EPOLLIN;
+   if (status & MYSQL_WAIT_WRITE)
+      ev.events |= EPOLLOUT;
+   if (status & MYSQL_WAIT_EXCEPT)
+      ev.events |= EPOLLPRI;
+   ev.data.ptr = &conn;
+
+   int fd = mysql_get_socket(&conn.m_mysql);
+   if (epoll_ctl(m_epoll, conn.m_registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev))
+      throw std::runtime_error("Failed to watch the connection socket.");
+   conn.m_registered = true;
+
+   if (status & MYSQL_WAIT_TIMEOUT)
+      conn.m_deadline = Clock::now()
+         + std::chrono::milliseconds(mysql_get_timeout_value_ms(&conn.m_mysql));
+   else
+      conn.m_deadline = Clock::time_point::max();
+
+   if (!conn.m_wait)
+      ++m_pending;
+   conn.m_wait = status;
+}
+
+/**
+ * Takes a connection whose operation is over out of the epoll set.  An
+ * idle socket left in the set would still report errors and hangups,
+ * which epoll can't mask, waking the loop over and over for a
+ * connection with nothing to do.  wait() adds it back.
+ */
+void Async_Loop::unwait(Async_Connection &conn)
+{
+   if (conn.m_wait)
+   {
+      --m_pending;
+      conn.m_wait = 0;
+   }
+
+   if (conn.m_registered)
+   {
+      epoll_event ev = {};
+      epoll_ctl(m_epoll, EPOLL_CTL_DEL, mysql_get_socket(&conn.m_mysql), &ev);
+      conn.m_registered = false;
+   }
+}
+
+/**
+ * Starts connecting *conn*.  Unspecified connection values are read from
+ * the [client] group of ~/.my.cnf, as connect_mysql() does.  *done* is
+ * called when the connection is open or has failed.
+ */
+void Async_Loop::connect(Async_Connection &conn,
+                         const char *host,
+                         const char *user,
+                         const char *pass,
+                         const char *dbase,
+                         const IAsync_Callback *done)
+{
+   if (conn.is_busy())
+      throw std::runtime_error("Async connection is busy.");
+
+   conn.close();
+
+   if (!mysql_init(&conn.m_mysql))
+      throw std::runtime_error("Failed to initialize MySQL: insufficient memory?");
+
+   mysql_options(&conn.m_mysql, MYSQL_OPT_NONBLOCK, 0);
+   mysql_options(&conn.m_mysql, MYSQL_READ_DEFAULT_FILE, "~/.my.cnf");
+   mysql_options(&conn.m_mysql, MYSQL_READ_DEFAULT_GROUP, "client");
+
+   attach(conn);
+   conn.m_state = Async_Connection::ASYNC_CONNECTING;
+   conn.m_done = done;
+   conn.m_error.clear();
+
+   conn.proceed(mysql_real_connect_start(&conn.m_ret_mysql, &conn.m_mysql,
+                                         host, user, pass, dbase, 0, nullptr, 0));
+}
+
+/**
+ * Starts a query on an open, idle connection.  Rows are sent to *cb* as
+ * they arrive, and *done* is called when the query is finished or has
+ * failed.  The statement is prepared, so *params* may bind parameters.
+ */
+void Async_Loop::execute_query(Async_Connection &conn,
+                               IBinder_Callback &cb,
+                               const char *query,
+                               const Binder *params,
+                               const IAsync_Callback *done)
+{
+   if (!conn.is_open())
+      throw std::runtime_error("Async connection is not open.");
+   else if (conn.is_busy())
+      throw std::runtime_error("Async connection is busy.");
+
+   attach(conn);
+   conn.m_cb = &cb;
+   conn.m_done = done;
+   conn.m_params = params;
+   conn.m_error.clear();
+   conn.m_row_count = 0;
+   conn.m_affected_rows = 0;
+
+   conn.m_stmt = mysql_stmt_init(&conn.m_mysql);
+   if (!conn.m_stmt)
+      throw std::runtime_error("Failed to initialize statement: insufficient memory?");
+
+   conn.m_state = Async_Connection::ASYNC_PREPARING;
+   conn.proceed(mysql_stmt_prepare_start(&conn.m_ret_int, conn.m_stmt, query, strlen(query)));
+}
+
+/** Limits *timeout_ms* to the time left before the earliest connection timeout. */
+int Async_Loop::next_timeout(int timeout_ms) const
+{
+   Clock::time_point now = Clock::now();
+   for (const Async_Connection *conn = m_attached; conn; conn = conn->m_next)
+   {
+      if (conn->m_wait && conn->m_deadline!=Clock::time_point::max())
+      {
+         long left = 0;
+         if (conn->m_deadline > now)
+            left = std::chrono::duration_cast<std::chrono::milliseconds>(conn->m_deadline - now).count() + 1;
+         if (timeout_ms < 0 || left < timeout_ms)
+            timeout_ms = static_cast<int>(left);
+      }
+   }
+   return timeout_ms;
+}
+
+/**
+ * Waits up to *timeout_ms* milliseconds (-1 for no limit) for sockets to
+ * become ready, and advances their connections.  Returns true while any
+ * connection is still waiting.
+ */
+bool Async_Loop::run_once(int timeout_ms)
+{
+   if (m_pending==0)
+      return false;
+
+   const int   max_events = 64;
+   epoll_event events[max_events];
+
+   int count = epoll_wait(m_epoll, events, max_events, next_timeout(timeout_ms));
+   if (count < 0 && errno!=EINTR)
+      throw std::runtime_error("Failed to wait for the connection sockets.");
+
+   for (int i=0; i<count; ++i)
+   {
+      Async_Connection &conn = *static_cast<Async_Connection*>(events[i].data.ptr);
+
+      // Errors and hangups wake whatever the connection waits for, so
+      // the next call will find and report them:
+      int status = 0;
+      if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+         status |= MYSQL_WAIT_READ;
+      if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+         status |= MYSQL_WAIT_WRITE;
+      if (events[i].events & EPOLLPRI)
+         status |= MYSQL_WAIT_EXCEPT;
+
+      status &= conn.m_wait;
+      if (status)
+         conn.advance(status);
+   }
+
+   // Connections whose deadlines passed before this round get a timeout:
+   Clock::time_point now = Clock::now();
+   Async_Connection *conn = m_attached;
+   while (conn)
+   {
+      if (conn->m_wait & MYSQL_WAIT_TIMEOUT && conn->m_deadline < now)
+      {
+         conn->advance(MYSQL_WAIT_TIMEOUT);
+         conn = m_attached;
+      }
+      else
+         conn = conn->m_next;
+   }
+
+   return m_pending!=0;
+}
+
+/** Runs until no connection is waiting. */
+void Async_Loop::run(void)
+{
+   while (run_once(-1))
+      ;
+}
+
+}  // namespace
+
+#endif  // LIBMARIADB
@@ -0,0 +1,166 @@
+#include <mysql.h>
+#include <string.h>  // For memcpy(), memset()
+#include <stdint.h>  // for uint32_t
+#include "mysqlcb_binder.hpp"
+#include "mysqlcb.hpp"
+#include "mysqlcb_arena.hpp"
+
+namespace mysqlcb {
+
+inline size_t align_batch_length(size_t len) { return (len + 7) & ~static_cast<size_t>(7); }
+
+/** Bytes of column arrays for *rows* rows of the columns bound in *binder*. */
+size_t get_batch_size(const Binder &binder, uint32_t rows)
+{
+   size_t total = 0;
+   for (uint32_t i=0; i<binder.field_count; ++i)
+   {
+      total += align_batch_length(binder.binds[i].buffer_length * rows);
+      if (!is_fixed_length(binder.fields[i].type))
+         total += align_batch_length(sizeof(unsigned long) * rows);
+      total += align_batch_length((rows + 7) / 8);
+   }
+   return total;
+}
+
+/** Lays out the column arrays in *memory*, which must hold get_batch_size() bytes. */
+void set_batch_columns(Row_Batch &batch, const Binder &binder, char *memory)
+{
+   for (uint32_t i=0; i<binder.field_count; ++i)
+   {
+      Column_Batch &col = batch.columns[i];
+      col.field = &binder.fields[i];
+      col.bdtype = binder.bind_data[i].bdtype;
+      col.width = binder.binds[i].buffer_length;
+
+      col.values = memory;
+      memory += align_batch_length(col.width * batch.capacity);
+
+      if (is_fixed_length(col.field->type))
+         col.lengths = nullptr;
+      else
+      {
+         col.lengths = reinterpret_cast<unsigned long*>(memory);
+         memory += align_batch_length(sizeof(unsigned long) * batch.capacity);
+      }
+
+      col.nulls = reinterpret_cast<uint8_t*>(memory);
+      memory += align_batch_length((batch.capacity + 7) / 8);
+   }
+}
+
+/** Copies the fetched row in *binder* to row *row_count* of the batch. */
+void append_batch_row(Row_Batch &batch, const Binder &binder)
+{
+   uint32_t row = batch.row_count;
+   uint8_t  bit = static_cast<uint8_t>(1 << (row & 7));
+
+   for (uint32_t i=0; i<batch.column_count; ++i)
+   {
+      Column_Batch    &col = batch.columns[i];
+      const Bind_Data &bd = binder.bind_data[i];
+      char            *value = col.values + row * col.width;
+
+      if (bd.is_null)
+      {
+         col.nulls[row>>3] |= bit;
+         memset(value, 0, col.width);
+         if (col.lengths)
+            col.lengths[row] = 0;
+      }
+      else
+      {
+         col.nulls[row>>3] &= static_cast<uint8_t>(~bit);
+         if (col.lengths)
+         {
+            // Keep the full length, so a truncated value is told from a short one:
+            memcpy(value, bd.data, available_length(bd));
+            col.lengths[row] = bd.len_data;
+         }
+         else
+            memcpy(value, bd.data, col.width);
+      }
+   }
+
+   ++batch.row_count;
+}
+
+/**
+ * Fetches the rows of an executed statement into the batch, calling
+ * back each time the batch is full and once more for a partial batch.
+ */
+void fetch_batches(MYSQL_STMT *stmt, Binder &binder, Row_Batch &batch, IBatch_Callback &cb)
+{
+   int result;
+   while ((result=mysql_stmt_fetch(stmt))!=MYSQL_NO_DATA)
+   {
+      if (result!=0 && result!=MYSQL_DATA_TRUNCATED)
+         throw_stmt_error("Failed to fetch row", stmt);
+
+      append_batch_row(batch, binder);
+      if (batch.row_count==batch.capacity)
+      {
+         cb(batch);
+         batch.row_count = 0;
+      }
+   }
+
+   if (batch.row_count)
+      cb(batch);
+}
+
+/**
+ * Executes a query and delivers its rows in batches of per-column arrays.
+ *
+ * Rows are fetched into a Binder and copied into the column arrays, which
+ * hold no more than *batch_rows* rows, and no more than max_batch_memory
+ * bytes.  They come from Scratch, so a batch bigger than the stack
+ * budget is in the thread arena.
+ *
+ * @param mysql      Handle to an open MySQL connection
+ * @param cb         Callback function of type `void funcname(Row_Batch &batch)`
+ * @param query      Text of the query
+ * @param batch_rows Most rows in each batch
+ * @param params     Parameters for the query, or nullptr
+ */
+void t_execute_query_batch(MYSQL &mysql,
+                           IBatch_Callback &cb,
+                           const char *query,
+                           uint32_t batch_rows,
+                           const Binder *params)
+{
+   auto fstmt = [&mysql, &cb, batch_rows](MYSQL_STMT &stmt)
+   {
+      auto f = [&stmt, &cb, batch_rows](Binder &b)
+      {
+         if (mysql_stmt_bind_result(&stmt, b.binds))
+            throw_stmt_error("Failed to bind results", &stmt);
+
+         uint32_t capacity = batch_rows ? batch_rows : 1;
+         size_t   row_size = get_batch_size(b, 8) / 8;
+         if (row_size && capacity > max_batch_memory / row_size)
+            capacity = max_batch_memory / row_size;
+         if (capacity==0)
+            capacity = 1;
+
+         Scratch   scratch;
+         size_t    len_columns = sizeof(Column_Batch) * b.field_count;
+         Row_Batch batch = { 0, capacity, b.field_count,
+                             static_cast<Column_Batch*>(SCRATCH_ALLOC(scratch, len_columns)) };
+
+         size_t len_memory = get_batch_size(b, capacity);
+         char   *memory = static_cast<char*>(SCRATCH_ALLOC(scratch, len_memory));
+         set_batch_columns(batch, b, memory);
+
+         fetch_batches(&stmt, b, batch, cb);
+      };
+      Binder_User<decltype(f)> bu(f);
+
+      get_result_binds(mysql, bu, &stmt);
+   };
+   Stmt_User<decltype(fstmt)> su(fstmt);
+
+   t_execute_statement(mysql, su, query, params);
+}
+
+}  // namespace
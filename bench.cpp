@@ -0,0 +1,555 @@
+#include <mysql.h>
+#include <math.h>    // for floor(), log10()
+#include <stdio.h>   // for printf()
+#include <stdlib.h>  // for strtoul(), strtoull()
+#include <string.h>  // for strcmp()
+#include <chrono>
+#include <limits>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "mysqlcb.hpp"
+#include "mysqlcb_replay.hpp"
+#include "mysqlcb_stats.hpp"
+
+/**
+ * Measures the overhead of the library itself, without a server, by
+ * running against the stand-in client library of replay.cpp.
+ *
+ * Each benchmark prints one line: its name, the number of items it
+ * processed, the elapsed time, and the rate.  See show_usage() for the
+ * options.
+ */
+
+using namespace mysqlcb;
+
+const char bench_query[] = "SELECT * FROM replay";
+
+struct Bench_Settings
+{
+   uint64_t rows;      ///< Rows in each result of the row benchmarks
+   uint64_t queries;   ///< Queries run by the per-query benchmarks
+   uint64_t values;    ///< Values formatted by the format benchmarks
+   bool     observe;   ///< Report per-query statistics at the end
+};
+
+typedef std::chrono::steady_clock Clock;
+
+template <typename Func>
+double time_it(const Func &f)
+{
+   Clock::time_point start = Clock::now();
+   f();
+   return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(const char *name, uint64_t count, const char *unit, double seconds, uint64_t bytes=0)
+{
+   printf("%-22s %12llu %-7s %9.3f s %14.0f %s/s %9.1f ns/%s",
+          name,
+          static_cast<unsigned long long>(count),
+          unit,
+          seconds,
+          seconds > 0 ? count / seconds : 0.0,
+          unit,
+          count ? seconds * 1e9 / count : 0.0,
+          unit);
+   if (bytes)
+      printf(" %9.1f MB/s", seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+   printf("\n");
+}
+
+/** A streambuf that only counts what is written to it. */
+class Counting_Buf : public std::streambuf
+{
+public:
+   Counting_Buf() : std::streambuf(), m_count(0) { }
+   inline uint64_t count(void) const { return m_count; }
+
+protected:
+   virtual int_type overflow(int_type ch)
+   {
+      if (ch!=traits_type::eof())
+         ++m_count;
+      return traits_type::not_eof(ch);
+   }
+   virtual std::streamsize xsputn(const char *, std::streamsize count)
+   {
+      m_count += count;
+      return count;
+   }
+
+   uint64_t m_count;
+};
+
+/** Touches every value of a row, so a row isn't counted without being read. */
+inline unsigned long touch_row(const Binder &b)
+{
+   unsigned long sum = 0;
+   for (const Bind_Data *bd = b.bind_data; valid(bd); ++bd)
+      sum += bd->is_null ? 0 : bd->len_data;
+   return sum;
+}
+
+void bench_push_text(MYSQL &mysql, const Bench_Settings &s)
+{
+   uint64_t rows = 0, bytes = 0;
+   auto f = [&rows, &bytes](Binder &b) { ++rows; bytes += touch_row(b); };
+   Binder_User<decltype(f)> bu(f);
+
+   double secs = time_it([&]() { execute_query(mysql, bu, bench_query); });
+   report("push_text", rows, "row", secs, bytes);
+}
+
+void bench_push_prepared(MYSQL &mysql, const Bench_Settings &s)
+{
+   uint64_t rows = 0, bytes = 0;
+   auto f = [&rows, &bytes](Binder &b) { ++rows; bytes += touch_row(b); };
+   Binder_User<decltype(f)> bu(f);
+
+   double secs = time_it([&]() { execute_prepared_query(mysql, bu, bench_query); });
+   report("push_prepared", rows, "row", secs, bytes);
+}
+
+void bench_push_inline(MYSQL &mysql, const Bench_Settings &s)
+{
+   uint64_t rows = 0, bytes = 0;
+   auto f = [&rows, &bytes](Binder &b) { ++rows; bytes += touch_row(b); };
+
+   double secs = time_it([&]() { execute_query_inline(mysql, f, bench_query); });
+   report("push_inline", rows, "row", secs, bytes);
+}
+
+void run_pull(MYSQL &mysql, const char *name, const Pull_Options *options)
+{
+   uint64_t rows = 0, bytes = 0;
+   auto f = [&rows, &bytes](PullPack &pp)
+   {
+      while (pp.puller(false))
+      {
+         ++rows;
+         bytes += touch_row(pp.binder);
+      }
+   };
+   PullPack_User<decltype(f)> pu(f);
+
+   double secs = time_it([&]() { int_execute_query_pull(mysql, pu, bench_query, nullptr, options); });
+   report(name, rows, "row", secs, bytes);
+}
+
+/** Compares the streamed, buffered, adaptive and cursor fetch modes on the same result. */
+void bench_pull(MYSQL &mysql, const Bench_Settings &s)
+{
+   Pull_Options buffered = buffered_pull_options();
+   Pull_Options adaptive = adaptive_pull_options();
+   Pull_Options cursor = cursor_pull_options(1000);
+
+   run_pull(mysql, "pull_stream", nullptr);
+   run_pull(mysql, "pull_buffered", &buffered);
+   run_pull(mysql, "pull_adaptive", &adaptive);
+   run_pull(mysql, "pull_cursor", &cursor);
+}
+
+/** The cost of the result metadata and bind layout for each query. */
+void bench_result_binds(MYSQL &mysql, const Bench_Settings &s)
+{
+   MYSQL_STMT *stmt = mysql_stmt_init(&mysql);
+   prepare_statement(stmt, bench_query);
+
+   unsigned long fields = 0;
+   auto f = [&fields](Binder &b) { fields += b.field_count; };
+   Binder_User<decltype(f)> bu(f);
+
+   double secs = time_it([&]()
+   {
+      for (uint64_t i=0; i<s.queries; ++i)
+         get_result_binds(mysql, bu, stmt);
+   });
+   mysql_stmt_close(stmt);
+
+   report("get_result_binds", s.queries, "call", secs);
+}
+
+/** Per-query overhead, uncached and through a Stmt_Cache, on one-row results. */
+void bench_queries(MYSQL &mysql, const Bench_Settings &s)
+{
+   uint64_t saved_rows = replay_row_count();
+   replay_rows(1);
+
+   uint64_t rows = 0;
+   auto f = [&rows](Binder &b) { ++rows; };
+   Binder_User<decltype(f)> bu(f);
+
+   double secs = time_it([&]()
+   {
+      for (uint64_t i=0; i<s.queries; ++i)
+         execute_prepared_query(mysql, bu, bench_query);
+   });
+   report("query_uncached", s.queries, "query", secs);
+
+   Stmt_Cache cache(mysql);
+   secs = time_it([&]()
+   {
+      for (uint64_t i=0; i<s.queries; ++i)
+         execute_query(cache, bu, bench_query);
+   });
+   report("query_cached", s.queries, "query", secs);
+
+   secs = time_it([&]()
+   {
+      for (uint64_t i=0; i<s.queries; ++i)
+         execute_query(mysql, bu, bench_query);
+   });
+   report("query_text", s.queries, "query", secs);
+
+   replay_rows(saved_rows);
+}
+
+/** The stream-based integer and float formatting, for comparison. */
+template <typename T>
+size_t legacy_integer_length(T val)
+{
+   int sign_add = val < 0 ? 1 : 0;
+   if (sign_add)
+      val = 0-val;
+   return static_cast<size_t>(sign_add + 1 + floor(log10(val ? val : 1)));
+}
+
+template <typename T>
+void legacy_integer_value(T val, char *buff, size_t len)
+{
+   int sign_add = val < 0 ? 1 : 0;
+   if (sign_add)
+      val = 0-val;
+
+   char *ptr = &buff[len-1];
+   while (val && ptr >= buff)
+   {
+      *ptr = static_cast<char>('0' + val % 10);
+      val /= 10;
+      --ptr;
+   }
+   if (sign_add && ptr>=buff)
+      *ptr = '-';
+}
+
+template <typename T>
+size_t legacy_float_length(T val)
+{
+   char buff[15];
+   std::stringstream sstr;
+   sstr.precision(5);
+   sstr.rdbuf()->pubsetbuf(buff,15);
+   sstr << val;
+   return sstr.tellp();
+}
+
+template <typename T>
+void legacy_float_value(T val, char *buff, size_t len)
+{
+   std::stringstream sstr;
+   sstr.precision(5);
+   sstr.rdbuf()->pubsetbuf(buff,len);
+   sstr << val;
+}
+
+/**
+ * A shortest-text float formatting without Grisu2, for comparison:
+ * raises the precision of snprintf("%g") until strtod() reads the text
+ * back as the same value.
+ */
+template <typename T>
+size_t probing_format_float(T val, char *buff)
+{
+   int precision = std::numeric_limits<T>::digits10;
+   int last = std::numeric_limits<T>::max_digits10;
+   for (; precision < last; ++precision)
+   {
+      int len = snprintf(buff, max_float_chars, "%.*g", precision, static_cast<double>(val));
+      if (static_cast<T>(strtod(buff, nullptr))==val)
+         return len;
+   }
+   return snprintf(buff, max_float_chars, "%.*g", last, static_cast<double>(val));
+}
+
+/** Times format_float() and the probing formatter it replaced on the same values. */
+template <typename T>
+void run_float_format(const char *type, const std::vector<T> &values)
+{
+   char        buff[max_float_chars];
+   uint64_t    total = 0;
+   std::string name;
+
+   double secs = time_it([&]()
+   {
+      for (T v : values)
+         total += format_float(v, buff);
+   });
+   report((name = std::string("format_") + type).c_str(), values.size(), "value", secs, total);
+
+   total = 0;
+   secs = time_it([&]()
+   {
+      for (T v : values)
+         total += probing_format_float(v, buff);
+   });
+   report((name = std::string("probe_format_") + type).c_str(), values.size(), "value", secs, total);
+}
+
+/**
+ * Formats each value as a caller of get_string_length() and
+ * get_string_value() does, and streams each with stream_it(), then does
+ * the same with the legacy functions.
+ */
+template <typename T, typename Legacy_Length, typename Legacy_Value>
+void run_format(const char *type, const std::vector<T> &values, Legacy_Length llen, Legacy_Value lval)
+{
+   T          value = T();
+   Bind_Data  bd = { sizeof(T), 0, &value, 0, false, nullptr, nullptr, get_bdtype(type), nullptr };
+   char       buff[64];
+   uint64_t   total = 0;
+   std::string name;
+
+   double secs = time_it([&]()
+   {
+      for (T v : values)
+      {
+         value = v;
+         size_t len = get_string_length(bd);
+         get_string_value(bd, buff, len);
+         total += len;
+      }
+   });
+   report((name = std::string("string_") + type).c_str(), values.size(), "value", secs, total);
+
+   total = 0;
+   secs = time_it([&]()
+   {
+      for (T v : values)
+      {
+         size_t len = llen(v);
+         lval(v, buff, len);
+         total += len;
+      }
+   });
+   report((name = std::string("legacy_string_") + type).c_str(), values.size(), "value", secs, total);
+
+   Counting_Buf cbuf;
+   std::ostream os(&cbuf);
+   secs = time_it([&]()
+   {
+      for (T v : values)
+      {
+         value = v;
+         os << bd;
+      }
+   });
+   report((name = std::string("stream_") + type).c_str(), values.size(), "value", secs, cbuf.count());
+
+   Counting_Buf lbuf;
+   std::ostream los(&lbuf);
+   secs = time_it([&]()
+   {
+      for (T v : values)
+         los << v;
+   });
+   report((name = std::string("legacy_stream_") + type).c_str(), values.size(), "value", secs, lbuf.count());
+}
+
+/** Values of every digit count, like ids and amounts, not just large random ones. */
+void bench_format(MYSQL &mysql, const Bench_Settings &s)
+{
+   std::vector<int64_t> ints;
+   std::vector<double>  reals;
+   ints.reserve(s.values);
+   reals.reserve(s.values);
+
+   uint64_t x = 88172645463325252ull;
+   for (uint64_t i=0; i<s.values; ++i)
+   {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+
+      int64_t magnitude = 1;
+      for (uint64_t digits = x % 19; digits; --digits)
+         magnitude *= 10;
+      int64_t val = static_cast<int64_t>((x >> 8) % magnitude);
+      ints.push_back((x & 1) ? -val : val);
+      reals.push_back(static_cast<double>((x >> 16) % 100000000) / static_cast<double>(1 << (x % 16)));
+   }
+
+   run_format("BIGINT", ints, legacy_integer_length<int64_t>, legacy_integer_value<int64_t>);
+   run_format("DOUBLE", reals, legacy_float_length<double>, legacy_float_value<double>);
+   run_float_format("DOUBLE", reals);
+}
+
+/** The row output of xmlify, written to a stream that discards it. */
+void bench_xmlify(MYSQL &mysql, const Bench_Settings &s)
+{
+   Counting_Buf cbuf;
+   std::ostream os(&cbuf);
+   uint64_t rows = 0;
+
+   auto xmlify = [&os, &rows](Binder &b)
+   {
+      os << "<row";
+
+      const Bind_Data *bd = b.bind_data;
+      while (valid(bd))
+      {
+         if (!is_null(bd))
+            os << " " << field_name(bd) << "=\"" << bd << "\"";
+         ++bd;
+      }
+
+      os << "/>\n";
+      ++rows;
+   };
+   Binder_User<decltype(xmlify)> bu(xmlify);
+
+   double secs = time_it([&]()
+   {
+      os << "<?xml version=\"1.0\" ?>\n<resultset>\n";
+      execute_query(mysql, bu, bench_query);
+      os << "</resultset>\n";
+   });
+   report("xmlify", rows, "row", secs, cbuf.count());
+}
+
+struct Benchmark
+{
+   const char *name;
+   void (*run)(MYSQL &mysql, const Bench_Settings &s);
+};
+
+const Benchmark benchmarks[] = {
+   { "push_text",     bench_push_text },
+   { "push_prepared", bench_push_prepared },
+   { "push_inline",   bench_push_inline },
+   { "pull",          bench_pull },
+   { "result_binds",  bench_result_binds },
+   { "queries",       bench_queries },
+   { "format",        bench_format },
+   { "xmlify",        bench_xmlify },
+   { nullptr,         nullptr }
+};
+
+void show_usage(void)
+{
+   std::cout << "Usage instructions:\n\n"
+      "bench [-r ROWS] [-c COLUMNS] [-w WIDTH] [-f FILE] [-q QUERIES] [-n VALUES] [-s] [benchmark ...]\n\n"
+      "Options:\n"
+      "-r rows\n"
+      "   Rows in each result of the row benchmarks (default 100000).\n"
+      "-c columns\n"
+      "   Column spec of the results, as name:type[:length][:u][:null],...\n"
+      "   (default id:int:11:u,name:varchar:40,price:double,made:datetime).\n"
+      "-w width\n"
+      "   Typical length of synthetic string values (default 16).\n"
+      "-f file\n"
+      "   Replay a recorded result instead of synthetic rows.\n"
+      "-q queries\n"
+      "   Queries run by the per-query benchmarks (default 100000).\n"
+      "-n values\n"
+      "   Values formatted by the format benchmarks (default 1000000).\n"
+      "-s\n"
+      "   Observe the queries and report their statistics to stderr.\n"
+      "\n"
+      "Benchmarks, all by default:\n"
+      "   ";
+   for (const Benchmark *b=benchmarks; b->name; ++b)
+      std::cout << " " << b->name;
+   std::cout << "\n";
+}
+
+int main(int argc, char **argv)
+{
+   Bench_Settings settings = { 100000, 100000, 1000000, false };
+   std::vector<const char*> names;
+   bool recorded = false, sized = false;
+
+   try
+   {
+      for (int i=1; i<argc; ++i)
+      {
+         const char *arg = argv[i];
+         if (*arg=='-')
+         {
+            if (arg[1]!='s' && i+1==argc)
+            {
+               show_usage();
+               return 1;
+            }
+
+            switch(arg[1])
+            {
+               case 'r':
+                  settings.rows = strtoull(argv[++i], nullptr, 10);
+                  sized = true;
+                  break;
+               case 'c':
+                  replay_columns(argv[++i]);
+                  break;
+               case 'w':
+                  replay_width(strtoul(argv[++i], nullptr, 10));
+                  break;
+               case 'f':
+                  replay_load(argv[++i]);
+                  recorded = true;
+                  break;
+               case 'q':
+                  settings.queries = strtoull(argv[++i], nullptr, 10);
+                  break;
+               case 'n':
+                  settings.values = strtoull(argv[++i], nullptr, 10);
+                  break;
+               case 's':
+                  settings.observe = true;
+                  break;
+               default:
+                  show_usage();
+                  return 1;
+            }
+         }
+         else
+            names.push_back(arg);
+      }
+
+      // A recorded result keeps its own row count unless -r is given:
+      if (sized || !recorded)
+         replay_rows(settings.rows);
+
+      Query_Stats_Aggregator stats;
+      if (settings.observe)
+         set_query_observer(&stats);
+
+      MYSQL mysql;
+      mysql_init(&mysql);
+
+      for (const Benchmark *b=benchmarks; b->name; ++b)
+      {
+         bool selected = names.empty();
+         for (const char *name : names)
+            selected = selected || 0==strcmp(name, b->name);
+         if (selected)
+            b->run(mysql, settings);
+      }
+
+      mysql_close(&mysql);
+
+      if (settings.observe)
+      {
+         set_query_observer(nullptr);
+         stats.report(std::cerr);
+      }
+   }
+   catch(std::exception &e)
+   {
+      std::cerr << "Error " << e.what() << std::endl;
+      return 1;
+   }
+
+   return 0;
+}
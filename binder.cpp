@@ -1,11 +1,14 @@
 #include <alloca.h>
 #include <iostream>
+#include <string>
 #include <string.h>
 #include <alloca.h>
 #include <math.h>
 #include <assert.h>
+#include <ctype.h>   // for toupper()
 #include "mysqlcb.hpp"
 #include "mysqlcb_binder.hpp"
+#include "mysqlcb_arena.hpp"
 using namespace std;
 namespace mysqlcb {
 
@@ -45,6 +48,20 @@ MParam::MParam(unsigned int &val)
 MParam::MParam(double &val)
    : m_size(sizeof(double)), m_data(&val), m_type(&bd_Double) { }
 
+/** The time_type of the value picks DATE, TIME or DATETIME. */
+static const BDType *get_time_bdtype(const MYSQL_TIME &val)
+{
+   switch(val.time_type)
+   {
+      case MYSQL_TIMESTAMP_DATE: return &bd_Date;
+      case MYSQL_TIMESTAMP_TIME: return &bd_Time;
+      default:                   return &bd_DateTime;
+   }
+}
+
+MParam::MParam(MYSQL_TIME &val)
+   : m_size(sizeof(MYSQL_TIME)), m_data(&val), m_type(get_time_bdtype(val)) { }
+
 
 
 const BDType *typerefs[] = {
@@ -71,30 +88,83 @@ const BDType *typerefs[] = {
    nullptr
 };
 
-const BDType *get_bdtype(const MYSQL_FIELD &fld)
+/**
+ * Tables built once from typerefs so get_bdtype() takes constant time.
+ *
+ * *by_field* is indexed by field type, then by the unsigned flag.  Types
+ * without an unsigned handler use the signed handler for both.
+ *
+ * *by_name* is an open-addressed hash table of the case-insensitive type
+ * names, sized to stay sparse so probes are short.
+ */
+class BDType_Tables
 {
-   enum_field_types ftype = fld.type;
-   const BDType **ptr = typerefs;
-   while(*ptr)
+public:
+   static const unsigned field_types = 256;
+   static const unsigned name_slots = 64;
+
+   const BDType *by_field[field_types][2];
+   const BDType *by_name[name_slots];
+
+   BDType_Tables(void) : by_field(), by_name()
    {
-      if ((*ptr)->field_type()==ftype)
-         return *ptr;
-      ++ptr;
-   };
-   
-   return nullptr;
+      for (const BDType **ptr = typerefs; *ptr; ++ptr)
+      {
+         const BDType *t = *ptr;
+         unsigned ftype = t->field_type();
+         assert(ftype < field_types);
+
+         by_field[ftype][t->is_unsigned() ? 1 : 0] = t;
+         if (!t->is_unsigned() && !by_field[ftype][1])
+            by_field[ftype][1] = t;
+
+         unsigned slot = hash_name(t->type_name()) % name_slots;
+         while (by_name[slot])
+            slot = (slot + 1) % name_slots;
+         by_name[slot] = t;
+      }
+   }
+
+   /** Case-insensitive FNV-1a hash. */
+   static uint32_t hash_name(const char *name)
+   {
+      uint32_t hash = 2166136261u;
+      while (*name)
+      {
+         hash ^= static_cast<unsigned char>(toupper(static_cast<unsigned char>(*name++)));
+         hash *= 16777619u;
+      }
+      return hash;
+   }
+};
+
+/** Function-level static to be safe to use during static initialization of other units. */
+const BDType_Tables &bdtype_tables(void)
+{
+   static const BDType_Tables tables;
+   return tables;
+}
+
+const BDType *get_bdtype(const MYSQL_FIELD &fld)
+{
+   unsigned ftype = fld.type;
+   if (ftype >= BDType_Tables::field_types)
+      return nullptr;
+
+   return bdtype_tables().by_field[ftype][(fld.flags & UNSIGNED_FLAG) ? 1 : 0];
 }
 
 const BDType *get_bdtype(const char *name)
 {
-   const BDType **ptr = typerefs;
-   while(*ptr)
+   const BDType_Tables &tables = bdtype_tables();
+   unsigned slot = BDType_Tables::hash_name(name) % BDType_Tables::name_slots;
+   while (tables.by_name[slot])
    {
-      if ((*ptr)->name_match(name))
-         return *ptr;
-      ++ptr;
-   };
-   
+      if (tables.by_name[slot]->name_match(name))
+         return tables.by_name[slot];
+      slot = (slot + 1) % BDType_Tables::name_slots;
+   }
+
    return nullptr;
 }
 
@@ -182,7 +252,209 @@ void set_bind_data_object_pointers(Bind_Data &bd, MYSQL_FIELD &field, MYSQL_BIND
    bd.bdtype = get_bdtype(field);
 }
 
-void get_result_binds(MYSQL &mysql, IBinder_Callback &cb, MYSQL_STMT *stmt)
+/** Fixed-length types are bound with their own size, regardless of sizing rules. */
+bool is_fixed_length(enum_field_types type)
+{
+   switch (type)
+   {
+      case MYSQL_TYPE_TINY:
+      case MYSQL_TYPE_SHORT:
+      case MYSQL_TYPE_LONG:
+      case MYSQL_TYPE_LONGLONG:
+      case MYSQL_TYPE_FLOAT:
+      case MYSQL_TYPE_DOUBLE:
+      case MYSQL_TYPE_DATE:
+      case MYSQL_TYPE_TIME:
+      case MYSQL_TYPE_DATETIME:
+      case MYSQL_TYPE_TIMESTAMP: return true;
+      default:                   return false;
+   }
+}
+
+const Column_Size *find_column_size(const Column_Size *overrides, const char *name)
+{
+   if (overrides)
+      for (const Column_Size *ptr = overrides; ptr->name; ++ptr)
+         if (0==strcmp(ptr->name, name))
+            return ptr;
+   return nullptr;
+}
+
+/**
+ * @brief Returns the buffer length a result field will be bound with.
+ *
+ * Unless the Buffer_Sizing rules say otherwise, variable-length fields are
+ * clamped to max_result_buffer to keep the stack footprint of a row reasonable.
+ */
+uint32_t get_field_buffer_length(const MYSQL_FIELD &fld, const Buffer_Sizing *sizing)
+{
+   uint32_t buffer_length = get_buffer_size(fld);
+   if (is_fixed_length(fld.type))
+      return buffer_length;
+
+   if (sizing)
+   {
+      const Column_Size *cs = find_column_size(sizing->overrides, fld.name);
+      if (cs)
+         return cs->size ? cs->size : 1;
+
+      // max_length is 0 unless STMT_ATTR_UPDATE_MAX_LENGTH was set for a stored result
+      if (sizing->use_max_length && fld.max_length)
+      {
+         buffer_length = fld.max_length;
+         if (sizing->limit && buffer_length > sizing->limit)
+            buffer_length = sizing->limit;
+         return buffer_length;
+      }
+   }
+
+   if (buffer_length > max_result_buffer)
+      buffer_length = max_result_buffer;
+   return buffer_length ? buffer_length : 1;
+}
+
+/** Round up to keep each field buffer aligned for MYSQL_TIME, double, etc. */
+inline size_t align_buffer_length(size_t len) { return (len + 7) & ~static_cast<size_t>(7); }
+
+size_t get_result_binds_size(const MYSQL_FIELD *fields,
+                             uint32_t num_fields,
+                             const Buffer_Sizing *sizing)
+{
+   // One extra Bind_Data element, set to NULL, signals the end of the list.
+   size_t total = sizeof(MYSQL_BIND) * num_fields + sizeof(Bind_Data) * (num_fields+1);
+   for (uint32_t i=0; i<num_fields; ++i)
+      total += align_buffer_length(get_field_buffer_length(fields[i], sizing));
+   return total;
+}
+
+void set_result_binds(Binder &binder,
+                      void *memory,
+                      MYSQL_FIELD *fields,
+                      uint32_t num_fields,
+                      const Buffer_Sizing *sizing)
+{
+   char        *ptr = static_cast<char*>(memory);
+   MYSQL_BIND  *binds = reinterpret_cast<MYSQL_BIND*>(ptr);
+   ptr += sizeof(MYSQL_BIND) * num_fields;
+   Bind_Data   *bdata = reinterpret_cast<Bind_Data*>(ptr);
+   ptr += sizeof(Bind_Data) * (num_fields+1);
+
+   memset(binds, 0, sizeof(MYSQL_BIND)*num_fields);
+   memset(bdata, 0, sizeof(Bind_Data)*(num_fields+1));
+
+   for (uint32_t i=0; i<num_fields; ++i)
+   {
+      Bind_Data  &bdataInst = bdata[i];
+      MYSQL_FIELD &field = fields[i];
+      MYSQL_BIND &bind = binds[i];
+
+      set_bind_pointers_to_data_members(bind, bdataInst);
+      set_bind_values_from_field(bind, field);
+      set_bind_data_object_pointers(bdataInst, field, bind);
+
+      if (is_unsupported_type(bdataInst))
+         throw std::runtime_error(std::string(field.name) + " unprepared field type.");
+
+      uint32_t buffer_length = get_field_buffer_length(field, sizing);
+
+      bind.buffer = bdataInst.data = static_cast<void*>(ptr);
+      bind.buffer_length = buffer_length;
+      ptr += align_buffer_length(buffer_length);
+   }
+
+   binder.field_count = num_fields;
+   binder.fields = fields;
+   binder.binds = binds;
+   binder.bind_data = bdata;
+   binder.stmt = nullptr;
+}
+
+/**
+ * MySQL flags the truncated columns of a MYSQL_DATA_TRUNCATED row through
+ * the MYSQL_BIND error member, which points to Bind_Data::is_error.
+ */
+void mark_truncations(Binder &binder, int fetch_result)
+{
+   Bind_Data *bd = binder.bind_data;
+   Bind_Data *end = bd + binder.field_count;
+   if (fetch_result==MYSQL_DATA_TRUNCATED)
+      for (; bd<end; ++bd)
+         bd->is_truncated = bd->is_error!=0;
+   else
+      for (; bd<end; ++bd)
+         bd->is_truncated = false;
+}
+
+size_t t_stream_column(const Binder &binder,
+                       uint32_t index,
+                       IChunk_Callback &sink,
+                       size_t chunk_size)
+{
+   if (index >= binder.field_count)
+      throw std::runtime_error("Column index out of range.");
+
+   const Bind_Data &bd = binder.bind_data[index];
+   if (bd.is_null)
+      return 0;
+
+   const char *data = static_cast<const char*>(bd.data);
+   unsigned long total = bd.len_data;
+   unsigned long in_buffer = available_length(bd);
+   unsigned long offset = 0;
+
+   if (chunk_size==0)
+      chunk_size = 4096;
+
+   // Send the part of the value we already have:
+   while (offset < in_buffer)
+   {
+      size_t len = in_buffer - offset;
+      if (len > chunk_size)
+         len = chunk_size;
+      sink(data + offset, len);
+      offset += len;
+   }
+
+   if (offset < total)
+   {
+      if (!binder.stmt)
+         throw std::runtime_error("Cannot stream a truncated value without its statement.");
+
+      Scratch       scratch;
+      char          *chunk = static_cast<char*>(SCRATCH_ALLOC(scratch, chunk_size));
+      unsigned long len_data = 0;
+      my_bool       is_null = 0;
+      my_bool       is_error = 0;
+
+      MYSQL_BIND bind;
+      memset(&bind, 0, sizeof(MYSQL_BIND));
+      bind.buffer_type = bd.bind->buffer_type;
+      bind.buffer = chunk;
+      bind.buffer_length = chunk_size;
+      bind.length = &len_data;
+      bind.is_null = &is_null;
+      bind.error = &is_error;
+
+      while (offset < total)
+      {
+         if (mysql_stmt_fetch_column(binder.stmt, &bind, index, offset))
+            throw std::runtime_error(mysql_stmt_error(binder.stmt));
+
+         size_t len = total - offset;
+         if (len > chunk_size)
+            len = chunk_size;
+         sink(chunk, len);
+         offset += len;
+      }
+   }
+
+   return offset;
+}
+
+void get_result_binds(MYSQL &mysql,
+                      IBinder_Callback &cb,
+                      MYSQL_STMT *stmt,
+                      const Buffer_Sizing *sizing)
 {
    uint32_t num_fields = mysql_stmt_field_count(stmt);
    if (num_fields)
@@ -191,51 +463,24 @@ void get_result_binds(MYSQL &mysql, IBinder_Callback &cb, MYSQL_STMT *stmt)
       if (result)
       {
          MYSQL_FIELD *fields = mysql_fetch_fields(result);
-         MYSQL_BIND  *binds = static_cast<MYSQL_BIND*>(alloca(sizeof(MYSQL_BIND) * num_fields));
-         // Make one extra Bind_Data element, set to NULL, to signal the end of the list.
-         Bind_Data   *bdata = static_cast<Bind_Data*>(alloca(sizeof(Bind_Data) * (num_fields+1)));
 
-         memset(binds, 0, sizeof(MYSQL_BIND)*num_fields);
-         memset(bdata, 0, sizeof(Bind_Data)*(num_fields+1));
+         // SCRATCH_ALLOC must be in this scope to persist until callback:
+         Scratch scratch;
+         size_t  memlen = get_result_binds_size(fields, num_fields, sizing);
+         void    *memory = SCRATCH_ALLOC(scratch, memlen);
 
-         for (uint32_t i=0; i<num_fields; ++i)
+         Binder b;
+         try
          {
-            Bind_Data  &bdataInst = bdata[i];
-            MYSQL_FIELD &field = fields[i];
-            MYSQL_BIND &bind = binds[i];
-
-            set_bind_pointers_to_data_members(bind, bdataInst);
-            set_bind_values_from_field(bind, field);
-            set_bind_data_object_pointers(bdataInst, field, bind);
-
-            if (is_unsupported_type(bdataInst))
-            {
-               static const char *unp = " unprepared field type.";
-               static const int len_unp = strlen(unp);
-
-               int len = strlen(field.name);
-               char *buff = static_cast<char*>(alloca(len+len_unp+1));
-               char *ptr = buff;
-               memcpy(ptr, field.name, len);
-               ptr += len;
-               memcpy(ptr, unp, len_unp);
-               ptr[len_unp] = '\0';
-               throw std::runtime_error(ptr);
-            }
-
-            // uint32_t buffer_length = get_buffer_size(fields[i]);
-            uint32_t buffer_length = required_buffer_size(bdataInst);
-
-            if (buffer_length>1024)
-               buffer_length = 1024;
-
-            // alloca must be in this scope to persist until callback:
-            bind.buffer = bdata[i].data = static_cast<void*>(alloca(buffer_length));
-            bind.buffer_length = buffer_length;
+            set_result_binds(b, memory, fields, num_fields, sizing);
+            b.stmt = stmt;
+            cb(b);
+         }
+         catch(...)
+         {
+            mysql_free_result(result);
+            throw;
          }
-
-         Binder b = { num_fields, fields, binds, bdata };
-         cb(b);
 
          mysql_free_result(result);
       }
@@ -264,15 +509,16 @@ void summon_binder(IBinder_Callback &cb, ...)
    }
    va_end(counter);
 
+   Scratch scratch;
    size_t memlen = num_params * sizeof(MYSQL_BIND);
-   MYSQL_BIND *binds = static_cast<MYSQL_BIND*>(alloca(memlen));
+   MYSQL_BIND *binds = static_cast<MYSQL_BIND*>(SCRATCH_ALLOC(scratch, memlen));
    memset(static_cast<void*>(binds), 0, memlen);
 
    memlen = (num_params+1) * sizeof(Bind_Data);
-   Bind_Data *bind_data = static_cast<Bind_Data*>(alloca(memlen));
+   Bind_Data *bind_data = static_cast<Bind_Data*>(SCRATCH_ALLOC(scratch, memlen));
    memset(static_cast<void*>(bind_data), 0, memlen);
 
-   Binder binder = { static_cast<uint32_t>(num_params), nullptr, binds, bind_data };
+   Binder binder = { static_cast<uint32_t>(num_params), nullptr, binds, bind_data, nullptr };
    
    MYSQL_BIND *p_bind = binds;
    Bind_Data *p_data = bind_data;
@@ -290,8 +536,8 @@ void summon_binder(IBinder_Callback &cb, ...)
          // uint32_t buffer_length = get_buffer_size(fields[i]);
          uint32_t buffer_length = param.get_data_len();
 
-         // alloca must be in this scope to persist until callback:
-         void *data = alloca(buffer_length);
+         // SCRATCH_ALLOC must be in this scope to persist until callback:
+         void *data = SCRATCH_ALLOC(scratch, buffer_length);
          memcpy(data, param.data(), buffer_length);
          p_bind->buffer = p_data->data = data;
          p_bind->buffer_length = buffer_length;
@@ -317,15 +563,16 @@ void summon_binder(IBinder_Callback &cb, const MParam *params)
       ++num_params;
 
    // Allocate arrays memory and install into a binder object:
+   Scratch scratch;
    size_t memlen = num_params * sizeof(MYSQL_BIND);
-   MYSQL_BIND *binds = static_cast<MYSQL_BIND*>(alloca(memlen));
+   MYSQL_BIND *binds = static_cast<MYSQL_BIND*>(SCRATCH_ALLOC(scratch, memlen));
    memset(static_cast<void*>(binds), 0, memlen);
 
    memlen = (num_params+1) * sizeof(Bind_Data);
-   Bind_Data *bind_data = static_cast<Bind_Data*>(alloca(memlen));
+   Bind_Data *bind_data = static_cast<Bind_Data*>(SCRATCH_ALLOC(scratch, memlen));
    memset(static_cast<void*>(bind_data), 0, memlen);
 
-   Binder binder = {num_params, nullptr, binds, bind_data };
+   Binder binder = {num_params, nullptr, binds, bind_data, nullptr };
    
    MYSQL_BIND *p_bind = binds;
    Bind_Data *p_data = bind_data;
@@ -341,8 +588,8 @@ void summon_binder(IBinder_Callback &cb, const MParam *params)
       // uint32_t buffer_length = get_buffer_size(fields[i]);
       uint32_t buffer_length = ptr->size();
 
-      // alloca must be in this scope to persist until callback:
-      void *data = alloca(buffer_length);
+      // SCRATCH_ALLOC must be in this scope to persist until callback:
+      void *data = SCRATCH_ALLOC(scratch, buffer_length);
       memcpy(data, ptr->data(), buffer_length);
       p_bind->buffer = p_data->data = data;
       p_bind->buffer_length = buffer_length;
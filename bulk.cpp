@@ -0,0 +1,247 @@
+#include <mysql.h>
+#include <string.h>  // For memcpy(), memset()
+#include <stdint.h>  // for uint32_t, uint64_t
+#include "mysqlcb_binder.hpp"
+#include "mysqlcb.hpp"
+#include "mysqlcb_arena.hpp"
+
+namespace mysqlcb {
+
+/** Points *bind* at the value of *param*, or marks it NULL for a default MParam. */
+void set_bulk_bind(MYSQL_BIND &bind, unsigned long &length, const MParam &param)
+{
+   memset(&bind, 0, sizeof(MYSQL_BIND));
+   if (param.is_null())
+      bind.buffer_type = MYSQL_TYPE_NULL;
+   else
+   {
+      length = param.size();
+      bind.buffer_type = param.field_type();
+      bind.is_unsigned = param.is_unsigned();
+      bind.buffer = const_cast<void*>(param.data());
+      bind.buffer_length = length;
+      bind.length = &length;
+   }
+}
+
+/**
+ * Executes the prepared statement once for each row, rebinding the
+ * parameters to the row's values.  Binding is done by the client, so
+ * only the execute is a round trip.
+ */
+uint64_t execute_bulk_rows(MYSQL_STMT *stmt,
+                           const MParam *rows,
+                           uint64_t row_count,
+                           uint32_t param_count)
+{
+   Scratch       scratch;
+   MYSQL_BIND    *binds = static_cast<MYSQL_BIND*>(SCRATCH_ALLOC(scratch, sizeof(MYSQL_BIND) * param_count));
+   unsigned long *lengths = static_cast<unsigned long*>(SCRATCH_ALLOC(scratch, sizeof(unsigned long) * param_count));
+   uint64_t      affected = 0;
+
+   for (uint64_t r=0; r<row_count; ++r)
+   {
+      const MParam *row = &rows[r * param_count];
+      for (uint32_t i=0; i<param_count; ++i)
+         set_bulk_bind(binds[i], lengths[i], row[i]);
+
+      if (mysql_stmt_bind_param(stmt, binds))
+         throw_stmt_error("Failed to bind parameters", stmt);
+      if (mysql_stmt_execute(stmt))
+         throw_stmt_error("Failed to execute statement", stmt);
+
+      affected += mysql_stmt_affected_rows(stmt);
+   }
+
+   return affected;
+}
+
+#ifdef LIBMARIADB
+
+/** Rows sent in each array execute. */
+const uint32_t bulk_array_rows = 1024;
+
+/** MariaDB servers from 10.2 accept parameter arrays in one execute. */
+bool has_bulk_operations(MYSQL &mysql)
+{
+   unsigned long caps = 0;
+   if (mariadb_get_infov(&mysql, MARIADB_CONNECTION_EXTENDED_SERVER_CAPABILITIES, &caps))
+      return false;
+   return (caps & (MARIADB_CLIENT_STMT_BULK_OPERATIONS >> 32))!=0;
+}
+
+/**
+ * Array slots are 8 bytes, so rows with a wider fixed-length value, like
+ * a MYSQL_TIME, can't go in parameter arrays and are sent row by row.
+ */
+bool fits_bulk_arrays(const MParam *rows, uint64_t row_count, uint32_t param_count)
+{
+   const MParam *end = rows + row_count * param_count;
+   for (const MParam *param = rows; param < end; ++param)
+      if (!param->is_null() && is_fixed_length(param->field_type()) && param->size() > sizeof(uint64_t))
+         return false;
+   return true;
+}
+
+/** Bytes for the arrays of one parameter column of *count* rows. */
+size_t get_bulk_column_size(uint32_t count)
+{
+   return sizeof(uint64_t) * count            // values or pointers, 8-byte aligned
+      + sizeof(unsigned long) * count
+      + count;                                // indicators
+}
+
+/**
+ * Binds one parameter column of *count* rows as MariaDB column-wise
+ * arrays: an array of values for fixed-length types, or an array of
+ * pointers and an array of lengths for strings, and an indicator array
+ * marking NULLs.  The arrays are in *memory*, which must be
+ * get_bulk_column_size() bytes.
+ */
+void set_bulk_column(MYSQL_BIND &bind,
+                     char *memory,
+                     const MParam *first,
+                     uint32_t count,
+                     uint32_t param_count)
+{
+   memset(&bind, 0, sizeof(MYSQL_BIND));
+
+   // The first non-NULL value sets the column type:
+   const MParam *typed = nullptr;
+   for (uint32_t r=0; r<count && !typed; ++r)
+      if (!first[r * param_count].is_null())
+         typed = &first[r * param_count];
+
+   char          *values = memory;
+   unsigned long *lengths = reinterpret_cast<unsigned long*>(memory + sizeof(uint64_t) * count);
+   char          *indicators = reinterpret_cast<char*>(lengths + count);
+
+   bind.buffer_type = typed ? typed->field_type() : MYSQL_TYPE_NULL;
+   bind.is_unsigned = typed ? typed->is_unsigned() : 0;
+   bind.buffer = values;
+   bind.u.indicator = indicators;
+
+   bool   fixed = is_fixed_length(bind.buffer_type);
+   size_t width = fixed && typed ? typed->size() : sizeof(char*);
+   if (!fixed)
+      bind.length = lengths;
+   else if (width > sizeof(uint64_t))
+      throw std::runtime_error("Bulk parameter type is too large for an array.");
+
+   for (uint32_t r=0; r<count; ++r)
+   {
+      const MParam &param = first[r * param_count];
+      if (param.is_null())
+      {
+         indicators[r] = STMT_INDICATOR_NULL;
+         lengths[r] = 0;
+         memset(values + r * width, 0, width);
+         continue;
+      }
+      else if (param.field_type()!=bind.buffer_type)
+         throw std::runtime_error("Bulk parameter types differ between rows.");
+
+      indicators[r] = STMT_INDICATOR_NONE;
+      lengths[r] = param.size();
+      if (fixed)
+         memcpy(values + r * width, param.data(), width);
+      else
+         reinterpret_cast<const void**>(values)[r] = param.data();
+   }
+}
+
+/**
+ * Sends the rows in arrays of up to bulk_array_rows rows per execute.
+ * The arrays take about 17KB per parameter, so they come from Scratch,
+ * which moves them off the stack for statements with many parameters.
+ */
+uint64_t execute_bulk_arrays(MYSQL_STMT *stmt,
+                             const MParam *rows,
+                             uint64_t row_count,
+                             uint32_t param_count)
+{
+   Scratch    scratch;
+   size_t     len_column = get_bulk_column_size(bulk_array_rows);
+   MYSQL_BIND *binds = static_cast<MYSQL_BIND*>(SCRATCH_ALLOC(scratch, sizeof(MYSQL_BIND) * param_count));
+   char       *memory = static_cast<char*>(SCRATCH_ALLOC(scratch, len_column * param_count));
+   uint64_t   affected = 0;
+
+   for (uint64_t start=0; start<row_count; start+=bulk_array_rows)
+   {
+      unsigned int count = static_cast<unsigned int>(row_count - start < bulk_array_rows
+                                                     ? row_count - start
+                                                     : bulk_array_rows);
+      const MParam *first = &rows[start * param_count];
+      for (uint32_t i=0; i<param_count; ++i)
+         set_bulk_column(binds[i], memory + i * len_column, first + i, count, param_count);
+
+      if (mysql_stmt_attr_set(stmt, STMT_ATTR_ARRAY_SIZE, &count))
+         throw_stmt_error("Failed to set array size", stmt);
+      if (mysql_stmt_bind_param(stmt, binds))
+         throw_stmt_error("Failed to bind parameters", stmt);
+      if (mysql_stmt_execute(stmt))
+         throw_stmt_error("Failed to execute statement", stmt);
+
+      affected += mysql_stmt_affected_rows(stmt);
+   }
+
+   return affected;
+}
+
+#endif  // LIBMARIADB
+
+/**
+ * Prepares a statement once and executes it for each of *row_count*
+ * rows of parameters, returning the total of affected rows.
+ *
+ * *rows* holds row_count rows, one after the other, each with one MParam
+ * for each `?` in the query.  A default-constructed MParam sends NULL.
+ *
+ * With MariaDB Connector/C and a server that supports it, the rows are
+ * sent as parameter arrays (STMT_ATTR_ARRAY_SIZE), many rows to an
+ * execute.  Otherwise, or if a value is too wide for an array slot, like
+ * a MYSQL_TIME, the statement is executed once per row.
+ *
+ *~~~c++
+int id1 = 1, id2 = 2;
+MParam rows[] = { id1, "Alice",
+                  id2, "Bob" };
+uint64_t added = execute_bulk(mysql, "INSERT INTO Person (id, name) VALUES (?, ?)", rows, 2);
+ *~~~
+ *
+ * @param mysql     Handle to an open MySQL connection
+ * @param query     Text of a statement with parameters, like an INSERT
+ * @param rows      Array of row_count * (parameter count) values
+ * @param row_count Number of rows of parameters
+ *
+ * @return Sum of the affected rows of the executions
+ */
+uint64_t execute_bulk(MYSQL &mysql, const char *query, const MParam *rows, uint64_t row_count)
+{
+   uint64_t affected = 0;
+
+   auto f = [&mysql, &rows, row_count, &affected](MYSQL_STMT &stmt)
+   {
+      uint32_t param_count = static_cast<uint32_t>(mysql_stmt_param_count(&stmt));
+      if (param_count==0)
+         throw std::runtime_error("Bulk statement has no parameters.");
+      if (mysql_stmt_field_count(&stmt))
+         throw std::runtime_error("Bulk statement returns a result.");
+
+#ifdef LIBMARIADB
+      if (has_bulk_operations(mysql) && fits_bulk_arrays(rows, row_count, param_count))
+      {
+         affected = execute_bulk_arrays(&stmt, rows, row_count, param_count);
+         return;
+      }
+#endif
+      affected = execute_bulk_rows(&stmt, rows, row_count, param_count);
+   };
+   Stmt_User<decltype(f)> su(f);
+
+   t_prepare_statement(mysql, su, query);
+
+   return affected;
+}
+
+}  // namespace
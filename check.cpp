@@ -0,0 +1,1633 @@
+#include <mysql.h>
+#include <stdio.h>   // for printf(), remove()
+#include <stdlib.h>  // for strtod(), strtof(), strtoll(), strtoull()
+#include <string.h>  // for strcmp(), strstr(), memcmp(), memcpy()
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mysqlcb.hpp"
+#include "mysqlcb_arena.hpp"
+#include "mysqlcb_async.hpp"
+#include "mysqlcb_cursor.hpp"
+#include "mysqlcb_fanout.hpp"
+#include "mysqlcb_inserter.hpp"
+#include "mysqlcb_pool.hpp"
+#include "mysqlcb_replay.hpp"
+#include "mysqlcb_scan.hpp"
+#include "mysqlcb_stats.hpp"
+#include "mysqlcb_typed.hpp"
+
+/**
+ * Behavior checks for the library, built from source against the
+ * stand-in client library of replay.cpp, so they run without a server.
+ *
+ * Each check is a function that uses CHECK() to assert what the library
+ * should do.  A failed CHECK() is reported with its file and line, and
+ * the remaining checks still run.  With names on the command line, only
+ * those checks run.
+ */
+
+using namespace mysqlcb;
+
+unsigned long checks_run = 0;
+unsigned long checks_failed = 0;
+
+void check_that(bool ok, const char *expr, const char *file, int line)
+{
+   ++checks_run;
+   if (!ok)
+   {
+      ++checks_failed;
+      printf("%s:%d: CHECK(%s) failed\n", file, line, expr);
+   }
+}
+
+#define CHECK(expr) check_that((expr), #expr, __FILE__, __LINE__)
+
+/**
+ * A connection to the stand-in, with its result set to *columns* and
+ * *rows*, and string values up to *width* characters long.
+ */
+class Replay_Connection
+{
+public:
+   Replay_Connection(const char *columns, uint64_t rows, unsigned long width=16) : m_mysql()
+   {
+      replay_width(width);
+      replay_columns(columns);
+      replay_rows(rows);
+      mysql_init(&m_mysql);
+   }
+   ~Replay_Connection() { mysql_close(&m_mysql); }
+   Replay_Connection(const Replay_Connection&) = delete;
+   Replay_Connection& operator=(const Replay_Connection&) = delete;
+
+   inline MYSQL &mysql(void) { return m_mysql; }
+
+protected:
+   MYSQL m_mysql;
+};
+
+/** Runs a query through *cache* and returns the number of rows pushed. */
+uint64_t count_cached_rows(Stmt_Cache &cache, const char *query)
+{
+   uint64_t rows = 0;
+   auto f = [&rows](Binder &) { ++rows; };
+   Binder_User<decltype(f)> bu(f);
+   execute_query(cache, bu, query);
+   return rows;
+}
+
+/** Repeated queries hit the cache, and a full cache evicts its oldest entry. */
+void check_stmt_cache(void)
+{
+   Replay_Connection conn("id:int,name:varchar:20", 25);
+   Stmt_Cache cache(conn.mysql(), 2);
+
+   CHECK(count_cached_rows(cache, "SELECT id, name FROM t1")==25);
+   CHECK(cache.misses()==1 && cache.hits()==0);
+   CHECK(count_cached_rows(cache, "SELECT id, name FROM t1")==25);
+   CHECK(cache.misses()==1 && cache.hits()==1);
+
+   count_cached_rows(cache, "SELECT id, name FROM t2");
+   CHECK(cache.size()==2 && cache.evictions()==0);
+
+   // t1 was used before t2, so t3 evicts it and t1 must be prepared again:
+   count_cached_rows(cache, "SELECT id, name FROM t3");
+   CHECK(cache.size()==2 && cache.evictions()==1);
+   count_cached_rows(cache, "SELECT id, name FROM t1");
+   CHECK(cache.misses()==4 && cache.hits()==1 && cache.evictions()==2);
+
+   // A cached pull sees the same rows:
+   uint64_t pulled = 0;
+   auto fpull = [&pulled](PullPack &pp) { while (pp.puller(0)) ++pulled; };
+   PullPack_User<decltype(fpull)> pu(fpull);
+   execute_query_pull(cache, pu, "SELECT id, name FROM t1");
+   CHECK(pulled==25 && cache.hits()==2);
+
+   cache.clear();
+   CHECK(cache.size()==0);
+}
+
+/** A value longer than its buffer is marked truncated and streams whole. */
+void check_truncated_stream(void)
+{
+   Replay_Connection conn("id:int,body:text:5000", 30, 4000);
+
+   // The text protocol reads each value whole, for comparing with the streams:
+   std::vector<std::string> whole;
+   auto ftext = [&whole](PullPack &pp)
+   {
+      while (pp.puller(0))
+      {
+         const Bind_Data &bd = pp.binder.bind_data[1];
+         whole.push_back(std::string(static_cast<const char*>(bd.data), bd.len_data));
+      }
+   };
+   execute_query_pull(conn.mysql(), ftext, "SELECT id, body FROM t1");
+   CHECK(whole.size()==30);
+
+   // A buffered result gets max_result_buffer bytes per text field:
+   size_t row = 0, truncated = 0, bad_chunks = 0;
+   auto fstream = [&](PullPack &pp)
+   {
+      while (pp.puller(0))
+      {
+         const Bind_Data &bd = pp.binder.bind_data[1];
+         if (is_truncated(bd))
+         {
+            ++truncated;
+            CHECK(available_length(bd)==max_result_buffer);
+         }
+
+         std::string streamed;
+         auto sink = [&streamed, &bad_chunks](const char *chunk, size_t len)
+         {
+            if (len==0 || len > 300)
+               ++bad_chunks;
+            streamed.append(chunk, len);
+         };
+         size_t sent = stream_column(pp.binder, 1, sink, 300);
+         CHECK(sent==bd.len_data && sent==streamed.size());
+         CHECK(row < whole.size() && streamed==whole[row]);
+         ++row;
+      }
+   };
+   execute_query_pull(conn.mysql(), fstream, "SELECT id, body FROM t1", buffered_pull_options());
+   CHECK(row==30 && truncated > 0 && bad_chunks==0);
+}
+
+/** Formats *val* with format_integer() and checks the length and the value read back. */
+template <typename T>
+bool integer_round_trips(T val)
+{
+   char buff[max_integer_chars + 1];
+   size_t len = format_integer(val, buff);
+   buff[len] = '\0';
+   if (len != integer_length(val))
+      return false;
+   return std::numeric_limits<T>::is_signed
+      ? static_cast<T>(strtoll(buff, nullptr, 10))==val
+      : static_cast<T>(strtoull(buff, nullptr, 10))==val;
+}
+
+/** Formats *val* with format_float() and checks that it reads back as the same bits. */
+template <typename T>
+bool float_round_trips(T val)
+{
+   char buff[max_float_chars + 1];
+   size_t len = format_float(val, buff);
+   buff[len] = '\0';
+   T back = static_cast<T>(std::numeric_limits<T>::digits > 24 ? strtod(buff, nullptr) : strtof(buff, nullptr));
+   return len <= max_float_chars && memcmp(&back, &val, sizeof(T))==0;
+}
+
+template <typename T>
+std::string float_text(T val)
+{
+   char buff[max_float_chars];
+   return std::string(buff, format_float(val, buff));
+}
+
+/** Integers and floats read back as the values they were formatted from. */
+void check_number_format(void)
+{
+   uint64_t x = 88172645463325252ull;
+   unsigned long bad_int = 0, bad_double = 0, bad_float = 0;
+
+   for (unsigned i=0; i<20; ++i)
+   {
+      uint64_t p = powers_of_10[i];
+      CHECK(integer_round_trips(p) && integer_round_trips(p - 1) && integer_round_trips(p + 1));
+      CHECK(integer_round_trips(static_cast<int64_t>(p)) && integer_round_trips(-static_cast<int64_t>(p)));
+   }
+   CHECK(integer_round_trips(std::numeric_limits<int64_t>::min()));
+   CHECK(integer_round_trips(std::numeric_limits<int64_t>::max()));
+   CHECK(integer_round_trips(std::numeric_limits<uint64_t>::max()));
+
+   // Random bit patterns cover every exponent, subnormals included:
+   for (unsigned i=0; i<200000; ++i)
+   {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+
+      if (!integer_round_trips(static_cast<int64_t>(x)) || !integer_round_trips(x >> (x % 64)))
+         ++bad_int;
+
+      double d;
+      memcpy(&d, &x, sizeof(d));
+      if (!std::isnan(d) && !float_round_trips(d))
+         ++bad_double;
+      if (!float_round_trips(static_cast<double>(x % 100000000) / (1 << (x % 16))))
+         ++bad_double;
+
+      float f;
+      uint32_t fbits = static_cast<uint32_t>(x >> 32);
+      memcpy(&f, &fbits, sizeof(f));
+      if (!std::isnan(f) && !float_round_trips(f))
+         ++bad_float;
+   }
+   CHECK(bad_int==0);
+   CHECK(bad_double==0);
+   CHECK(bad_float==0);
+
+   // Laid out as printf("%g") does, with the fewest digits:
+   CHECK(float_text(0.1)=="0.1");
+   CHECK(float_text(-0.0)=="-0");
+   CHECK(float_text(2.5)=="2.5");
+   CHECK(float_text(100.0)=="100");
+   CHECK(float_text(0.0001)=="0.0001");
+   CHECK(float_text(0.00001)=="1e-05");
+   CHECK(float_text(1e15)=="1e+15");
+   CHECK(float_text(123456789012345.0)=="123456789012345");
+   CHECK(float_text(5e-324)=="5e-324");
+   CHECK(float_text(1.7976931348623157e308)=="1.7976931348623157e+308");
+   CHECK(float_text(0.1f)=="0.1");
+   CHECK(float_text(123456.7f)=="123456.7");
+   CHECK(float_text(std::numeric_limits<double>::infinity())=="inf");
+
+   // get_string_value() copies the text get_string_length() made, but not for another value:
+   double     value = 0.0;
+   Bind_Data  bd = { sizeof(double), 0, &value, 0, false, nullptr, nullptr, get_bdtype("DOUBLE"), nullptr };
+   char       buff[max_float_chars + 1];
+   const double values[] = { 0.3, -0.0, 0.0, 1e300, 0.3 };
+   for (double v : values)
+   {
+      value = v;
+      size_t len = get_string_length(bd);
+      get_string_value(bd, buff, len + 1);
+      CHECK(std::string(buff)==float_text(v));
+   }
+   value = 0.5;
+   get_string_value(bd, buff, sizeof(buff));
+   CHECK(std::string(buff)=="0.5");
+}
+
+std::string time_text(size_t (*format)(const MYSQL_TIME&, unsigned, char*), const MYSQL_TIME &t, unsigned decimals)
+{
+   char buff[max_temporal_chars];
+   return std::string(buff, format(t, decimals, buff));
+}
+
+/** Dates and times are written as the server writes them. */
+void check_time_format(void)
+{
+   MYSQL_TIME t;
+   memset(&t, 0, sizeof(t));
+   t.year = 2024;
+   t.month = 1;
+   t.day = 31;
+   t.hour = 23;
+   t.minute = 59;
+   t.second = 7;
+   t.second_part = 45600;
+
+   char buff[max_temporal_chars];
+   CHECK(std::string(buff, format_date(t, buff))=="2024-01-31");
+   CHECK(time_text(format_datetime, t, 0)=="2024-01-31 23:59:07");
+   CHECK(time_text(format_datetime, t, 3)=="2024-01-31 23:59:07.045");
+   CHECK(time_text(format_datetime, t, 6)=="2024-01-31 23:59:07.045600");
+   CHECK(time_text(format_datetime, t, 9)=="2024-01-31 23:59:07.045600");
+   CHECK(time_text(format_time, t, 0)=="23:59:07");
+
+   t.year = 5;
+   CHECK(std::string(buff, format_date(t, buff))=="0005-01-31");
+
+   // TIME can be negative and longer than a day:
+   t.neg = 1;
+   t.hour = 838;
+   t.second_part = 999999;
+   CHECK(time_text(format_time, t, 0)=="-838:59:07");
+   CHECK(time_text(format_time, t, 2)=="-838:59:07.99");
+   t.hour = 5;
+   CHECK(time_text(format_time, t, 0)=="-05:59:07");
+
+   // Fetched values stream and convert to strings the same way:
+   Replay_Connection conn("made:datetime,took:time", 40);
+   uint64_t rows = 0, bad = 0;
+   auto f = [&rows, &bad](Binder &binder)
+   {
+      ++rows;
+      const Bind_Data &made = binder.bind_data[0];
+      const MYSQL_TIME &mt = value_of<MYSQL_TIME>(made);
+      char expect[64];
+      snprintf(expect, sizeof(expect), "%04u-%02u-%02u %02u:%02u:%02u",
+               mt.year, mt.month, mt.day, mt.hour, mt.minute, mt.second);
+
+      char text[max_temporal_chars + 1];
+      size_t len = get_string_length(made);
+      get_string_value(made, text, len + 1);
+      std::ostringstream os;
+      os << made << ' ' << binder.bind_data[1];
+
+      const MYSQL_TIME &tt = value_of<MYSQL_TIME>(binder.bind_data[1]);
+      char took[16];
+      snprintf(took, sizeof(took), "%02u:%02u:%02u", tt.hour, tt.minute, tt.second);
+
+      if (len!=strlen(expect) || strcmp(text, expect) || os.str()!=std::string(expect) + ' ' + took)
+         ++bad;
+   };
+   Binder_User<decltype(f)> bu(f);
+   execute_prepared_query(conn.mysql(), bu, "SELECT made, took FROM t1");
+   CHECK(rows==40 && bad==0);
+}
+
+/** The values of a row read every way a callback can read them. */
+struct Row_Reading
+{
+   uint32_t    id;
+   int64_t     count;
+   double      price;
+   std::string text;       ///< Every column streamed, separated by spaces
+   std::string lengths;    ///< Every non-NULL column's len_data
+};
+
+Row_Reading read_row(const Binder &binder)
+{
+   Row_Reading        rr = { value_of<uint32_t>(binder.bind_data[0]),
+                             value_of<int64_t>(binder.bind_data[1]),
+                             value_of<double>(binder.bind_data[2]),
+                             std::string(),
+                             std::string() };
+   std::ostringstream text, lengths;
+   for (const Bind_Data *bd = binder.bind_data; valid(bd); ++bd)
+   {
+      if (is_null(bd))
+         text << "NULL ";
+      else
+      {
+         text << bd << ' ';
+         lengths << bd->len_data;
+      }
+      lengths << ' ';
+   }
+   rr.text = text.str();
+   rr.lengths = lengths.str();
+   return rr;
+}
+
+/**
+ * A parameterless query, sent by the text protocol, reads the same
+ * values and lengths as a prepared statement, and converts its numbers
+ * and dates only when they are read.
+ */
+void check_text_fast_path(void)
+{
+   Replay_Connection conn("id:int:11:u,count:bigint,price:double,made:datetime,name:varchar:40:null", 50);
+   const char        *query = "SELECT id, count, price, made, name FROM t1";
+
+   std::vector<Row_Reading> prepared;
+   auto fprep = [&prepared](Binder &binder) { prepared.push_back(read_row(binder)); };
+   Binder_User<decltype(fprep)> bprep(fprep);
+   execute_prepared_query(conn.mysql(), bprep, query);
+
+   std::vector<Row_Reading> text;
+   uint64_t pending = 0, converted = 0;
+   auto ftext = [&](Binder &binder)
+   {
+      const Bind_Data &made = binder.bind_data[3];
+      if (made.pending_text)
+         ++pending;
+      text.push_back(read_row(binder));
+      if (!made.pending_text)
+         ++converted;
+   };
+   Binder_User<decltype(ftext)> btext(ftext);
+   execute_query(conn.mysql(), btext, query);
+
+   CHECK(prepared.size()==50 && text.size()==50);
+   CHECK(pending==50 && converted==50);
+
+   unsigned long differ = 0;
+   for (size_t i=0; i<prepared.size() && i<text.size(); ++i)
+   {
+      const Row_Reading &p = prepared[i], &t = text[i];
+      if (p.id!=t.id || p.count!=t.count || p.price!=t.price || p.text!=t.text || p.lengths!=t.lengths)
+         ++differ;
+   }
+   CHECK(differ==0);
+
+   // Fixed-length fields report their native size, not their text length:
+   auto flen = [](Binder &binder)
+   {
+      CHECK(binder.bind_data[0].len_data==sizeof(uint32_t));
+      CHECK(binder.bind_data[1].len_data==sizeof(int64_t));
+      CHECK(binder.bind_data[3].len_data==sizeof(MYSQL_TIME));
+   };
+   Binder_User<decltype(flen)> blen(flen);
+   replay_rows(1);
+   execute_query(conn.mysql(), blen, query);
+}
+
+/** Returns true if *f* throws std::runtime_error. */
+template <typename Func>
+bool throws(const Func &f)
+{
+   try
+   {
+      f();
+   }
+   catch(const std::runtime_error &)
+   {
+      return true;
+   }
+   return false;
+}
+
+/** execute_bulk sends every row, in arrays when the values fit them. */
+void check_bulk(void)
+{
+   Replay_Connection conn("id:int", 1);
+   const uint64_t    count = 2500;
+   std::vector<int>  ids(count);
+   std::vector<MParam> rows;
+   for (uint64_t i=0; i<count; ++i)
+   {
+      ids[i] = static_cast<int>(i);
+      rows.push_back(ids[i]);
+      rows.push_back(i % 10==0 ? MParam() : i % 10==5 ? MParam("") : MParam("name"));
+   }
+
+   // An empty string is a value, and only a default MParam sends NULL:
+   uint64_t before = replay_execute_count();
+   uint64_t nulls = replay_null_param_count();
+   CHECK(execute_bulk(conn.mysql(), "INSERT INTO t1 (id, name) VALUES (?, ?)", rows.data(), count)==count);
+   CHECK(replay_null_param_count() - nulls==count / 10);
+#ifdef LIBMARIADB
+   CHECK(replay_execute_count() - before==3);
+#else
+   CHECK(replay_execute_count() - before==count);
+#endif
+
+   // A MYSQL_TIME is too wide for an array slot, so these go row by row:
+   MYSQL_TIME made;
+   memset(&made, 0, sizeof(made));
+   made.year = 2024;
+   made.month = 2;
+   made.day = 29;
+   made.time_type = MYSQL_TIMESTAMP_DATETIME;
+
+   std::vector<MParam> timed;
+   for (uint64_t i=0; i<100; ++i)
+   {
+      timed.push_back(ids[i]);
+      timed.push_back(made);
+   }
+   before = replay_execute_count();
+   CHECK(execute_bulk(conn.mysql(), "INSERT INTO t1 (id, made) VALUES (?, ?)", timed.data(), 100)==100);
+   CHECK(replay_execute_count() - before==100);
+
+   CHECK(throws([&]() { execute_bulk(conn.mysql(), "INSERT INTO t1 VALUES (1)", rows.data(), 1); }));
+   CHECK(throws([&]() { execute_bulk(conn.mysql(), "SELECT id FROM t1 WHERE id=?", rows.data(), 1); }));
+}
+
+/** Histogram buckets tile the range within 1/16 of each value, and queries group by shape. */
+void check_histogram(void)
+{
+   typedef Latency_Histogram LH;
+
+   unsigned long gaps = 0, wide = 0;
+   for (uint32_t b=0; b<LH::BUCKET_COUNT; ++b)
+   {
+      uint64_t high = LH::highest_in_bucket(b);
+      uint64_t low = b ? LH::highest_in_bucket(b-1) + 1 : 0;
+      if (LH::bucket_of(low)!=b || LH::bucket_of(high)!=b)
+         ++gaps;
+      if (low >= 2 * LH::SUB_COUNT && (high - low + 1) > low / LH::SUB_COUNT)
+         ++wide;
+   }
+   CHECK(gaps==0 && wide==0);
+   CHECK(LH::bucket_of(7)==7);
+   CHECK(LH::highest_in_bucket(LH::BUCKET_COUNT-1)==std::numeric_limits<uint64_t>::max());
+
+   LH first, second, all;
+   for (uint64_t v=1; v<=1000; ++v)
+   {
+      (v % 2 ? first : second).record(v * 1000);
+      all.record(v * 1000);
+   }
+   CHECK(all.count()==1000 && all.min()==1000 && all.max()==1000000 && all.mean()==500500.0);
+
+   uint64_t p50 = all.value_at_percentile(50);
+   CHECK(p50 >= 500000 && p50 <= 500000 + 500000 / LH::SUB_COUNT);
+   CHECK(all.value_at_percentile(100)==1000000);
+   CHECK(all.value_at_percentile(0)==LH::highest_in_bucket(LH::bucket_of(1000)));
+
+   first.merge(second);
+   CHECK(first.count()==all.count() && first.min()==all.min() && first.max()==all.max());
+   CHECK(first.value_at_percentile(99)==all.value_at_percentile(99));
+
+   CHECK(normalize_query("SELECT *  FROM t1\n WHERE id=42 AND name='O\\'Brien'")
+         =="SELECT * FROM t1 WHERE id=? AND name=?");
+   CHECK(normalize_query("SELECT id FROM t1 WHERE id IN (1, 2, 3)")=="SELECT id FROM t1 WHERE id IN (?)");
+
+   // Both queries count under one shape, with their rows:
+   Replay_Connection      conn("id:int", 20);
+   Query_Stats_Aggregator stats;
+   uint64_t               rows = 0;
+   auto f = [&rows](Binder &) { ++rows; };
+   Binder_User<decltype(f)> bu(f);
+
+   set_query_observer(&stats);
+   execute_query(conn.mysql(), bu, "SELECT id FROM t1 WHERE id > 5");
+   execute_query(conn.mysql(), bu, "SELECT id FROM t1 WHERE id > 10");
+   set_query_observer(nullptr);
+
+   size_t shapes = 0;
+   stats.for_each([&](const std::string &query, const Query_Stats_Aggregator::Entry &e)
+   {
+      ++shapes;
+      CHECK(query=="SELECT id FROM t1 WHERE id > ?");
+      CHECK(e.calls==2 && e.rows==40 && e.bytes==40 * sizeof(int32_t) && e.latency.count()==2);
+   });
+   CHECK(shapes==1 && rows==40);
+}
+
+/** Batch arrays past the stack budget come from the thread arena and hold the same rows. */
+void check_scratch_spill(void)
+{
+   Replay_Connection conn("id:int,name:varchar:20", 5000);
+   const char        *query = "SELECT id, name FROM t1";
+
+   int64_t expect = 0;
+   auto fpush = [&expect](Binder &binder) { expect += value_of<int32_t>(binder.bind_data[0]); };
+   Binder_User<decltype(fpush)> bu(fpush);
+   execute_prepared_query(conn.mysql(), bu, query);
+
+   // With no stack budget, every scratch allocation is in the arena:
+   size_t saved = get_stack_budget();
+   set_stack_budget(0);
+   thread_arena().trim();
+
+   uint64_t rows = 0, batches = 0;
+   int64_t  sum = 0;
+   auto fbatch = [&](const Row_Batch &batch)
+   {
+      ++batches;
+      const int32_t *ids = column_values<int32_t>(batch.columns[0]);
+      for (uint32_t i=0; i<batch.row_count; ++i, ++rows)
+         sum += ids[i];
+   };
+   execute_query_batch(conn.mysql(), fbatch, query, 1024);
+   size_t reserved = thread_arena().reserved();
+   set_stack_budget(saved);
+
+   CHECK(rows==5000 && batches==5 && sum==expect);
+   CHECK(reserved > 0);
+}
+
+/** Records the thread ids it is asked to stop. */
+class Recording_Canceller : public IQuery_Canceller
+{
+public:
+   Recording_Canceller() : stopped() {}
+   virtual ~Recording_Canceller()    {}
+   virtual void operator()(unsigned long thread_id) const { stopped.push_back(thread_id); }
+
+   mutable std::vector<unsigned long> stopped;
+};
+
+/**
+ * Runs *query* with a callback that returns *control* at row *at*, and
+ * returns the number of rows the callback saw.  With *params*, the
+ * query goes by a prepared statement, else by the text protocol.
+ */
+uint64_t rows_until(MYSQL &mysql, const char *query, const MParam *params,
+                    Row_Control control, uint64_t at, const IQuery_Canceller *canceller)
+{
+   uint64_t rows = 0;
+   auto f = [&rows, control, at](Binder &) -> Row_Control
+   {
+      return ++rows==at ? control : ROW_CONTINUE;
+   };
+   Row_Control_User<decltype(f)> ru(f);
+   execute_query_until(mysql, ru, query, params, canceller);
+   return rows;
+}
+
+/** Early-termination codes end the callbacks, and only ROW_STOP calls the canceller. */
+void check_row_control(void)
+{
+   Replay_Connection conn("id:int,name:varchar:20", 100);
+   const char        *text = "SELECT id, name FROM t1";
+   const char        *prepared = "SELECT id, name FROM t1 WHERE id > ?";
+   int32_t           low = 0;
+   MParam            params[] = { low, MParam() };
+
+   const MParam *modes[] = { nullptr, params };
+   for (const MParam *mode : modes)
+   {
+      const char          *query = mode ? prepared : text;
+      Recording_Canceller canceller;
+
+      CHECK(rows_until(conn.mysql(), query, mode, ROW_CONTINUE, 0, &canceller)==100);
+      CHECK(rows_until(conn.mysql(), query, mode, ROW_SKIP_REST, 3, &canceller)==3);
+      CHECK(canceller.stopped.empty());
+
+      CHECK(rows_until(conn.mysql(), query, mode, ROW_STOP, 3, &canceller)==3);
+      CHECK(canceller.stopped.size()==1 && canceller.stopped[0]==1);
+
+      CHECK(rows_until(conn.mysql(), query, mode, ROW_STOP, 1, nullptr)==1);
+
+      // The connection is free for the next query once the rest is dropped:
+      CHECK(rows_until(conn.mysql(), query, mode, ROW_CONTINUE, 0, nullptr)==100);
+   }
+
+   // The KILL goes by the canceller's own connection, kept between cancels:
+   Kill_Query_Canceller killer;
+   CHECK(rows_until(conn.mysql(), text, nullptr, ROW_STOP, 2, &killer)==2);
+   CHECK(rows_until(conn.mysql(), prepared, params, ROW_STOP, 2, &killer)==2);
+   CHECK(rows_until(conn.mysql(), text, nullptr, ROW_CONTINUE, 0, &killer)==100);
+}
+
+/** Leases reuse idle connections, wait at max_size, close idle ones and reset returned ones. */
+void check_pool(void)
+{
+   Pool_Settings settings = { 0, 1, 60, 60 };
+   Connection_Pool pool(settings);
+   CHECK(pool.open_count()==0);
+
+   uint64_t resets = replay_reset_count();
+   MYSQL    *first = nullptr, *second = nullptr;
+   auto f1 = [&first](MYSQL &mysql) { first = &mysql; };
+   auto f2 = [&second](MYSQL &mysql) { second = &mysql; };
+   start_mysql(pool, f1);
+   start_mysql(pool, f2);
+   CHECK(first==second && pool.connects()==1 && pool.leases()==2);
+   CHECK(replay_reset_count() - resets==2);
+
+   // A lease past max_size waits until the held connection comes back:
+   std::atomic<bool> held(false), done(false), leased(false);
+   auto fhold = [&held, &done](MYSQL &) { held = true; while (!done) std::this_thread::yield(); };
+   auto fwait = [&leased](MYSQL &) { leased = true; };
+   std::thread holder([&pool, &fhold]() { start_mysql(pool, fhold); });
+   while (!held)
+      std::this_thread::yield();
+
+   unsigned long waits = pool.waits();
+   std::thread waiter([&pool, &fwait]() { start_mysql(pool, fwait); });
+   while (pool.waits()==waits)
+      std::this_thread::yield();
+   CHECK(!leased);
+
+   done = true;
+   holder.join();
+   waiter.join();
+   CHECK(leased && pool.open_count()==1 && pool.connects()==1);
+
+   // Past the idle timeout, a connection above min_size is closed and
+   // the next lease opens another, while min_size connections stay:
+   auto fnone = [](MYSQL &) { };
+   Pool_Settings idle = { 0, 2, 0, 60 };
+   Connection_Pool idle_pool(idle);
+   start_mysql(idle_pool, fnone);
+   std::this_thread::sleep_for(std::chrono::milliseconds(2));
+   start_mysql(idle_pool, fnone);
+   CHECK(idle_pool.connects()==2 && idle_pool.open_count()==1);
+
+   Pool_Settings kept = { 1, 2, 0, 60 };
+   Connection_Pool kept_pool(kept);
+   start_mysql(kept_pool, fnone);
+   std::this_thread::sleep_for(std::chrono::milliseconds(2));
+   start_mysql(kept_pool, fnone);
+   CHECK(kept_pool.connects()==1 && kept_pool.open_count()==1);
+}
+
+/** Reads the first column of the next *count* pulled rows into *ids*, and returns how many were read. */
+uint64_t pull_ids(PullPack &pp, std::vector<int32_t> &ids, uint64_t count)
+{
+   ids.clear();
+   while (ids.size() < count && pp.puller(0))
+      ids.push_back(value_of<int32_t>(pp.binder.bind_data[0]));
+   return ids.size();
+}
+
+/** A buffered pull seeks and rewinds on both protocols, and a streamed pull refuses to seek. */
+void check_pull_seek(void)
+{
+   Replay_Connection conn("id:int,name:varchar:20", 50);
+   const char        *text = "SELECT id, name FROM t1";
+   const char        *prepared = "SELECT id, name FROM t1 WHERE id > ?";
+   int32_t           low = 0;
+   MParam            params[] = { low, MParam() };
+   Pull_Options      buffered = buffered_pull_options();
+
+   auto fbuffered = [](PullPack &pp)
+   {
+      std::vector<int32_t> all, part;
+      CHECK(pp.is_buffered() && pp.row_count==50);
+      CHECK(pull_ids(pp, all, 100)==50);
+
+      CHECK(pp.seek(45));
+      CHECK(pull_ids(pp, part, 100)==5 && std::equal(part.begin(), part.end(), all.begin() + 45));
+
+      CHECK(!pp.seek(50));
+      CHECK(pp.rewind());
+      CHECK(pull_ids(pp, part, 3)==3 && std::equal(part.begin(), part.end(), all.begin()));
+
+      CHECK(pp.seek(49));
+      CHECK(pull_ids(pp, part, 100)==1 && part[0]==all[49]);
+   };
+   execute_query_pull(conn.mysql(), fbuffered, text, buffered);
+   execute_query_pull(conn.mysql(), fbuffered, prepared, params, buffered);
+
+   // A streamed result can't go back, but the failed seek leaves it readable:
+   auto fstream = [](PullPack &pp)
+   {
+      std::vector<int32_t> all;
+      CHECK(!pp.is_buffered() && pp.row_count==0);
+      CHECK(pull_ids(pp, all, 10)==10);
+      CHECK(!pp.seek(0) && !pp.rewind());
+      CHECK(pull_ids(pp, all, 100)==40);
+   };
+   execute_query_pull(conn.mysql(), fstream, text);
+   execute_query_pull(conn.mysql(), fstream, prepared, params);
+}
+
+/** Returns the buffer_length of each result field bound for a pull of *query* with *options*. */
+std::vector<unsigned long> bound_lengths(MYSQL &mysql, const char *query, const MParam *params,
+                                         const Pull_Options &options)
+{
+   std::vector<unsigned long> lengths;
+   auto f = [&lengths](PullPack &pp)
+   {
+      for (uint32_t i=0; i<pp.binder.field_count; ++i)
+         lengths.push_back(pp.binder.bind_data[i].bind->buffer_length);
+      while (pp.puller(1))
+         ;
+   };
+   execute_query_pull(mysql, f, query, params, options);
+   return lengths;
+}
+
+/** Variable-length field buffers follow each Buffer_Sizing policy, and fixed-length ones keep their size. */
+void check_buffer_sizing(void)
+{
+   Replay_Connection conn("id:int,name:varchar:200,note:varchar:3000", 100, 40);
+   const char        *query = "SELECT id, name, note FROM t1 WHERE id > ?";
+   int32_t           low = 0;
+   MParam            params[] = { low, MParam() };
+
+   unsigned long longest[2] = { 0, 0 };
+   auto f = [&longest](Binder &b)
+   {
+      for (int i=0; i<2; ++i)
+         if (*b.bind_data[i+1].bind->length > longest[i])
+            longest[i] = *b.bind_data[i+1].bind->length;
+   };
+   Binder_User<decltype(f)> bu(f);
+   execute_query(conn.mysql(), bu, query, params);
+   CHECK(longest[0] > 10 && longest[0] <= 40 && longest[1] > 10 && longest[1] <= 40);
+
+   // The declared length, clamped to max_result_buffer:
+   std::vector<unsigned long> lengths = bound_lengths(conn.mysql(), query, params, buffered_pull_options());
+   CHECK(lengths.size()==3 && lengths[0]==sizeof(int32_t));
+   CHECK(lengths[1]==200 && lengths[2]==max_result_buffer);
+
+   // The longest value in each column:
+   lengths = bound_lengths(conn.mysql(), query, params, adaptive_pull_options());
+   CHECK(lengths[0]==sizeof(int32_t) && lengths[1]==longest[0] && lengths[2]==longest[1]);
+
+   // The longest value, up to the limit:
+   lengths = bound_lengths(conn.mysql(), query, params, adaptive_pull_options(10));
+   CHECK(lengths[0]==sizeof(int32_t) && lengths[1]==10 && lengths[2]==10);
+
+   // A named column gets its own size, whatever the other rules:
+   Column_Size overrides[] = { { "note", 500 }, { "id", 1 }, { nullptr, 0 } };
+   lengths = bound_lengths(conn.mysql(), query, params, adaptive_pull_options(10, overrides));
+   CHECK(lengths[0]==sizeof(int32_t) && lengths[1]==10 && lengths[2]==500);
+
+   // A streamed result reports no max_length, so the declared length is used:
+   Pull_Options streamed = adaptive_pull_options();
+   streamed.mode = FETCH_STREAM;
+   lengths = bound_lengths(conn.mysql(), query, params, streamed);
+   CHECK(lengths[1]==200 && lengths[2]==max_result_buffer);
+}
+
+/** Integer fields get the handler of their width and signedness, and type names are found in any case. */
+void check_bdtype(void)
+{
+   struct Integer_Field
+   {
+      enum_field_types type;
+      const char       *name;
+   };
+   const Integer_Field widths[] = {
+      { MYSQL_TYPE_TINY,     "TINYINT" },
+      { MYSQL_TYPE_SHORT,    "SMALLINT" },
+      { MYSQL_TYPE_LONG,     "INT" },
+      { MYSQL_TYPE_LONGLONG, "BIGINT" }
+   };
+
+   for (const Integer_Field &width : widths)
+   {
+      MYSQL_FIELD field;
+      memset(&field, 0, sizeof(field));
+      field.type = width.type;
+
+      const BDType *sig = get_bdtype(field);
+      CHECK(sig && sig->field_type()==width.type && !sig->is_unsigned());
+      CHECK(sig && 0==strcmp(sig->type_name(), width.name));
+
+      field.flags = UNSIGNED_FLAG;
+      const BDType *uns = get_bdtype(field);
+      std::string uname = std::string(width.name) + " UNSIGNED";
+      CHECK(uns && uns->field_type()==width.type && uns->is_unsigned());
+      CHECK(uns && uname==uns->type_name());
+
+      CHECK(get_bdtype(width.name)==sig && get_bdtype(uname.c_str())==uns);
+   }
+
+   // A type without an unsigned handler uses its one handler for both:
+   MYSQL_FIELD field;
+   memset(&field, 0, sizeof(field));
+   field.type = MYSQL_TYPE_DOUBLE;
+   const BDType *dbl = get_bdtype(field);
+   field.flags = UNSIGNED_FLAG;
+   CHECK(dbl && get_bdtype(field)==dbl && 0==strcmp(dbl->type_name(), "DOUBLE"));
+
+   CHECK(get_bdtype("int unsigned")==get_bdtype("INT UNSIGNED"));
+   CHECK(get_bdtype("Varchar")==&bd_VarString);
+   CHECK(get_bdtype("INTEGER")==nullptr && get_bdtype("")==nullptr);
+
+   // Fetched unsigned values read back without a sign:
+   Replay_Connection conn("small:tinyint:4:u,big:bigint:20:u", 20);
+   bool all_unsigned = true;
+   auto f = [&all_unsigned](Binder &b)
+   {
+      for (uint32_t i=0; i<b.field_count; ++i)
+         all_unsigned = all_unsigned && b.bind_data[i].bdtype->is_unsigned();
+   };
+   Binder_User<decltype(f)> bu(f);
+   int32_t low = 0;
+   MParam  params[] = { low, MParam() };
+   execute_query(conn.mysql(), bu, "SELECT small, big FROM t1");
+   execute_query(conn.mysql(), bu, "SELECT small, big FROM t1 WHERE small > ?", params);
+   CHECK(all_unsigned);
+}
+
+/** execute_query_inline() reads the same rows as execute_query(), and an exception from its callback leaves the connection usable. */
+void check_query_inline(void)
+{
+   Replay_Connection conn("id:int,name:varchar:20", 500);
+   const char        *text = "SELECT id, name FROM t1";
+   const char        *prepared = "SELECT id, name FROM t1 WHERE id > ?";
+   int32_t           low = 0;
+   MParam            params[] = { low, MParam() };
+
+   int64_t expect = 0;
+   auto fpush = [&expect](Binder &b) { expect += value_of<int32_t>(b.bind_data[0]); };
+   Binder_User<decltype(fpush)> bu(fpush);
+   execute_query(conn.mysql(), bu, text);
+
+   int64_t  sum = 0;
+   uint64_t rows = 0;
+   auto f = [&sum, &rows](Binder &b) { sum += value_of<int32_t>(b.bind_data[0]); ++rows; };
+   execute_query_inline(conn.mysql(), f, text);
+   CHECK(rows==500 && sum==expect);
+
+   sum = 0;
+   rows = 0;
+   execute_query_inline(conn.mysql(), f, prepared, params);
+   CHECK(rows==500 && sum==expect);
+
+   auto fthrow = [](Binder &) { throw std::runtime_error("stop"); };
+   CHECK(throws([&]() { execute_query_inline(conn.mysql(), fthrow, text); }));
+   CHECK(throws([&]() { execute_query_inline(conn.mysql(), fthrow, prepared, params); }));
+
+   sum = 0;
+   rows = 0;
+   execute_query_inline(conn.mysql(), f, text);
+   CHECK(rows==500 && sum==expect);
+}
+
+/** One row of the typed check, read with execute_query_into(). */
+struct Typed_Row
+{
+   int32_t                  id;
+   Nullable<int32_t>        score;
+   Fixed_String<8>          name;
+};
+MYSQLCB_STRUCT_FIELDS(Typed_Row, s.id, s.score, s.name)
+
+/** True if a one-column result of type *spec* can be read as T. */
+template <typename T>
+bool reads_as(MYSQL &mysql, const char *spec)
+{
+   replay_columns(spec);
+   auto f = [](const T &) { };
+   return !throws([&]() { execute_query_as<T>(mysql, f, "SELECT x FROM t1"); });
+}
+
+/**
+ * Typed reads check the column count and types before the first row,
+ * clear NULL values, and report truncated strings.
+ */
+void check_typed(void)
+{
+   Replay_Connection conn("id:int,score:int:11:null,name:varchar:40", 100, 24);
+   const char        *query = "SELECT id, score, name FROM t1";
+
+   // What the Binder reads, to compare against:
+   std::vector<bool>        nulls;
+   std::vector<int32_t>     scores;
+   std::vector<std::string> names;
+   auto fpush = [&](Binder &b)
+   {
+      nulls.push_back(b.bind_data[1].is_null);
+      scores.push_back(b.bind_data[1].is_null ? 0 : value_of<int32_t>(b.bind_data[1]));
+      names.push_back(std::string(static_cast<const char*>(b.bind_data[2].data), *b.bind_data[2].bind->length));
+   };
+   Binder_User<decltype(fpush)> bu(fpush);
+   int32_t low = 0;
+   MParam  params[] = { low, MParam() };
+   execute_query(conn.mysql(), bu, "SELECT id, score, name FROM t1 WHERE id > ?", params);
+   CHECK(nulls.size()==100 && std::count(nulls.begin(), nulls.end(), true)==10);
+
+   size_t row = 0;
+   bool   same = true, some_truncated = false;
+   auto fas = [&](int32_t, const Nullable<int32_t> &score, const Fixed_String<8> &name)
+   {
+      same = same && score.is_null==nulls[row] && score.value==scores[row];
+      same = same && name.length==names[row].length() && name.str()==names[row].substr(0, 8);
+      same = same && name.is_truncated()==(names[row].length() > 8);
+      some_truncated = some_truncated || name.is_truncated();
+      ++row;
+   };
+   execute_query_as<int32_t, Nullable<int32_t>, Fixed_String<8>>(conn.mysql(), fas, query);
+   CHECK(row==100 && same && some_truncated);
+
+   // A plain type reads NULL as its default value:
+   row = 0;
+   same = true;
+   auto fplain = [&](int32_t, int32_t score, const Fixed_String<64> &) { same = same && score==scores[row++]; };
+   execute_query_as<int32_t, int32_t, Fixed_String<64>>(conn.mysql(), fplain, query);
+   CHECK(row==100 && same);
+
+   row = 0;
+   same = true;
+   auto finto = [&](const Typed_Row &r)
+   {
+      same = same && r.score.is_null==nulls[row] && r.name.length==names[row].length();
+      ++row;
+   };
+   execute_query_into<Typed_Row>(conn.mysql(), finto, query);
+   CHECK(row==100 && same);
+
+   // Column counts must match:
+   auto ftwo = [](int32_t, int32_t) { };
+   CHECK(throws([&]() { execute_query_as<int32_t, int32_t>(conn.mysql(), ftwo, query); }));
+   auto ffour = [](int32_t, int32_t, int32_t, int32_t) { };
+   CHECK(throws([&]() { execute_query_as<int32_t, int32_t, int32_t, int32_t>(conn.mysql(), ffour, query); }));
+
+   // Types that would lose values are rejected, and those that hold them accepted:
+   CHECK(!reads_as<int16_t>(conn.mysql(), "x:int"));
+   CHECK(!reads_as<uint32_t>(conn.mysql(), "x:int"));
+   CHECK(!reads_as<int32_t>(conn.mysql(), "x:int:11:u"));
+   CHECK(!reads_as<double>(conn.mysql(), "x:bigint"));
+   CHECK(!reads_as<double>(conn.mysql(), "x:decimal:10"));
+   CHECK(!reads_as<float>(conn.mysql(), "x:double"));
+   CHECK(!reads_as<float>(conn.mysql(), "x:int"));
+   CHECK(!reads_as<MYSQL_TIME>(conn.mysql(), "x:int"));
+   CHECK(reads_as<int64_t>(conn.mysql(), "x:int:11:u"));
+   CHECK(reads_as<uint32_t>(conn.mysql(), "x:int:11:u"));
+   CHECK(reads_as<int64_t>(conn.mysql(), "x:bigint"));
+   CHECK(reads_as<double>(conn.mysql(), "x:int"));
+   CHECK(reads_as<double>(conn.mysql(), "x:double"));
+   CHECK(reads_as<float>(conn.mysql(), "x:float"));
+   CHECK(reads_as<MYSQL_TIME>(conn.mysql(), "x:datetime"));
+   CHECK(reads_as<Fixed_String<16>>(conn.mysql(), "x:decimal:10"));
+}
+
+/** Batched values longer than the column width keep their full length, so truncation shows. */
+void check_batch_truncation(void)
+{
+   Replay_Connection conn("id:int,note:varchar:3000:null", 200, 1500);
+   const char        *query = "SELECT id, note FROM t1";
+
+   std::vector<std::string> notes;
+   std::vector<bool>        nulls;
+   auto fpush = [&](Binder &b)
+   {
+      const Bind_Data &bd = b.bind_data[1];
+      nulls.push_back(bd.is_null);
+      notes.push_back(bd.is_null ? std::string() : std::string(static_cast<const char*>(bd.data), available_length(bd)));
+      if (!bd.is_null)
+         notes.back().resize(bd.len_data, '?');
+   };
+   Binder_User<decltype(fpush)> bu(fpush);
+   int32_t low = 0;
+   MParam  params[] = { low, MParam() };
+   execute_query(conn.mysql(), bu, "SELECT id, note FROM t1 WHERE id > ?", params);
+
+   uint64_t row = 0, truncated = 0, whole = 0;
+   bool     same = true;
+   auto fbatch = [&](const Row_Batch &batch)
+   {
+      const Column_Batch &col = batch.columns[1];
+      same = same && col.width==max_result_buffer && col.lengths!=nullptr;
+      for (uint32_t i=0; i<batch.row_count; ++i, ++row)
+      {
+         const std::string &note = notes[row];
+         if (is_null(col, i))
+         {
+            same = same && nulls[row] && col.lengths[i]==0 && !is_truncated(col, i);
+            continue;
+         }
+
+         unsigned long kept = column_length(col, i);
+         same = same && !nulls[row] && col.lengths[i]==note.length();
+         same = same && is_truncated(col, i)==(note.length() > col.width);
+         same = same && kept==(note.length() < col.width ? note.length() : col.width);
+         same = same && 0==memcmp(column_text(col, i), note.data(), kept);
+         if (is_truncated(col, i))
+            ++truncated;
+         else
+            ++whole;
+      }
+   };
+   execute_query_batch(conn.mysql(), fbatch, query, 64);
+   CHECK(row==200 && same);
+   CHECK(truncated > 0 && whole > 0);
+}
+
+/**
+ * The inserter quotes and escapes strings, tells NULL from an empty
+ * string, keeps fractions of a second, refuses non-finite numbers, and
+ * sends its rows at the row and byte limits.
+ */
+void check_inserter(void)
+{
+   // No max_allowed_packet row, so the settings alone set the limit:
+   Replay_Connection conn("v:bigint", 0);
+
+   Inserter_Settings manual = { 0, 0, 0 };
+   Bulk_Inserter     ins(conn.mysql(), "t1", "id, name, note, extra, price, made", nullptr, manual);
+   CHECK(ins.column_count()==6 && ins.statement_limit()==0);
+
+   int        id = 7;
+   double     price = 2.5;
+   MYSQL_TIME made;
+   memset(&made, 0, sizeof(made));
+   made.year = 2024;
+   made.month = 2;
+   made.day = 29;
+   made.hour = 12;
+   made.minute = 34;
+   made.second = 56;
+   made.second_part = 250000;
+   made.time_type = MYSQL_TIMESTAMP_DATETIME;
+
+   MParam row[] = { id, "O'Brien \\ \"x\"", "", MParam(), price, made };
+   ins.add(row);
+   made.second_part = 0;
+   MParam whole[] = { id, "a", "b", "c", price, made };
+   ins.add(whole);
+   CHECK(ins.pending_rows()==2 && ins.statements()==0);
+   ins.flush();
+   CHECK(ins.pending_rows()==0 && ins.statements()==1 && ins.rows_written()==2);
+   CHECK(replay_last_query()=="INSERT INTO t1 (id, name, note, extra, price, made) VALUES "
+         "(7,'O\\'Brien \\\\ \\\"x\\\"','',NULL,2.5,'2024-02-29 12:34:56.250000'),"
+         "(7,'a','b','c',2.5,'2024-02-29 12:34:56')");
+
+   double nan = std::numeric_limits<double>::quiet_NaN();
+   double inf = std::numeric_limits<double>::infinity();
+   MParam bad_nan[] = { id, "a", "b", "c", nan, made };
+   MParam bad_inf[] = { id, "a", "b", "c", inf, made };
+   CHECK(throws([&]() { ins.add(bad_nan); }));
+   CHECK(throws([&]() { ins.add(bad_inf); }));
+   CHECK(ins.pending_rows()==0);
+
+   // Every max_rows rows go in a statement:
+   Inserter_Settings by_rows = { 0, 3, 0 };
+   Bulk_Inserter     counted(conn.mysql(), "t1", "id", nullptr, by_rows);
+   MParam            one[] = { id };
+   for (int i=0; i<7; ++i)
+      counted.add(one);
+   CHECK(counted.statements()==2 && counted.rows_written()==6 && counted.pending_rows()==1);
+   CHECK(replay_last_query()=="INSERT INTO t1 (id) VALUES (7),(7),(7)");
+   counted.flush();
+   CHECK(counted.statements()==3 && counted.rows_written()==7);
+
+   // A statement stays under max_bytes, but a longer row is sent alone:
+   Inserter_Settings by_bytes = { 150, 0, 0 };
+   Bulk_Inserter     sized(conn.mysql(), "t1", "id, name", "id=id", by_bytes);
+   MParam            pair[] = { id, "abcdef" };
+   bool              under = true;
+   for (int i=0; i<20; ++i)
+   {
+      sized.add(pair);
+      under = under && replay_last_query().size() <= 150;
+   }
+   CHECK(under && sized.statements() > 1 && sized.rows_written() + sized.pending_rows()==20);
+
+   std::string long_name(200, 'z');
+   MParam      big[] = { id, long_name.c_str() };
+   sized.add(big);
+   sized.flush();
+   CHECK(replay_last_query()=="INSERT INTO t1 (id, name) VALUES (7,'" + long_name + "') ON DUPLICATE KEY UPDATE id=id");
+   CHECK(sized.rows_written()==21);
+}
+
+/** Text-protocol queries read past the results after the first, so the connection takes the next query. */
+void check_multi_results(void)
+{
+   Replay_Connection conn("id:int", 30);
+   uint64_t          rows = 0;
+   auto f = [&rows](Binder &) { ++rows; };
+   Binder_User<decltype(f)> bu(f);
+
+   // A CALL is followed by a status result:
+   execute_query(conn.mysql(), bu, "CALL list_ids()");
+   CHECK(rows==30);
+
+   // Only the first result of a multi-statement query reaches the callback:
+   rows = 0;
+   execute_query(conn.mysql(), bu, "SELECT id FROM t1; UPDATE t1 SET id=id; SELECT id FROM t1");
+   CHECK(rows==30);
+
+   // Nor does an UPDATE first hide the rest:
+   execute_query(conn.mysql(), bu, "UPDATE t1 SET id=id; SELECT id FROM t1");
+   CHECK(rows==30);
+
+   // A streamed pull that stops early, and a callback that throws:
+   auto fpull = [](PullPack &pp)
+   {
+      std::vector<int32_t> ids;
+      CHECK(pull_ids(pp, ids, 5)==5);
+   };
+   execute_query_pull(conn.mysql(), fpull, "SELECT id FROM t1; SELECT id FROM t1");
+
+   auto fthrow = [](Binder &) { throw std::runtime_error("stop"); };
+   Binder_User<decltype(fthrow)> bthrow(fthrow);
+   CHECK(throws([&]() { execute_query(conn.mysql(), bthrow, "CALL list_ids()"); }));
+
+   rows = 0;
+   execute_query(conn.mysql(), bu, "SELECT id FROM t1");
+   CHECK(rows==30);
+}
+
+/** Splits the key span from MIN *low* to MAX *high*, read from a loaded replay file, with get_key_ranges(). */
+std::vector<Key_Range> key_ranges(MYSQL &mysql, const char *low, const char *high, uint32_t max_ranges)
+{
+   const char *path = "checks_key_range.tmp";
+   {
+      std::ofstream out(path);
+      out << "low:bigint,high:bigint\n" << low << '\t' << high << '\n';
+   }
+   replay_load(path);
+   remove(path);
+
+   std::vector<Key_Range> ranges(max_ranges);
+   ranges.resize(get_key_ranges(mysql, ranges.data(), max_ranges, "t1", "id"));
+   return ranges;
+}
+
+/** True if *ranges* cover *low* to *high* in order, without gaps or overlaps, in widths that differ by at most one. */
+bool covers(const std::vector<Key_Range> &ranges, int64_t low, int64_t high)
+{
+   if (ranges.empty() || ranges.front().low!=low || ranges.back().high!=high)
+      return false;
+
+   uint64_t widest = 0, narrowest = std::numeric_limits<uint64_t>::max();
+   for (size_t i=0; i<ranges.size(); ++i)
+   {
+      // Unsigned, so the width of a range of any two int64_t values fits:
+      uint64_t width = static_cast<uint64_t>(ranges[i].high) - static_cast<uint64_t>(ranges[i].low);
+      if (ranges[i].low > ranges[i].high)
+         return false;
+      if (i && static_cast<uint64_t>(ranges[i-1].high) + 1!=static_cast<uint64_t>(ranges[i].low))
+         return false;
+      widest = std::max(widest, width);
+      narrowest = std::min(narrowest, width);
+   }
+   return widest - narrowest <= 1;
+}
+
+/** Key spans split into contiguous ranges, fewer when the span is narrow, and ordered scans of them. */
+void check_key_ranges(void)
+{
+   const int64_t     lowest = std::numeric_limits<int64_t>::min();
+   const int64_t     highest = std::numeric_limits<int64_t>::max();
+   Replay_Connection conn("id:bigint", 1);
+
+   std::vector<Key_Range> ranges = key_ranges(conn.mysql(), "1", "100", 16);
+   CHECK(ranges.size()==16 && covers(ranges, 1, 100));
+
+   // A span narrower than the ranges asked for gets one range per value:
+   ranges = key_ranges(conn.mysql(), "5", "7", 16);
+   CHECK(ranges.size()==3 && covers(ranges, 5, 7));
+   CHECK(ranges[0].high==5 && ranges[1].high==6 && ranges[2].high==7);
+
+   ranges = key_ranges(conn.mysql(), "-3", "-3", 4);
+   CHECK(ranges.size()==1 && covers(ranges, -3, -3));
+
+   // One value more than the ranges, so the first range is one wider:
+   ranges = key_ranges(conn.mysql(), "0", "4", 4);
+   CHECK(ranges.size()==4 && covers(ranges, 0, 4) && ranges[0].high==1);
+
+   // The extremes of the key type, where the span overflows int64_t:
+   ranges = key_ranges(conn.mysql(), "-9223372036854775808", "9223372036854775807", 4);
+   CHECK(ranges.size()==4 && covers(ranges, lowest, highest));
+   CHECK(ranges[1].low==lowest / 2 && ranges[2].low==0);
+
+   ranges = key_ranges(conn.mysql(), "9223372036854775806", "9223372036854775807", 8);
+   CHECK(ranges.size()==2 && covers(ranges, highest - 1, highest));
+
+   ranges = key_ranges(conn.mysql(), "-9223372036854775808", "-9223372036854775808", 8);
+   CHECK(ranges.size()==1 && covers(ranges, lowest, lowest));
+
+   // No matching rows, or no ranges asked for:
+   CHECK(key_ranges(conn.mysql(), "\\N", "\\N", 4).empty());
+   CHECK(key_ranges(conn.mysql(), "1", "100", 0).empty());
+
+   // An ordered scan reads each range through a cursor; the stand-in
+   // returns the loaded row for every range:
+   key_ranges(conn.mysql(), "1", "100", 1);
+   Pool_Settings   settings = { 0, 2, 60, 60 };
+   Connection_Pool pool(settings);
+   Scan_Settings   scan = { 4, 2, true };
+   uint64_t        rows = 0;
+   auto f = [&rows](Binder &) { ++rows; };
+   scan_table(pool, f, "t1", "id", "id", nullptr, scan);
+   CHECK(rows==4);
+}
+
+/** Counts the rows execute_query() reads from *query*, which throws if the connection is still busy. */
+uint64_t count_rows(MYSQL &mysql, const char *query)
+{
+   uint64_t rows = 0;
+   auto f = [&rows](Binder &) { ++rows; };
+   Binder_User<decltype(f)> bu(f);
+   execute_query(mysql, bu, query);
+   return rows;
+}
+
+/**
+ * Query_Cursor and Row_Generator read every row, free the connection
+ * when destroyed part way through a result, and pass on exceptions.
+ */
+void check_cursor(void)
+{
+   Replay_Connection conn("id:int", 50);
+   const char        *query = "SELECT id FROM t1";
+
+   int64_t expect = 0;
+   auto fsum = [&expect](Binder &b) { expect += value_of<int32_t>(b.bind_data[0]); };
+   Binder_User<decltype(fsum)> bu(fsum);
+   execute_query(conn.mysql(), bu, query);
+
+   int64_t sum = 0;
+   {
+      Query_Cursor cursor(conn.mysql(), query);
+      while (cursor.next())
+         sum += value_of<int32_t>(cursor.binder().bind_data[0]);
+      CHECK(sum==expect && cursor.rows_fetched()==50 && !cursor.next());
+   }
+
+   // A streamed cursor holds the connection until it is destroyed:
+   {
+      Query_Cursor cursor(conn.mysql(), query);
+      CHECK(cursor.next() && cursor.next());
+      CHECK(throws([&]() { Query_Cursor other(conn.mysql(), query); }));
+      CHECK(throws([&]() { count_rows(conn.mysql(), query); }));
+   }
+   CHECK(count_rows(conn.mysql(), query)==50);
+
+   // Buffered cursors of one connection can be read side by side:
+   Pull_Options buffered = buffered_pull_options();
+   {
+      Query_Cursor left(conn.mysql(), query, nullptr, &buffered);
+      Query_Cursor right(conn.mysql(), query, nullptr, &buffered);
+      bool same = true;
+      while (left.next() && right.next())
+         same = same && value_of<int32_t>(left.binder().bind_data[0])==value_of<int32_t>(right.binder().bind_data[0]);
+      CHECK(same && left.row_count()==50 && right.rows_fetched()==50);
+      CHECK(right.seek(49) && right.next() && !right.next() && !right.seek(50));
+   }
+
+   // An exception out of the row loop leaves the connection usable:
+   CHECK(throws([&]()
+   {
+      Query_Cursor cursor(conn.mysql(), query);
+      while (cursor.next())
+         if (cursor.rows_fetched()==10)
+            throw std::runtime_error("stop");
+   }));
+   CHECK(count_rows(conn.mysql(), query)==50);
+
+#ifdef MYSQLCB_COROUTINES
+   sum = 0;
+   uint64_t rows = 0;
+   for (Binder &b : query_rows(conn.mysql(), query))
+   {
+      sum += value_of<int32_t>(b.bind_data[0]);
+      ++rows;
+   }
+   CHECK(rows==50 && sum==expect);
+
+   {
+      Row_Generator gen = query_rows(conn.mysql(), query);
+      CHECK(gen.next() && gen.next());
+   }
+   CHECK(count_rows(conn.mysql(), query)==50);
+
+   // The query runs at the first next(), which throws its error:
+   {
+      Query_Cursor  busy(conn.mysql(), query);
+      Row_Generator gen = query_rows(conn.mysql(), query);
+      CHECK(busy.next() && throws([&]() { gen.next(); }));
+      CHECK(!gen.next());
+   }
+
+   CHECK(throws([&]()
+   {
+      for (Binder &b : query_rows(conn.mysql(), query))
+         if (value_of<int32_t>(b.bind_data[0])!=0)
+            throw std::runtime_error("stop");
+   }));
+   CHECK(count_rows(conn.mysql(), query)==50);
+#endif
+}
+
+#ifdef LIBMARIADB
+/**
+ * Async_Loop connections deliver their rows, let a completion callback
+ * start the next query, report a failed query without disturbing the
+ * others, and are idle again after a row callback throws.  The
+ * stand-in finishes each non-blocking call at once.
+ */
+void check_async(void)
+{
+   Replay_Connection conn("id:int", 40);
+   const char        *query = "SELECT id FROM t1";
+
+   int64_t expect = 0;
+   auto fexpect = [&expect](Binder &b) { expect += value_of<int32_t>(b.bind_data[0]); };
+   Binder_User<decltype(fexpect)> bexpect(fexpect);
+   execute_query(conn.mysql(), bexpect, query);
+
+   Async_Loop       loop;
+   Async_Connection conns[3];
+   unsigned         finished = 0;
+   auto fcount = [&finished](Async_Connection &) { ++finished; };
+   Async_User<decltype(fcount)> counted(fcount);
+
+   for (Async_Connection &c : conns)
+      loop.connect(c, nullptr, nullptr, nullptr, nullptr, &counted);
+   loop.run();
+   CHECK(finished==3);
+   for (Async_Connection &c : conns)
+      CHECK(c.is_open() && !c.is_busy() && !c.failed());
+
+   int64_t  sum = 0;
+   uint64_t rows = 0;
+   auto f = [&sum, &rows](Binder &b) { sum += value_of<int32_t>(b.bind_data[0]); ++rows; };
+   Binder_User<decltype(f)> bu(f);
+
+   // The first query to finish starts one more on its connection:
+   const IAsync_Callback *chain = nullptr;
+   bool                  chained = false;
+   finished = 0;
+   auto fchain = [&](Async_Connection &c)
+   {
+      ++finished;
+      if (!chained)
+      {
+         chained = true;
+         loop.execute_query(c, bu, query, nullptr, chain);
+      }
+   };
+   Async_User<decltype(fchain)> chaining(fchain);
+   chain = &chaining;
+
+   for (Async_Connection &c : conns)
+      loop.execute_query(c, bu, query, nullptr, &chaining);
+   loop.run();
+   CHECK(finished==4 && rows==160 && sum==4 * expect);
+   for (Async_Connection &c : conns)
+      CHECK(c.row_count()==40 && c.state()==Async_Connection::ASYNC_IDLE);
+
+   loop.execute_query(conns[0], bu, "UPDATE t1 SET id=id");
+   loop.run();
+   CHECK(conns[0].row_count()==0 && conns[0].affected_rows()==1);
+
+   // A connection still streaming another result fails the query alone:
+   finished = 0;
+   rows = 0;
+   {
+      Query_Cursor busy(conns[0].mysql(), query);
+      CHECK(busy.next());
+      loop.execute_query(conns[0], bu, query, nullptr, &counted);
+      loop.execute_query(conns[1], bu, query, nullptr, &counted);
+      loop.run();
+   }
+   CHECK(finished==2 && rows==40);
+   CHECK(conns[0].failed() && strstr(conns[0].error(), "out of sync") && !conns[0].is_busy());
+   CHECK(!conns[1].failed() && conns[1].row_count()==40);
+
+   // A throwing row callback leaves its connection idle for the next query:
+   auto fthrow = [](Binder &) { throw std::runtime_error("stop"); };
+   Binder_User<decltype(fthrow)> bthrow(fthrow);
+   CHECK(throws([&]()
+   {
+      loop.execute_query(conns[2], bthrow, query);
+      loop.run();
+   }));
+   CHECK(conns[2].state()==Async_Connection::ASYNC_IDLE && loop.pending()==0);
+
+   rows = 0;
+   loop.execute_query(conns[0], bu, query);
+   loop.execute_query(conns[2], bu, query);
+   loop.run();
+   CHECK(rows==80 && !conns[0].failed() && conns[2].row_count()==40);
+}
+#endif
+
+/**
+ * Fanout_Executor runs queries at the same time, serializes a merged
+ * callback, and finishes the other queries when one fails.
+ */
+void check_fanout(void)
+{
+   Replay_Connection conn("id:int", 40);
+   Pool_Settings     settings = { 0, 3, 60, 60 };
+   Connection_Pool   pool(settings);
+   Fanout_Executor   fan(pool, 3);
+   const char        *query = "SELECT id FROM t1 WHERE id > ?";
+   int32_t           shard[6] = { 0, 10, 20, 30, 40, 50 };
+   MParam            params[6][2];
+   Fanout_Query      queries[6];
+   for (uint32_t i=0; i<6; ++i)
+   {
+      params[i][0] = shard[i];
+      params[i][1] = MParam();
+      queries[i] = Fanout_Query{ query, params[i], nullptr };
+   }
+
+   // The merged callback sees every row with its query's index, one call at a time:
+   std::vector<uint64_t> rows(6, 0);
+   std::atomic<int>      inside(0);
+   std::atomic<bool>     overlapped(false);
+   auto fmerged = [&](uint32_t index, Binder &)
+   {
+      if (++inside > 1)
+         overlapped = true;
+      ++rows[index];
+      --inside;
+   };
+   Fanout_User<decltype(fmerged)> fu(fmerged);
+   fan.execute(queries, 6, fu);
+   CHECK(!overlapped && fan.failures()==0);
+   CHECK(std::count(rows.begin(), rows.end(), 40)==6);
+
+   // Each query's own callback, with two queries in flight at once:
+   std::atomic<int> started(0);
+   std::atomic<int> together(0);
+   auto fown = [&](Binder &)
+   {
+      auto until = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+      int  now = ++started;
+      while (started < 2 && std::chrono::steady_clock::now() < until)
+         std::this_thread::yield();
+      if (now <= 2 && started >= 2)
+         ++together;
+   };
+   Binder_User<decltype(fown)> own(fown);
+   for (Fanout_Query &q : queries)
+      q.cb = &own;
+   fan.execute(queries, 2);
+   CHECK(together==2 && pool.open_count()>=2);
+
+   // A failed query is rethrown after the rest have run:
+   uint64_t done = 0;
+   std::mutex done_mutex;
+   auto fcount = [&](Binder &) { std::lock_guard<std::mutex> lock(done_mutex); ++done; };
+   auto fthrow = [](Binder &) { throw std::runtime_error("stop"); };
+   Binder_User<decltype(fcount)> counted(fcount);
+   Binder_User<decltype(fthrow)> thrower(fthrow);
+   for (Fanout_Query &q : queries)
+      q.cb = &counted;
+   queries[1].cb = &thrower;
+   CHECK(throws([&]() { fan.execute(queries, 6); }));
+   CHECK(fan.failures()==1 && done==5 * 40);
+
+   // and the pool's connections are still good:
+   fan.execute(queries + 2, 4);
+   CHECK(fan.failures()==0 && done==9 * 40);
+}
+
+/** Connection_Options reach the client library, and a pool keeps its own copy of them. */
+void check_connection_options(void)
+{
+   const char  *option_file = "read_default_file=~/.my.cnf read_default_group=client";
+   std::string connected;
+   auto f = [&connected](MYSQL &) { connected = replay_last_connect(); };
+
+   start_mysql(f, "db.example", "app", "secret", "shop");
+   CHECK(connected==std::string(option_file) + " host=db.example user=app dbase=shop");
+
+   Connection_Options local = socket_connection_options("/run/mysqld/mysqld.sock");
+   start_mysql(f, nullptr, nullptr, nullptr, nullptr, &local);
+   CHECK(connected==std::string(option_file) + " socket=/run/mysqld/mysqld.sock");
+
+   Connection_Options remote = compressed_connection_options(3307);
+   remote.multi_statements = true;
+   remote.read_timeout = 5;
+   remote.write_timeout = 7;
+   remote.skip_option_file = true;
+   start_mysql(f, "db.example", "app", "secret", nullptr, &remote);
+   CHECK(connected=="compress read_timeout=5 write_timeout=7 host=db.example user=app port=3307 multi_statements");
+
+   // The pool connects later, after the caller's socket path has changed:
+   Pool_Settings      settings = { 0, 1, 60, 60 };
+   std::string        path = "/run/mysqld/pool.sock";
+   Connection_Options pooled = socket_connection_options(path.c_str());
+   pooled.read_timeout = 9;
+   Connection_Pool    pool(settings, "db.example", nullptr, nullptr, "shop", &pooled);
+   path.assign(path.length(), 'x');
+
+   start_mysql(pool, f);
+   CHECK(connected==std::string(option_file) + " read_timeout=9 host=db.example dbase=shop socket=/run/mysqld/pool.sock");
+}
+
+struct Check
+{
+   const char *name;
+   void       (*run)(void);
+};
+
+const Check all_checks[] = {
+   { "stmt_cache",       check_stmt_cache },
+   { "truncated_stream", check_truncated_stream },
+   { "number_format",    check_number_format },
+   { "time_format",      check_time_format },
+   { "text_fast_path",   check_text_fast_path },
+   { "bulk",             check_bulk },
+   { "histogram",        check_histogram },
+   { "scratch_spill",    check_scratch_spill },
+   { "row_control",      check_row_control },
+   { "pool",             check_pool },
+   { "pull_seek",        check_pull_seek },
+   { "buffer_sizing",    check_buffer_sizing },
+   { "bdtype",           check_bdtype },
+   { "query_inline",     check_query_inline },
+   { "typed",            check_typed },
+   { "batch_truncation", check_batch_truncation },
+   { "inserter",         check_inserter },
+   { "multi_results",    check_multi_results },
+   { "key_ranges",       check_key_ranges },
+   { "cursor",           check_cursor },
+#ifdef LIBMARIADB
+   { "async",            check_async },
+#endif
+   { "fanout",           check_fanout },
+   { "connection_options", check_connection_options },
+   { nullptr,            nullptr }
+};
+
+bool is_selected(const char *name, int argc, char **argv)
+{
+   if (argc < 2)
+      return true;
+   for (int i=1; i<argc; ++i)
+      if (0==strcmp(name, argv[i]))
+         return true;
+   return false;
+}
+
+int main(int argc, char **argv)
+{
+   for (const Check *check=all_checks; check->name; ++check)
+   {
+      if (!is_selected(check->name, argc, argv))
+         continue;
+
+      unsigned long failed = checks_failed;
+      try
+      {
+         check->run();
+      }
+      catch(const std::exception &e)
+      {
+         ++checks_failed;
+         printf("%s: exception: %s\n", check->name, e.what());
+      }
+      printf("%-20s %s\n", check->name, failed==checks_failed ? "ok" : "FAILED");
+   }
+
+   printf("%lu checks, %lu failed\n", checks_run, checks_failed);
+   return checks_failed ? 1 : 0;
+}
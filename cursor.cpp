@@ -0,0 +1,116 @@
+#include <mysql.h>
+#include <stdint.h>  // for uint32_t
+#include <stdexcept>
+#include "mysqlcb_cursor.hpp"
+
+namespace mysqlcb {
+
+Query_Cursor::Query_Cursor(MYSQL &mysql,
+                           const char *query,
+                           const Binder *params,
+                           const Pull_Options *options)
+   : m_stmt(mysql_stmt_init(&mysql)),
+     m_meta(nullptr),
+     m_memory(nullptr),
+     m_binder(),
+     m_buffered(options && options->mode==FETCH_BUFFERED),
+     m_done(false),
+     m_row_count(0),
+     m_rows_fetched(0)
+{
+   if (!m_stmt)
+      throw std::runtime_error("Failed to initialize statement: insufficient memory?");
+
+   try
+   {
+      prepare_statement(m_stmt, query);
+      execute_statement(m_stmt, params, options);
+
+      uint32_t num_fields = mysql_stmt_field_count(m_stmt);
+      if (num_fields)
+      {
+         m_meta = mysql_stmt_result_metadata(m_stmt);
+         if (!m_meta)
+            throw std::runtime_error("Error getting result metadata.");
+
+         MYSQL_FIELD *fields = mysql_fetch_fields(m_meta);
+         const Buffer_Sizing *sizing = options ? &options->sizing : nullptr;
+
+         // The Binder outlives this call, so it can't be on the stack:
+         m_memory = new char[get_result_binds_size(fields, num_fields, sizing)];
+         set_result_binds(m_binder, m_memory, fields, num_fields, sizing);
+         m_binder.stmt = m_stmt;
+
+         if (mysql_stmt_bind_result(m_stmt, m_binder.binds))
+            throw_stmt_error("Failed to bind results", m_stmt);
+      }
+      else
+         m_done = true;
+
+      if (m_buffered)
+         m_row_count = mysql_stmt_num_rows(m_stmt);
+   }
+   catch(...)
+   {
+      release();
+      throw;
+   }
+}
+
+Query_Cursor::~Query_Cursor()
+{
+   release();
+}
+
+void Query_Cursor::release(void)
+{
+   if (m_meta)
+      mysql_free_result(m_meta);
+   if (m_stmt)
+      mysql_stmt_close(m_stmt);
+   delete [] m_memory;
+
+   m_meta = nullptr;
+   m_stmt = nullptr;
+   m_memory = nullptr;
+}
+
+/**
+ * Fetches the next row into the Binder, returning false after the last
+ * row.  As with the pull API, truncated values are flagged for
+ * stream_column().
+ */
+bool Query_Cursor::next(void)
+{
+   if (m_done)
+      return false;
+
+   int result = mysql_stmt_fetch(m_stmt);
+   if (result==0 || result==MYSQL_DATA_TRUNCATED)
+   {
+      mark_truncations(m_binder, result);
+      ++m_rows_fetched;
+      return true;
+   }
+   else if (result==MYSQL_NO_DATA)
+   {
+      m_done = true;
+      return false;
+   }
+   else
+      throw_stmt_error("Failed to fetch row", m_stmt);
+
+   return false;
+}
+
+bool Query_Cursor::seek(uint64_t row)
+{
+   if (!m_buffered || row >= m_row_count)
+      return false;
+
+   mysql_stmt_data_seek(m_stmt, row);
+   m_done = false;
+   return true;
+}
+
+}  // namespace
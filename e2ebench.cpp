@@ -0,0 +1,499 @@
+#include <mysql.h>
+#include <stdio.h>   // for printf(), snprintf()
+#include <stdlib.h>  // for strtoull()
+#include <string.h>  // for strlen(), strchr(), strstr()
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mysqlcb.hpp"
+#include "mysqlcb_inserter.hpp"
+#include "mysqlcb_stats.hpp"
+
+/**
+ * Runs fixed workloads through the library against a real server and
+ * writes the results as JSON.  e2ebench.sh starts a private server on a
+ * Unix socket and runs this program against it; it can also be pointed
+ * at any server with the usual connection options.
+ *
+ * The fixture tables are made fresh in the database (e2ebench unless -d
+ * is given) with reproducible contents, one narrow and one wide, each
+ * with *rows* rows.  Each workload produces one JSON object per table.
+ */
+
+using namespace mysqlcb;
+
+typedef std::chrono::steady_clock Clock;
+
+struct E2E_Settings
+{
+   uint64_t    rows;          ///< Rows in each fixture table
+   uint64_t    lookups;       ///< Point lookups per table
+   uint64_t    ranges;        ///< Range scans per table
+   unsigned    range_rows;    ///< Rows in each range scan
+   unsigned    prefetch_rows; ///< Rows per fetch of the cursor scan
+   const char  *workloads;    ///< Comma-separated workload names, or nullptr for all
+};
+
+struct Fixture
+{
+   const char *table;
+   const char *create;
+   const char *columns;
+   unsigned   text_columns;   ///< VARCHAR columns after id, qty and price
+};
+
+const Fixture fixtures[] = {
+   { "e2e_narrow",
+     "CREATE TABLE e2e_narrow (id INT PRIMARY KEY, qty INT, price DOUBLE, name VARCHAR(32))",
+     "id, qty, price, name",
+     1 },
+   { "e2e_wide",
+     "CREATE TABLE e2e_wide (id INT PRIMARY KEY, qty INT, price DOUBLE,"
+     " name VARCHAR(64), c1 VARCHAR(64), c2 VARCHAR(64), c3 VARCHAR(64),"
+     " c4 VARCHAR(64), c5 VARCHAR(64), c6 VARCHAR(64), note TEXT)",
+     "id, qty, price, name, c1, c2, c3, c4, c5, c6, note",
+     8 },
+   { nullptr, nullptr, nullptr, 0 }
+};
+
+/** The measurements of a workload on a table. */
+struct Workload_Result
+{
+   const char        *workload;
+   const char        *table;
+   uint64_t          ops;
+   uint64_t          rows;
+   uint64_t          bytes;
+   double            seconds;
+   Latency_Histogram latency;   ///< Nanoseconds per operation
+
+   Workload_Result(const char *w, const char *t)
+      : workload(w), table(t), ops(0), rows(0), bytes(0), seconds(0.0), latency() { }
+};
+
+/** Returns a value, in kB, from /proc/self/status, such as "VmRSS" or "VmHWM". */
+unsigned long read_status_kb(const char *name)
+{
+   std::ifstream in("/proc/self/status");
+   std::string   line;
+   size_t        len = strlen(name);
+   while (std::getline(in, line))
+      if (0==line.compare(0, len, name) && line[len]==':')
+         return strtoul(line.c_str() + len + 1, nullptr, 10);
+   return 0;
+}
+
+/** Same numbers each run: a xorshift generator seeded per table. */
+class Fixture_Random
+{
+public:
+   Fixture_Random(uint64_t seed) : m_x(seed | 1) { }
+   inline uint64_t next(void)
+   {
+      m_x ^= m_x << 13;
+      m_x ^= m_x >> 7;
+      m_x ^= m_x << 17;
+      return m_x;
+   }
+protected:
+   uint64_t m_x;
+};
+
+void run_sql(MYSQL &mysql, const char *sql)
+{
+   if (mysql_query(&mysql, sql))
+      throw std::runtime_error(std::string("Failed \"") + sql + "\": " + mysql_error(&mysql));
+}
+
+bool selected(const E2E_Settings &s, const char *workload)
+{
+   if (!s.workloads)
+      return true;
+
+   size_t len = strlen(workload);
+   for (const char *p = strstr(s.workloads, workload); p; p = strstr(p + 1, workload))
+      if ((p==s.workloads || p[-1]==',') && (p[len]=='\0' || p[len]==','))
+         return true;
+   return false;
+}
+
+/** Creates and fills the fixture table with Bulk_Inserter, timing each statement sent. */
+void load_fixture(MYSQL &mysql, const Fixture &fx, const E2E_Settings &s, Workload_Result &result)
+{
+   std::string drop = std::string("DROP TABLE IF EXISTS ") + fx.table;
+   run_sql(mysql, drop.c_str());
+   run_sql(mysql, fx.create);
+
+   Fixture_Random rnd(s.rows);
+   Bulk_Inserter  ins(mysql, fx.table, fx.columns);
+
+   const unsigned max_columns = 12;
+   char           text[max_columns][80];
+   MParam         row[max_columns];
+
+   Clock::time_point start = Clock::now();
+   for (uint64_t i=1; i<=s.rows; ++i)
+   {
+      int    id = static_cast<int>(i);
+      int    qty = static_cast<int>(rnd.next() % 100000);
+      double price = static_cast<double>(rnd.next() % 10000000) / 100.0;
+
+      row[0] = MParam(id);
+      row[1] = MParam(qty);
+      row[2] = MParam(price);
+      for (unsigned c=0; c<fx.text_columns; ++c)
+      {
+         // Lengths from 8 to 63 characters, so buffers see varied values:
+         unsigned len = 8 + rnd.next() % 56;
+         int      n = snprintf(text[c], sizeof(text[c]), "%s-%llu-", fx.table, static_cast<unsigned long long>(i));
+         for (unsigned k=static_cast<unsigned>(n); k<len; ++k)
+            text[c][k] = static_cast<char>('a' + (i + k) % 26);
+         text[c][len > static_cast<unsigned>(n) ? len : n] = '\0';
+         row[3 + c] = MParam(text[c]);
+      }
+
+      unsigned long statements = ins.statements();
+      Clock::time_point before = Clock::now();
+      ins.add(row);
+      if (ins.statements()!=statements)
+         result.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count());
+   }
+
+   Clock::time_point before = Clock::now();
+   ins.flush();
+   result.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count());
+   result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+   result.ops = ins.statements();
+   result.rows = ins.rows_written();
+}
+
+/** Reads single rows by primary key, through a Stmt_Cache. */
+void point_lookups(MYSQL &mysql, const Fixture &fx, const E2E_Settings &s, Workload_Result &result)
+{
+   std::string query = std::string("SELECT * FROM ") + fx.table + " WHERE id=?";
+   Stmt_Cache  cache(mysql);
+   Fixture_Random rnd(s.lookups);
+
+   auto f = [&result](PullPack &pp)
+   {
+      while (pp.puller(false))
+      {
+         ++result.rows;
+         for (const Bind_Data *bd = pp.binder.bind_data; valid(bd); ++bd)
+            result.bytes += is_null(bd) ? 0 : available_length(*bd);
+      }
+   };
+
+   Clock::time_point start = Clock::now();
+   for (uint64_t i=0; i<s.lookups; ++i)
+   {
+      int    id = static_cast<int>(1 + rnd.next() % (s.rows ? s.rows : 1));
+      MParam params[2] = { id };
+
+      Clock::time_point before = Clock::now();
+      execute_query_pull(cache, f, query.c_str(), params);
+      result.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count());
+   }
+   result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+   result.ops = s.lookups;
+}
+
+/** Reads runs of *range_rows* consecutive keys, through a Stmt_Cache. */
+void range_scans(MYSQL &mysql, const Fixture &fx, const E2E_Settings &s, Workload_Result &result)
+{
+   std::string query = std::string("SELECT * FROM ") + fx.table + " WHERE id BETWEEN ? AND ?";
+   Stmt_Cache  cache(mysql);
+   Fixture_Random rnd(s.ranges);
+
+   auto f = [&result](PullPack &pp)
+   {
+      while (pp.puller(false))
+      {
+         ++result.rows;
+         for (const Bind_Data *bd = pp.binder.bind_data; valid(bd); ++bd)
+            result.bytes += is_null(bd) ? 0 : available_length(*bd);
+      }
+   };
+
+   uint64_t span = s.rows > s.range_rows ? s.rows - s.range_rows : 0;
+
+   Clock::time_point start = Clock::now();
+   for (uint64_t i=0; i<s.ranges; ++i)
+   {
+      int    low = static_cast<int>(1 + rnd.next() % (span + 1));
+      int    high = low + static_cast<int>(s.range_rows) - 1;
+      MParam params[3] = { low, high };
+
+      Clock::time_point before = Clock::now();
+      execute_query_pull(cache, f, query.c_str(), params);
+      result.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count());
+   }
+   result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+   result.ops = s.ranges;
+}
+
+/**
+ * Reads the whole table with execute_query_pull() in the fetch mode of
+ * *options*, for comparing the rows/sec of the modes on the same table.
+ */
+void scan_in_mode(MYSQL &mysql, const Fixture &fx, const Pull_Options &options, Workload_Result &result)
+{
+   std::string query = std::string("SELECT * FROM ") + fx.table;
+
+   auto f = [&result](PullPack &pp)
+   {
+      while (pp.puller(false))
+      {
+         ++result.rows;
+         for (const Bind_Data *bd = pp.binder.bind_data; valid(bd); ++bd)
+            result.bytes += is_null(bd) ? 0 : available_length(*bd);
+      }
+   };
+
+   Clock::time_point start = Clock::now();
+   execute_query_pull(mysql, f, query.c_str(), options);
+   Clock::duration elapsed = Clock::now() - start;
+
+   result.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+   result.seconds = std::chrono::duration<double>(elapsed).count();
+   result.ops = 1;
+}
+
+void scan_stream(MYSQL &mysql, const Fixture &fx, const E2E_Settings &, Workload_Result &result)
+{
+   scan_in_mode(mysql, fx, default_pull_options, result);
+}
+
+void scan_buffered(MYSQL &mysql, const Fixture &fx, const E2E_Settings &, Workload_Result &result)
+{
+   scan_in_mode(mysql, fx, buffered_pull_options(), result);
+}
+
+void scan_cursor(MYSQL &mysql, const Fixture &fx, const E2E_Settings &s, Workload_Result &result)
+{
+   scan_in_mode(mysql, fx, cursor_pull_options(s.prefetch_rows), result);
+}
+
+/** A streambuf that only counts what is written to it. */
+class Counting_Buf : public std::streambuf
+{
+public:
+   Counting_Buf() : std::streambuf(), m_count(0) { }
+   inline uint64_t count(void) const { return m_count; }
+
+protected:
+   virtual int_type overflow(int_type ch)
+   {
+      if (ch!=traits_type::eof())
+         ++m_count;
+      return traits_type::not_eof(ch);
+   }
+   virtual std::streamsize xsputn(const char *, std::streamsize count)
+   {
+      m_count += count;
+      return count;
+   }
+
+   uint64_t m_count;
+};
+
+/** Writes the whole table as xmlify does, to a stream that discards it. */
+void export_table(MYSQL &mysql, const Fixture &fx, const E2E_Settings &s, Workload_Result &result)
+{
+   std::string  query = std::string("SELECT * FROM ") + fx.table;
+   Counting_Buf cbuf;
+   std::ostream os(&cbuf);
+
+   auto xmlify = [&os, &result](Binder &b)
+   {
+      os << "<row";
+      for (const Bind_Data *bd = b.bind_data; valid(bd); ++bd)
+         if (!is_null(bd))
+            os << " " << field_name(bd) << "=\"" << bd << "\"";
+      os << "/>\n";
+      ++result.rows;
+   };
+   Binder_User<decltype(xmlify)> bu(xmlify);
+
+   Clock::time_point start = Clock::now();
+   execute_query(mysql, bu, query.c_str());
+   Clock::duration elapsed = Clock::now() - start;
+
+   result.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+   result.seconds = std::chrono::duration<double>(elapsed).count();
+   result.ops = 1;
+   result.bytes = cbuf.count();
+}
+
+void print_result(const Workload_Result &r, bool first)
+{
+   double secs = r.seconds > 0 ? r.seconds : 1e-9;
+   printf("%s\n    {\"workload\": \"%s\", \"table\": \"%s\", \"ops\": %llu, \"rows\": %llu, \"bytes\": %llu,"
+          " \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"rows_per_sec\": %.1f, \"mb_per_sec\": %.3f,"
+          " \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f,"
+          " \"rss_kb\": %lu, \"peak_rss_kb\": %lu}",
+          first ? "" : ",",
+          r.workload,
+          r.table,
+          static_cast<unsigned long long>(r.ops),
+          static_cast<unsigned long long>(r.rows),
+          static_cast<unsigned long long>(r.bytes),
+          r.seconds,
+          r.ops / secs,
+          r.rows / secs,
+          r.bytes / secs / 1e6,
+          r.latency.value_at_percentile(50) / 1000.0,
+          r.latency.value_at_percentile(99) / 1000.0,
+          r.latency.max() / 1000.0,
+          read_status_kb("VmRSS"),
+          read_status_kb("VmHWM"));
+   fflush(stdout);
+}
+
+typedef void (*Workload_Function)(MYSQL &mysql, const Fixture &fx, const E2E_Settings &s, Workload_Result &result);
+
+struct Workload
+{
+   const char        *name;
+   Workload_Function run;
+};
+
+const Workload workloads[] = {
+   { "load",          load_fixture },
+   { "point",         point_lookups },
+   { "range",         range_scans },
+   { "export",        export_table },
+   { "scan_stream",   scan_stream },
+   { "scan_buffered", scan_buffered },
+   { "scan_cursor",   scan_cursor },
+   { nullptr,         nullptr }
+};
+
+void run_workloads(MYSQL &mysql, const char *dbase, const E2E_Settings &s)
+{
+   std::string create = std::string("CREATE DATABASE IF NOT EXISTS ") + dbase;
+   run_sql(mysql, create.c_str());
+   if (mysql_select_db(&mysql, dbase))
+      throw std::runtime_error(std::string("Failed to use database: ") + mysql_error(&mysql));
+
+   printf("{\n  \"server\": \"%s\",\n  \"client\": \"%s\",\n  \"rows\": %llu,\n  \"results\": [",
+          mysql_get_server_info(&mysql),
+          mysql_get_client_info(),
+          static_cast<unsigned long long>(s.rows));
+
+   bool first = true;
+   for (const Fixture *fx=fixtures; fx->table; ++fx)
+      for (const Workload *w=workloads; w->name; ++w)
+      {
+         // The other workloads need the table, so it is always loaded:
+         if (w->run!=load_fixture && !selected(s, w->name))
+            continue;
+
+         Workload_Result result(w->name, fx->table);
+         w->run(mysql, *fx, s, result);
+         if (selected(s, w->name))
+         {
+            print_result(result, first);
+            first = false;
+         }
+      }
+
+   printf("\n  ]\n}\n");
+}
+
+void show_usage(void)
+{
+   std::cout << "Usage instructions:\n\n"
+      "e2ebench [-S SOCKET] [-P PORT] [-C] [-N] [-h HOST] [-u USER] [-pPASSWORD] [-d DATABASE]\n"
+      "         [-r ROWS] [-n LOOKUPS] [-g RANGES] [-l RANGE_ROWS] [-f PREFETCH] [-w WORKLOADS]\n\n"
+      "Options:\n"
+      "-S socket\n"
+      "   Unix socket of the server, used when the host is localhost.\n"
+      "-P port\n"
+      "   TCP port of the server.\n"
+      "-C\n"
+      "   Compress the protocol.\n"
+      "-N\n"
+      "   Don't read [client] in ~/.my.cnf.\n"
+      "-h host, -u user, -p[password]\n"
+      "   As for xmlify.  Unspecified values are read from [client] in ~/.my.cnf.\n"
+      "-d database\n"
+      "   Database for the fixture tables, created if needed (default e2ebench).\n"
+      "-r rows\n"
+      "   Rows in each fixture table (default 100000).\n"
+      "-n lookups\n"
+      "   Point lookups per table (default 10000).\n"
+      "-g ranges\n"
+      "   Range scans per table (default 1000).\n"
+      "-l range_rows\n"
+      "   Rows in each range scan (default 100).\n"
+      "-f prefetch\n"
+      "   Rows per fetch of the scan_cursor workload (default 1000).\n"
+      "-w workloads\n"
+      "   Comma-separated list from load, point, range, export, scan_stream,\n"
+      "   scan_buffered and scan_cursor (default all).  The scan workloads read\n"
+      "   the whole table in each fetch mode, for comparing their rows/sec.\n"
+      "\n"
+      "The fixture tables e2e_narrow and e2e_wide are dropped and created again.\n";
+}
+
+int main(int argc, char **argv)
+{
+   E2E_Settings settings = { 100000, 10000, 1000, 100, 1000, nullptr };
+   const char   *host = "localhost";
+   const char   *user = nullptr;
+   const char   *password = nullptr;
+   Connection_Options options = default_connection_options;
+   const char   *dbase = "e2ebench";
+
+   for (int i=1; i<argc; ++i)
+   {
+      const char *arg = argv[i];
+      if (*arg!='-' || (!strchr("pCN", arg[1]) && i+1==argc))
+      {
+         show_usage();
+         return 1;
+      }
+
+      switch(arg[1])
+      {
+         case 'S': options.socket = argv[++i];                                break;
+         case 'P': options.port = strtoul(argv[++i], nullptr, 10);            break;
+         case 'C': options.compress = true;                                   break;
+         case 'N': options.skip_option_file = true;                           break;
+         case 'h': host = argv[++i];                                          break;
+         case 'u': user = argv[++i];                                          break;
+         case 'p': password = &arg[2];                                        break;
+         case 'd': dbase = argv[++i];                                         break;
+         case 'r': settings.rows = strtoull(argv[++i], nullptr, 10);          break;
+         case 'n': settings.lookups = strtoull(argv[++i], nullptr, 10);       break;
+         case 'g': settings.ranges = strtoull(argv[++i], nullptr, 10);        break;
+         case 'l': settings.range_rows = strtoul(argv[++i], nullptr, 10);     break;
+         case 'f': settings.prefetch_rows = strtoul(argv[++i], nullptr, 10);  break;
+         case 'w': settings.workloads = argv[++i];                            break;
+         default:
+            show_usage();
+            return 1;
+      }
+   }
+
+   try
+   {
+      auto f = [&dbase, &settings](MYSQL &mysql)
+      {
+         run_workloads(mysql, dbase, settings);
+      };
+      start_mysql(f, host, user, password, nullptr, &options);
+   }
+   catch(std::exception &e)
+   {
+      std::cerr << "Error " << e.what() << std::endl;
+      return 1;
+   }
+
+   return 0;
+}
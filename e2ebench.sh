@@ -0,0 +1,86 @@
+#!/bin/bash
+#
+# Runs e2ebench against a throwaway server: initializes a data directory
+# in a temporary directory, starts mysqld (or mariadbd) on a Unix socket
+# with networking disabled, runs the workloads, writes their JSON to
+# stdout, then stops the server and removes the directory.
+#
+# Options after the script name are passed to e2ebench, for example:
+#
+#    ./e2ebench.sh -r 1000000 -w load,export > results.json
+#
+# Set MYSQLD to choose the server binary.  The server's own output goes
+# to the error log, which is shown if it fails to start.
+
+set -e
+
+MYSQLD=${MYSQLD:-$(command -v mariadbd || command -v mysqld || true)}
+if [ -z "${MYSQLD}" ]; then
+   echo "No mysqld or mariadbd found; set MYSQLD." >&2
+   exit 1
+fi
+
+E2EBENCH=${E2EBENCH:-$(dirname "$0")/e2ebench}
+if [ ! -x "${E2EBENCH}" ]; then
+   echo "${E2EBENCH} not found; run make e2ebench." >&2
+   exit 1
+fi
+
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/mysqlcb-e2e.XXXXXX")
+socket=${tmp}/mysqld.sock
+pid=
+
+cleanup()
+{
+   if [ -n "${pid}" ]; then
+      kill "${pid}" 2>/dev/null || true
+      wait "${pid}" 2>/dev/null || true
+   fi
+   rm -rf "${tmp}"
+}
+trap cleanup EXIT
+
+# mysqld refuses to run as root without --user:
+user_opt=
+if [ "$(id -u)" = 0 ]; then
+   user_opt=--user=root
+fi
+
+if "${MYSQLD}" --version | grep -qi mariadb; then
+   install_db=$(command -v mariadb-install-db || command -v mysql_install_db)
+   "${install_db}" --no-defaults ${user_opt} --datadir="${tmp}/data" \
+      --auth-root-authentication-method=normal --skip-test-db > "${tmp}/install.log" 2>&1 \
+      || { cat "${tmp}/install.log" >&2; exit 1; }
+else
+   "${MYSQLD}" --no-defaults ${user_opt} --initialize-insecure --datadir="${tmp}/data" \
+      > "${tmp}/install.log" 2>&1 \
+      || { cat "${tmp}/install.log" >&2; exit 1; }
+fi
+
+"${MYSQLD}" --no-defaults ${user_opt} \
+   --datadir="${tmp}/data" \
+   --socket="${socket}" \
+   --pid-file="${tmp}/mysqld.pid" \
+   --log-error="${tmp}/error.log" \
+   --skip-networking \
+   --innodb-buffer-pool-size=256M \
+   --innodb-flush-log-at-trx-commit=2 \
+   --max-allowed-packet=64M &
+pid=$!
+
+for i in $(seq 1 300); do
+   [ -S "${socket}" ] && break
+   if ! kill -0 "${pid}" 2>/dev/null; then
+      break
+   fi
+   sleep 0.1
+done
+
+if [ ! -S "${socket}" ]; then
+   echo "The server did not start:" >&2
+   cat "${tmp}/error.log" >&2
+   exit 1
+fi
+
+# -N keeps ~/.my.cnf from changing the user, and -p alone is an empty password:
+"${E2EBENCH}" -S "${socket}" -N -h localhost -u root -p "$@"
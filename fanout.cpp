@@ -0,0 +1,119 @@
+#include <mysql.h>
+#include <stdint.h>  // for uint32_t
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+#include "mysqlcb_fanout.hpp"
+
+namespace mysqlcb {
+
+Fanout_Executor::Fanout_Executor(Connection_Pool &pool, uint32_t max_threads)
+   : m_pool(pool),
+     m_max_threads(max_threads ? max_threads : 1),
+     m_failures(0),
+     m_merge_mutex()
+{
+}
+
+/**
+ * Sends the queries to the worker threads.  Each thread registers itself
+ * with the client library, then claims the next unclaimed query until
+ * none are left.  The pool hands each thread its own connection, which
+ * is released between queries so threads can share a small pool.
+ */
+void Fanout_Executor::run(const Fanout_Query *queries, uint32_t count, const IFanout_Callback *merged)
+{
+   m_failures = 0;
+   if (count==0)
+      return;
+
+   uint32_t thread_count = count < m_max_threads ? count : m_max_threads;
+   if (thread_count > m_pool.settings().max_size)
+      thread_count = m_pool.settings().max_size;
+
+   std::atomic<uint32_t>      next(0);
+   std::atomic<unsigned long> failures(0);
+   std::exception_ptr         first_error = nullptr;
+   std::mutex                 error_mutex;
+
+   auto worker = [this, queries, count, merged, &next, &failures, &first_error, &error_mutex]()
+   {
+      mysql_thread_init();
+
+      uint32_t index;
+      while ((index = next++) < count)
+      {
+         const Fanout_Query &fq = queries[index];
+
+         auto fmerge = [this, merged, index](Binder &b)
+         {
+            std::lock_guard<std::mutex> lock(m_merge_mutex);
+            (*merged)(index, b);
+         };
+         Binder_User<decltype(fmerge)> bu_merge(fmerge);
+
+         IBinder_Callback *cb = merged ? &bu_merge : fq.cb;
+
+         auto fquery = [&fq, cb](MYSQL &mysql)
+         {
+            auto fnull = [](Binder &) { };
+            Binder_User<decltype(fnull)> bu_null(fnull);
+
+            execute_query(mysql,
+                          cb ? *cb : bu_null,
+                          fq.query,
+                          fq.params);
+         };
+
+         try
+         {
+            start_mysql(m_pool, fquery);
+         }
+         catch(...)
+         {
+            ++failures;
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!first_error)
+               first_error = std::current_exception();
+         }
+      }
+
+      mysql_thread_end();
+   };
+
+   std::vector<std::thread> threads;
+   try
+   {
+      threads.reserve(thread_count);
+      for (uint32_t i=0; i<thread_count; ++i)
+         threads.emplace_back(worker);
+   }
+   catch(...)
+   {
+      // Let the threads that did start finish the queries:
+      if (threads.empty())
+         throw;
+   }
+
+   for (auto &t : threads)
+      t.join();
+
+   m_failures = failures;
+   if (first_error)
+      std::rethrow_exception(first_error);
+}
+
+/** Runs the queries, sending the rows of each query to its own callback. */
+void Fanout_Executor::execute(const Fanout_Query *queries, uint32_t count)
+{
+   run(queries, count, nullptr);
+}
+
+/** Runs the queries, sending all rows to *merged*, one call at a time. */
+void Fanout_Executor::execute(const Fanout_Query *queries, uint32_t count, const IFanout_Callback &merged)
+{
+   run(queries, count, &merged);
+}
+
+}  // namespace
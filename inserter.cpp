@@ -0,0 +1,271 @@
+#include <mysql.h>
+#include <stdlib.h>  // for strtoull()
+#include <string.h>  // for strlen()
+#include <stdint.h>  // for uint32_t
+#include <cmath>     // for std::isfinite()
+#include <stdexcept>
+#include "mysqlcb_inserter.hpp"
+
+namespace mysqlcb {
+
+using Clock = std::chrono::steady_clock;
+
+/** Counts the columns of a column list by its commas, ignoring those in backquotes. */
+uint32_t count_columns(const char *columns)
+{
+   uint32_t count = 1;
+   bool     quoted = false;
+   for (const char *ptr = columns; *ptr; ++ptr)
+   {
+      if (*ptr=='`')
+         quoted = !quoted;
+      else if (*ptr==',' && !quoted)
+         ++count;
+   }
+   return count;
+}
+
+/** Returns the server's max_allowed_packet, or 0 if it can't be read. */
+size_t get_max_allowed_packet(MYSQL &mysql)
+{
+   const char *query = "SELECT @@max_allowed_packet";
+   size_t     result = 0;
+
+   if (0==mysql_real_query(&mysql, query, strlen(query)))
+   {
+      MYSQL_RES *res = mysql_use_result(&mysql);
+      if (res)
+      {
+         MYSQL_ROW row;
+         while ((row = mysql_fetch_row(res)))
+            if (row[0])
+               result = strtoull(row[0], nullptr, 10);
+         mysql_free_result(res);
+      }
+   }
+
+   return result;
+}
+
+inline bool is_text_type(enum_field_types type)
+{
+   switch(type)
+   {
+      case MYSQL_TYPE_VAR_STRING:
+      case MYSQL_TYPE_STRING:
+      case MYSQL_TYPE_VARCHAR:
+      case MYSQL_TYPE_BLOB:
+      case MYSQL_TYPE_ENUM:
+      case MYSQL_TYPE_SET:
+         return true;
+      default:
+         return false;
+   }
+}
+
+Bulk_Inserter::Bulk_Inserter(MYSQL &mysql,
+                             const char *table,
+                             const char *columns,
+                             const char *on_duplicate,
+                             const Inserter_Settings &settings)
+   : m_mysql(mysql),
+     m_settings(settings),
+     m_column_count(count_columns(columns)),
+     m_limit(settings.max_bytes),
+     m_prefix(), m_suffix(), m_sql(), m_row(),
+     m_pending_rows(0),
+     m_first_pending(),
+     m_rows_written(0), m_statements(0), m_affected_rows(0),
+     m_last_flush_us(0), m_max_flush_us(0), m_total_flush_us(0)
+{
+   m_prefix = "INSERT INTO ";
+   m_prefix += table;
+   m_prefix += " (";
+   m_prefix += columns;
+   m_prefix += ") VALUES ";
+
+   if (on_duplicate)
+   {
+      m_suffix = " ON DUPLICATE KEY UPDATE ";
+      m_suffix += on_duplicate;
+   }
+
+   // Leave room in the packet for the protocol header:
+   size_t packet = get_max_allowed_packet(mysql);
+   if (packet > 1024 && (m_limit==0 || packet - 1024 < m_limit))
+      m_limit = packet - 1024;
+
+   m_sql.reserve(m_limit ? m_limit : 65536);
+}
+
+Bulk_Inserter::~Bulk_Inserter()
+{
+   try
+   {
+      flush();
+   }
+   catch(...)
+   {
+   }
+}
+
+/**
+ * Appends a value to the row being built.  Strings are escaped and
+ * quoted; other types use the BDType text, with dates and times quoted
+ * and written with microseconds if they have a fraction of a second.
+ * SQL has no literal for NaN or infinity, so those throw.
+ */
+void Bulk_Inserter::append_value(const MParam &value)
+{
+   if (value.is_null())
+   {
+      m_row += "NULL";
+      return;
+   }
+
+   enum_field_types type = value.field_type();
+   if (is_text_type(type))
+   {
+      size_t start = m_row.size();
+      m_row.resize(start + value.size() * 2 + 3);
+
+      char *ptr = &m_row[start];
+      *ptr++ = '\'';
+      ptr += mysql_real_escape_string(&m_mysql,
+                                      ptr,
+                                      static_cast<const char*>(value.data()),
+                                      value.size());
+      *ptr++ = '\'';
+      m_row.resize(ptr - m_row.data());
+   }
+   else
+   {
+      if (type==MYSQL_TYPE_DOUBLE && !std::isfinite(*static_cast<const double*>(value.data())))
+         throw std::runtime_error("Bulk insert value is not a finite number.");
+
+      bool is_time = type==MYSQL_TYPE_DATE || type==MYSQL_TYPE_TIME
+         || type==MYSQL_TYPE_DATETIME || type==MYSQL_TYPE_TIMESTAMP;
+
+      // The BDType takes the fraction digits of a time from its field:
+      MYSQL_FIELD field;
+      memset(&field, 0, sizeof(MYSQL_FIELD));
+      field.type = type;
+      if (is_time && static_cast<const MYSQL_TIME*>(value.data())->second_part)
+         field.decimals = 6;
+
+      Bind_Data bd;
+      memset(&bd, 0, sizeof(Bind_Data));
+      bd.len_data = value.size();
+      bd.data = const_cast<void*>(value.data());
+      bd.bdtype = value.type();
+      bd.field = &field;
+
+      bool   quote = !is_fixed_length(type) || is_time;
+      size_t len = get_string_length(bd);
+      size_t start = m_row.size();
+
+      m_row.resize(start + len + 3);
+      char *ptr = &m_row[start];
+      if (quote)
+         *ptr++ = '\'';
+      get_string_value(bd, ptr, len + 1);
+      ptr += len;
+      if (quote)
+         *ptr++ = '\'';
+      m_row.resize(ptr - m_row.data());
+   }
+}
+
+bool Bulk_Inserter::is_due(Clock::time_point now) const
+{
+   if (m_pending_rows==0)
+      return false;
+   else if (m_settings.max_rows && m_pending_rows >= m_settings.max_rows)
+      return true;
+   else
+      return m_settings.max_delay_ms
+         && now - m_first_pending >= std::chrono::milliseconds(m_settings.max_delay_ms);
+}
+
+/**
+ * Adds a row, first sending the pending rows if this row would push the
+ * statement past the byte limit.  A row too large for the limit on its
+ * own is sent by itself.
+ */
+void Bulk_Inserter::add(const MParam *row)
+{
+   m_row = "(";
+   for (uint32_t i=0; i<m_column_count; ++i)
+   {
+      if (i)
+         m_row += ',';
+      append_value(row[i]);
+   }
+   m_row += ')';
+
+   if (m_pending_rows && m_limit
+       && m_sql.size() + 1 + m_row.size() + m_suffix.size() > m_limit)
+      flush();
+
+   if (m_pending_rows==0)
+   {
+      m_sql = m_prefix;
+      m_first_pending = Clock::now();
+   }
+   else
+      m_sql += ',';
+
+   m_sql += m_row;
+   ++m_pending_rows;
+
+   if (is_due(Clock::now()))
+      flush();
+}
+
+bool Bulk_Inserter::flush_if_due(void)
+{
+   if (is_due(Clock::now()))
+   {
+      flush();
+      return true;
+   }
+   else
+      return false;
+}
+
+/**
+ * Sends the pending rows.  The rows are dropped even if the statement
+ * fails, so a bad row can't block the rows that follow it.
+ */
+void Bulk_Inserter::flush(void)
+{
+   if (m_pending_rows==0)
+      return;
+
+   m_sql += m_suffix;
+   uint32_t rows = m_pending_rows;
+   m_pending_rows = 0;
+
+   Clock::time_point start = Clock::now();
+   int result = mysql_real_query(&m_mysql, m_sql.data(), m_sql.size());
+   uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+
+   m_last_flush_us = elapsed;
+   m_total_flush_us += elapsed;
+   if (elapsed > m_max_flush_us)
+      m_max_flush_us = elapsed;
+
+   if (result)
+   {
+      std::string msg("Bulk insert failed: \"");
+      msg += mysql_error(&m_mysql);
+      msg += "\"";
+      throw std::runtime_error(msg);
+   }
+
+   ++m_statements;
+   m_rows_written += rows;
+   m_affected_rows += mysql_affected_rows(&m_mysql);
+}
+
+}  // namespace
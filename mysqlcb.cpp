@@ -4,7 +4,11 @@
 #include <string.h>  // For strlen()
 #include <stdint.h>  // for uint32_t
 #include <alloca.h>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include "mysqlcb_binder.hpp"
+#include "mysqlcb_arena.hpp"
 #include "mysqlcb.hpp"
 
 namespace mysqlcb {
@@ -28,7 +32,8 @@ void get_stack_string_args(IString_Callback &cb, va_list args)
    }
    va_end(counter);
 
-   char *buffer = static_cast<char*>(alloca(buff_len));
+   Scratch scratch;
+   char *buffer = static_cast<char*>(SCRATCH_ALLOC(scratch, buff_len));
    char *ptr = buffer;
    size_t substr_len;
    while (1)
@@ -74,57 +79,338 @@ void throw_error(const char *err)
    throw std::runtime_error(err);
 }
 
+void throw_stmt_error(const char *msg, MYSQL_STMT *stmt)
+{
+   get_stack_string(throw_error, msg, " \"", mysql_stmt_error(stmt), "\"\n", nullstr);
+}
+
+std::atomic<const IQuery_Observer*> query_observer(nullptr);
+
 /**
- * Executes the query, then calls the callback function with each result row.
- *
- * @param mysql Handle to an open MySQL connection
- * @param cb    Callback function of type `void funcname(Binder &binder)`
- * @param query Text of the query
+ * Installs *observer* to receive the Query_Stats of every query that
+ * starts after this call, or removes the observer if it is nullptr.
+ * Queries already running report to the observer they started with, so
+ * don't destroy a removed observer until those queries have finished.
+ */
+void set_query_observer(const IQuery_Observer *observer)
+{
+   query_observer.store(observer, std::memory_order_release);
+}
+
+const IQuery_Observer *get_query_observer(void)
+{
+   return query_observer.load(std::memory_order_acquire);
+}
+
+inline uint64_t monotonic_ns(void)
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Query_Probe::Query_Probe(const char *query)
+   : m_observer(get_query_observer()),
+     m_stats(),
+     m_mark(0)
+{
+   if (m_observer)
+   {
+      m_stats.query = query;
+      m_mark = monotonic_ns();
+   }
+}
+
+/** A query that ends without done() or fail() was ended by a non-standard exception. */
+Query_Probe::~Query_Probe()
+{
+   if (m_observer)
+   {
+      try
+      {
+         report("Unknown exception");
+      }
+      catch(...)
+      {
+      }
+   }
+}
+
+void Query_Probe::done(void)
+{
+   if (m_observer)
+      report(nullptr);
+}
+
+void Query_Probe::fail(const char *error)
+{
+   if (m_observer)
+      report(error);
+}
+
+void Query_Probe::record_lap(Query_Phase phase)
+{
+   uint64_t now = monotonic_ns();
+   m_stats.phase_ns[phase] += now - m_mark;
+   m_mark = now;
+}
+
+void Query_Probe::record_row(const Binder &binder)
+{
+   ++m_stats.rows;
+
+   const Bind_Data *bd = binder.bind_data;
+   const Bind_Data *end = bd + binder.field_count;
+   for (; bd<end; ++bd)
+   {
+      if (!bd->is_null)
+         m_stats.bytes += bd->len_data;
+      if (bd->is_truncated)
+         ++m_stats.truncations;
+   }
+}
+
+/** Sends the stats to the observer once, then goes quiet. */
+void Query_Probe::report(const char *error)
+{
+   const IQuery_Observer *observer = m_observer;
+   m_observer = nullptr;
+
+   m_stats.error = error;
+   (*observer)(m_stats);
+}
+
+/**
+ * Prepares *query* in a statement handle, throwing on failure.
+ */
+void prepare_statement(MYSQL_STMT *stmt, const char *query)
+{
+   if (mysql_stmt_prepare(stmt, query, strlen(query)))
+      throw_stmt_error("Failed to prepare statement", stmt);
+}
+
+/**
+ * Sets the cursor attributes of a prepared statement for the fetch mode.
+ * The attributes must be set before the statement is executed.
+ */
+void set_fetch_mode(MYSQL_STMT *stmt, const Pull_Options &options)
+{
+   unsigned long cursor_type = CURSOR_TYPE_NO_CURSOR;
+   unsigned long prefetch_rows = options.prefetch_rows ? options.prefetch_rows : 1;
+
+   if (options.mode==FETCH_CURSOR)
+      cursor_type = CURSOR_TYPE_READ_ONLY;
+
+   if (mysql_stmt_attr_set(stmt, STMT_ATTR_CURSOR_TYPE, &cursor_type))
+      throw_stmt_error("Failed to set cursor type", stmt);
+
+   if (options.mode==FETCH_CURSOR
+       && mysql_stmt_attr_set(stmt, STMT_ATTR_PREFETCH_ROWS, &prefetch_rows))
+      throw_stmt_error("Failed to set prefetch rows", stmt);
+
+   // Have mysql_stmt_store_result() record the longest value of each column:
+   my_bool update_max_length = options.mode==FETCH_BUFFERED && options.sizing.use_max_length;
+   if (mysql_stmt_attr_set(stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_length))
+      throw_stmt_error("Failed to set max length update", stmt);
+}
+
+/**
+ * Binds the (optional) parameters, sets the (optional) fetch mode,
+ * and executes a prepared statement, throwing on failure.
+ */
+void execute_statement(MYSQL_STMT *stmt, const Binder *params, const Pull_Options *options)
+{
+   if (params && mysql_stmt_bind_param(stmt, params->binds))
+      throw_stmt_error("Failed to bind parameters", stmt);
+
+   if (options)
+      set_fetch_mode(stmt, *options);
+
+   if (mysql_stmt_execute(stmt))
+      throw_stmt_error("Failed to execute statement", stmt);
+
+   if (options && options->mode==FETCH_BUFFERED && mysql_stmt_store_result(stmt))
+      throw_stmt_error("Failed to store result", stmt);
+}
+
+/**
+ * Row loop of push_rows() and push_rows_until().  Fetches each row of an
+ * executed statement whose results are already bound to *binder*, and
+ * passes it to *deliver* until *deliver* returns something other than
+ * ROW_CONTINUE.  Returns what *deliver* last returned.
  *
- * @return void
+ * Rows with truncated values are passed on with the truncated Bind_Data
+ * flagged, so the callback can use stream_column() to read the values.
  */
-void execute_query(MYSQL &mysql, IBinder_Callback &cb, const char *query)
+template <typename Func>
+Row_Control fetch_rows(MYSQL_STMT *stmt,
+                       Binder &binder,
+                       Query_Probe *probe,
+                       const Func &deliver)
 {
-   MYSQL_STMT *stmt = mysql_stmt_init(&mysql);
-   if (stmt)
+   int result;
+   while ((result=mysql_stmt_fetch(stmt))!=MYSQL_NO_DATA)
    {
-      int result = mysql_stmt_prepare(stmt, query, strlen(query));
-      if (result==0)
+      if (result==0 || result==MYSQL_DATA_TRUNCATED)
       {
-         result = mysql_stmt_execute(stmt);
-         if (result==0)
+         mark_truncations(binder, result);
+         if (probe)
          {
-            auto f = [&mysql, &cb, &stmt](Binder &b)
-            {
-               mysql_stmt_bind_result(stmt, b.binds);
-
-               int result;
-               while ((result=mysql_stmt_fetch(stmt))!=MYSQL_NO_DATA)
-               {
-                  if (result==0)
-                     cb(b);
-                  else if (result==MYSQL_DATA_TRUNCATED)
-                     std::cerr << "Got a truncated result...deal with it now." << std::endl;
-               }
-            };
-            Binder_User<decltype(f)> bu(f);
-            
-            get_result_binds(mysql, bu, stmt);
+            probe->count_row(binder);
+            probe->lap(PHASE_FETCH);
          }
-         else
-            get_stack_string(throw_error,
-                             "Failed to execute statement \"",
-                             mysql_stmt_error(stmt),
-                             "\"\n",
-                             nullstr);
+
+         Row_Control control = deliver(binder);
+
+         if (probe)
+            probe->lap(PHASE_CALLBACK);
+
+         if (control!=ROW_CONTINUE)
+            return control;
       }
       else
+         throw_stmt_error("Failed to fetch row", stmt);
+   }
+
+   if (probe)
+      probe->lap(PHASE_FETCH);
+
+   return ROW_CONTINUE;
+}
+
+/**
+ * Fetches each row of an executed statement whose results are already
+ * bound to *binder*, calling *cb* with each row.
+ */
+void push_rows(MYSQL_STMT *stmt,
+               Binder &binder,
+               IBinder_Callback &cb,
+               Query_Probe *probe)
+{
+   auto deliver = [&cb](Binder &b) -> Row_Control
+   {
+      cb(b);
+      return ROW_CONTINUE;
+   };
+   fetch_rows(stmt, binder, probe, deliver);
+}
+
+/**
+ * Like push_rows(), but ends the result early as the callback asks.
+ * ROW_SKIP_REST discards the remaining rows with mysql_stmt_free_result(),
+ * and ROW_STOP calls the *canceller*, if any, before discarding them
+ * with mysql_stmt_reset(), which also closes a server-side cursor.
+ */
+void push_rows_until(MYSQL &mysql,
+                     MYSQL_STMT *stmt,
+                     Binder &binder,
+                     IRow_Control_Callback &cb,
+                     const IQuery_Canceller *canceller,
+                     Query_Probe *probe)
+{
+   auto deliver = [&cb](Binder &b) -> Row_Control { return cb(b); };
+
+   Row_Control control = fetch_rows(stmt, binder, probe, deliver);
+   if (control==ROW_SKIP_REST)
+   {
+      if (mysql_stmt_free_result(stmt))
+         throw_stmt_error("Failed to discard result", stmt);
+   }
+   else if (control==ROW_STOP)
+   {
+      if (canceller)
+         (*canceller)(mysql_thread_id(&mysql));
+      if (mysql_stmt_reset(stmt))
+         throw_stmt_error("Failed to reset statement", stmt);
+   }
+
+   if (control!=ROW_CONTINUE && probe)
+      probe->lap(PHASE_FETCH);
+}
+
+/**
+ * Packages an executed statement whose results are already bound to
+ * *binder* into a PullPack for the callback.  For a FETCH_BUFFERED
+ * result, the PullPack includes the row count and a seeker.
+ */
+void pull_rows(MYSQL &mysql,
+               MYSQL_STMT *stmt,
+               Binder &binder,
+               IPullPack_Callback &cb,
+               const Pull_Options *options,
+               Query_Probe *probe)
+{
+   int persist = 1;
+
+   auto puller = [&stmt, &binder, &persist, probe](int go_on) -> int
+   {
+      if (probe)
+         probe->lap(PHASE_CALLBACK);
+
+      int result;
+      do
       {
-         get_stack_string(throw_error,
-                          "Failed to prepare statement \"",
-                          mysql_stmt_error(stmt),
-                          "\"\n",
-                          nullstr);
+         result = mysql_stmt_fetch(stmt);
+         persist = result==0 || result==MYSQL_DATA_TRUNCATED;
+         if (persist && !go_on)
+            mark_truncations(binder, result);
+         if (persist && probe)
+            probe->count_row(binder);
+      }
+      while(go_on && persist);
+
+      if (probe)
+         probe->lap(PHASE_FETCH);
+
+      return persist;
+   };
+   Puller_User<decltype(puller)> pu(puller);
+
+   if (options && options->mode==FETCH_BUFFERED)
+   {
+      uint64_t row_count = mysql_stmt_num_rows(stmt);
+
+      auto seeker = [&stmt, &persist, &row_count](uint64_t row) -> int
+      {
+         if (row >= row_count)
+            return 0;
+
+         mysql_stmt_data_seek(stmt, row);
+         persist = 1;
+         return 1;
+      };
+      Seeker_User<decltype(seeker)> su(seeker);
+
+      PullPack pp = {mysql, binder, pu, row_count, &su};
+      cb(pp);
+   }
+   else
+   {
+      PullPack pp = {mysql, binder, pu, 0, nullptr};
+      cb(pp);
+   }
+
+   if (probe)
+      probe->lap(PHASE_CALLBACK);
+}
+
+/**
+ * Prepares and executes a query, calls the callback with the executed
+ * statement handle, then closes the statement.
+ */
+void t_prepare_statement(MYSQL &mysql, IStmt_Callback &cb, const char *query)
+{
+   MYSQL_STMT *stmt = mysql_stmt_init(&mysql);
+   if (stmt)
+   {
+      try
+      {
+         prepare_statement(stmt, query);
+         cb(*stmt);
+      }
+      catch(...)
+      {
+         mysql_stmt_close(stmt);
+         throw;
       }
 
       mysql_stmt_close(stmt);
@@ -132,11 +418,181 @@ void execute_query(MYSQL &mysql, IBinder_Callback &cb, const char *query)
    else
       get_stack_string(throw_error,
                        "Failed to initialize statement \"",
-                       mysql_stmt_error(stmt),
+                       mysql_error(&mysql),
                        "\"\n",
                        nullstr);
 }
 
+void t_execute_statement(MYSQL &mysql,
+                         IStmt_Callback &cb,
+                         const char *query,
+                         const Binder *params,
+                         const Pull_Options *options)
+{
+   auto f = [&cb, params, options](MYSQL_STMT &stmt)
+   {
+      execute_statement(&stmt, params, options);
+      cb(stmt);
+   };
+   Stmt_User<decltype(f)> su(f);
+
+   t_prepare_statement(mysql, su, query);
+}
+
+/**
+ * Executes the query, then calls the callback function with each result row.
+ *
+ * Having no parameters, the query is sent by the text protocol, which
+ * saves the prepare round trip.  Use execute_prepared_query() to force
+ * a prepared statement.
+ *
+ * @param mysql Handle to an open MySQL connection
+ * @param cb    Callback function of type `void funcname(Binder &binder)`
+ * @param query Text of the query
+ *
+ * @return void
+ */
+void execute_query(MYSQL &mysql, IBinder_Callback &cb, const char *query)
+{
+   execute_text_query(mysql, cb, query);
+}
+
+/**
+ * Like execute_query(), but runs the query as a prepared statement,
+ * with the parameters in *params*, if any.
+ */
+void execute_prepared_query(MYSQL &mysql,
+                            IBinder_Callback &cb,
+                            const char *query,
+                            const Binder *params)
+{
+   Query_Probe probe(query);
+
+   auto fstmt = [&mysql, &cb, params, &probe](MYSQL_STMT &stmt)
+   {
+      probe.lap(PHASE_PREPARE);
+      execute_statement(&stmt, params);
+      probe.lap(PHASE_EXECUTE);
+
+      auto f = [&stmt, &cb, &probe](Binder &b)
+      {
+         mysql_stmt_bind_result(&stmt, b.binds);
+         probe.lap(PHASE_METADATA);
+         push_rows(&stmt, b, cb, &probe);
+      };
+      Binder_User<decltype(f)> bu(f);
+
+      get_result_binds(mysql, bu, &stmt);
+   };
+   Stmt_User<decltype(fstmt)> su(fstmt);
+
+   try
+   {
+      t_prepare_statement(mysql, su, query);
+   }
+   catch(const std::exception &e)
+   {
+      probe.fail(e.what());
+      throw;
+   }
+   probe.done();
+}
+
+/**
+ * Like execute_prepared_query(), but the callback can end the result
+ * early, as for push_rows_until().
+ */
+void execute_prepared_query_until(MYSQL &mysql,
+                                  IRow_Control_Callback &cb,
+                                  const char *query,
+                                  const Binder *params,
+                                  const IQuery_Canceller *canceller)
+{
+   Query_Probe probe(query);
+
+   auto fstmt = [&mysql, &cb, params, canceller, &probe](MYSQL_STMT &stmt)
+   {
+      probe.lap(PHASE_PREPARE);
+      execute_statement(&stmt, params);
+      probe.lap(PHASE_EXECUTE);
+
+      auto f = [&mysql, &stmt, &cb, canceller, &probe](Binder &b)
+      {
+         mysql_stmt_bind_result(&stmt, b.binds);
+         probe.lap(PHASE_METADATA);
+         push_rows_until(mysql, &stmt, b, cb, canceller, &probe);
+      };
+      Binder_User<decltype(f)> bu(f);
+
+      get_result_binds(mysql, bu, &stmt);
+   };
+   Stmt_User<decltype(fstmt)> su(fstmt);
+
+   try
+   {
+      t_prepare_statement(mysql, su, query);
+   }
+   catch(const std::exception &e)
+   {
+      probe.fail(e.what());
+      throw;
+   }
+   probe.done();
+}
+
+/**
+ * Executes a query with a list of parameter values, as for summon_binder(),
+ * calling the callback with each result row.  Without parameters, the
+ * query is sent by the text protocol.
+ */
+void execute_query(MYSQL &mysql, IBinder_Callback &cb, const char *query, const MParam *params)
+{
+   if (!params)
+   {
+      execute_text_query(mysql, cb, query);
+      return;
+   }
+
+   auto f = [&mysql, &cb, query](Binder &b)
+   {
+      execute_prepared_query(mysql, cb, query, &b);
+   };
+   Binder_User<decltype(f)> bu(f);
+
+   summon_binder(bu, params);
+}
+
+/**
+ * Executes a query like execute_query(), calling the callback with each
+ * row until it returns ROW_SKIP_REST or ROW_STOP.
+ *
+ * @param mysql     Handle to an open MySQL connection
+ * @param cb        Callback function of type `Row_Control funcname(Binder &binder)`
+ * @param query     Text of the query
+ * @param params    Parameter values, or nullptr to use the text protocol
+ * @param canceller Stops the server's side of a ROW_STOP query, or nullptr
+ */
+void execute_query_until(MYSQL &mysql,
+                         IRow_Control_Callback &cb,
+                         const char *query,
+                         const MParam *params,
+                         const IQuery_Canceller *canceller)
+{
+   if (!params)
+   {
+      execute_text_query_until(mysql, cb, query, canceller);
+      return;
+   }
+
+   auto f = [&mysql, &cb, query, canceller](Binder &b)
+   {
+      execute_prepared_query_until(mysql, cb, query, &b, canceller);
+   };
+   Binder_User<decltype(f)> bu(f);
+
+   summon_binder(bu, params);
+}
+
 /**
  * Executes the query, then hands back a PullPack structure that includes a callback function
  * that gets a result row.  The function that receives the PullPack should call the included
@@ -145,123 +601,108 @@ void execute_query(MYSQL &mysql, IBinder_Callback &cb, const char *query)
  * @param mysql Handle to an open MySQL connection
  * @param cb    Callback function of type `void funcname(PullPack &pp)
  * @param query Text of the query
+ * @param binder Parameters for the query, or nullptr
+ * @param options Fetch mode for the query, or nullptr for default_pull_options
+ *
+ * A FETCH_STREAM query without parameters is sent by the text protocol.
+ * Other modes use a prepared statement, for its cursor or for the
+ * Buffer_Sizing of its stored result.
  *
  * @return void
  */
-   void int_execute_query_pull(MYSQL &mysql,
-                               IPullPack_Callback &cb,
-                               const char *query,
-                               const Binder *binder)
+void int_execute_query_pull(MYSQL &mysql,
+                            IPullPack_Callback &cb,
+                            const char *query,
+                            const Binder *binder,
+                            const Pull_Options *options)
 {
-   MYSQL_STMT *stmt = mysql_stmt_init(&mysql);
-   if (stmt)
+   if (!binder && (!options || options->mode==FETCH_STREAM))
    {
-      int result = mysql_stmt_prepare(stmt, query, strlen(query));
+      execute_text_query_pull(mysql, cb, query, options);
+      return;
+   }
 
-      if (result==0)
-      {
-         if (binder)
-            result = mysql_stmt_bind_param(stmt, binder->binds);
+   Query_Probe probe(query);
 
-         if (result)
-         {
-            get_stack_string(throw_error,
-                             "Failed to bind parameters \"",
-                             mysql_stmt_error(stmt),
-                             "\"\n",
-                             nullstr);
-         }
-         else
-         {
-            result = mysql_stmt_execute(stmt);
-            if (result==0)
-            {
-               auto f = [&mysql, &cb, &stmt](Binder &binder)
-                  {
-                     mysql_stmt_bind_result(stmt, binder.binds);
-
-                     int persist = 1;
-
-                     auto puller = [&stmt, &binder, &persist](int go_on) -> int
-                     {
-                        int result;
-                        do
-                        {
-                           result = mysql_stmt_fetch(stmt);
-                           binder.bind_data->is_truncated = result==MYSQL_DATA_TRUNCATED;
-                           persist = result!=MYSQL_NO_DATA;
-                        }
-                        while(go_on && persist);
-
-                        return persist;
-                     };
-                     Puller_User<decltype(puller)> pu(puller);
-                     PullPack pp = {mysql, binder, pu};
-
-                     cb(pp);
-                  };
-               Binder_User<decltype(f)> bu(f);
-            
-               get_result_binds(mysql, bu, stmt);
-            }
-            else
-               get_stack_string(throw_error,
-                                "Failed to execute statement \"",
-                                mysql_stmt_error(stmt),
-                                "\"\n",
-                                nullstr);
-         }
+   auto fstmt = [&mysql, &cb, binder, &options, &probe](MYSQL_STMT &stmt)
+   {
+      probe.lap(PHASE_PREPARE);
+      execute_statement(&stmt, binder, options);
+      probe.lap(PHASE_EXECUTE);
 
-      }
-      else
+      auto f = [&mysql, &stmt, &cb, &options, &probe](Binder &b)
       {
-         get_stack_string(throw_error,
-                          "Failed to prepare statement \"",
-                          mysql_stmt_error(stmt),
-                          "\"\n",
-                          nullstr);
-      }
+         mysql_stmt_bind_result(&stmt, b.binds);
+         probe.lap(PHASE_METADATA);
+         pull_rows(mysql, &stmt, b, cb, options, &probe);
+      };
+      Binder_User<decltype(f)> bu(f);
 
-      mysql_stmt_close(stmt);
+      get_result_binds(mysql, bu, &stmt, options ? &options->sizing : nullptr);
+   };
+   Stmt_User<decltype(fstmt)> su(fstmt);
+
+   try
+   {
+      t_prepare_statement(mysql, su, query);
    }
-   else
-      get_stack_string(throw_error,
-                       "Failed to initialize statement \"",
-                       mysql_stmt_error(stmt),
-                       "\"\n",
-                       nullstr);
+   catch(const std::exception &e)
+   {
+      probe.fail(e.what());
+      throw;
+   }
+   probe.done();
 }
 
-void t_start_mysql(IMySQL_Callback &cb,
+/**
+ * Initializes and connects a MYSQL handle, throwing on failure.
+ *
+ * Unspecified connection values are read from the [client] group of ~/.my.cnf,
+ * unless *options* says to skip it.  On success, the caller must eventually
+ * call mysql_close().
+ */
+void connect_mysql(MYSQL &mysql,
                    const char *host,
                    const char *user,
                    const char *pass,
-                   const char *dbase)
+                   const char *dbase,
+                   const Connection_Options *options)
 {
-   MYSQL mysql;
+   const Connection_Options &co = options ? *options : default_connection_options;
 
-   // remainder of mysql_real_connect arguments:
-   int           port = 0;
-   const char    *socket = nullptr;
    unsigned long client_flag = 0;
+   if (co.multi_statements)
+      client_flag |= CLIENT_MULTI_STATEMENTS;
 
    if (mysql_init(&mysql))
    {
-      mysql_options(&mysql,MYSQL_READ_DEFAULT_FILE,"~/.my.cnf");
-      mysql_options(&mysql,MYSQL_READ_DEFAULT_GROUP,"client");
+      if (!co.skip_option_file)
+      {
+         mysql_options(&mysql,MYSQL_READ_DEFAULT_FILE,"~/.my.cnf");
+         mysql_options(&mysql,MYSQL_READ_DEFAULT_GROUP,"client");
+      }
+      if (co.compress)
+         mysql_options(&mysql,MYSQL_OPT_COMPRESS,nullptr);
+      if (co.read_timeout)
+         mysql_options(&mysql,MYSQL_OPT_READ_TIMEOUT,&co.read_timeout);
+      if (co.write_timeout)
+         mysql_options(&mysql,MYSQL_OPT_WRITE_TIMEOUT,&co.write_timeout);
 
       MYSQL *handle = mysql_real_connect(&mysql,
                                          host, user, pass, dbase,
-                                         port, socket, client_flag);
+                                         co.port, co.socket, client_flag);
 
-      if (handle)
-      {
-         cb(mysql);
-         mysql_close(&mysql);
-      }
-      else
+      if (!handle)
       {
-         get_stack_string(throw_error,
+         // Copy the message to the stack before mysql_close() frees it:
+         auto f = [&mysql](const char *msg)
+         {
+            mysql_close(&mysql);
+            throw_error(msg);
+         };
+         String_User<decltype(f)> su(f);
+
+         get_stack_string(su,
                           "MySQL connection failed \"",
                           mysql_error(&mysql),
                           "\"\n",
@@ -274,6 +715,30 @@ void t_start_mysql(IMySQL_Callback &cb,
                        nullstr);
 }
 
+void t_start_mysql(IMySQL_Callback &cb,
+                   const char *host,
+                   const char *user,
+                   const char *pass,
+                   const char *dbase,
+                   const Connection_Options *options)
+{
+   MYSQL mysql;
+
+   connect_mysql(mysql, host, user, pass, dbase, options);
+
+   try
+   {
+      cb(mysql);
+   }
+   catch(...)
+   {
+      mysql_close(&mysql);
+      throw;
+   }
+
+   mysql_close(&mysql);
+}
+
 void run_querier_pack(IQuerier_Callback &cb, MYSQL &mysql)
 {
    bool  in_query = false;
@@ -315,7 +780,8 @@ void run_querier_pack(IQuerier_Callback &cb, MYSQL &mysql)
 }
 
 void t_get_querier_pack(IQuerier_Callback &cb,
-                        const char *host, const char *user, const char *pass, const char *dbase)
+                        const char *host, const char *user, const char *pass, const char *dbase,
+                        const Connection_Options *options)
 {
    auto f = [&cb](MYSQL &mysql)
    {
@@ -323,7 +789,7 @@ void t_get_querier_pack(IQuerier_Callback &cb,
    };
    MySQL_User<decltype(f)> su(f);
 
-   start_mysql(su, host, user, pass, dbase);
+   start_mysql(su, host, user, pass, dbase, options);
 }
 
 } // namespace
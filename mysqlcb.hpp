@@ -27,15 +27,47 @@ public:
    virtual int operator()(int persist) const { return m_f(persist); }
 };
 
-/** ******** */
+/** *************** */
+class ISeeker_Callback
+{
+public:
+   virtual ~ISeeker_Callback() {}
+   virtual int operator()(uint64_t row) const = 0;
+};
+
+/** ***************** */
+template <typename Func>
+class Seeker_User : public ISeeker_Callback
+{
+protected:
+   const Func &m_f;
+public:
+   Seeker_User(const Func &f) : m_f(f)         {}
+   virtual ~Seeker_User()                      {}
+   virtual int operator()(uint64_t row) const  { return m_f(row); }
+};
+
+/**
+ * The *row_count* and *seeker* members are only set for FETCH_BUFFERED
+ * queries, whose rows are all held by the client.  Otherwise *row_count*
+ * is 0 and *seeker* is nullptr, and seek() always fails.
+ */
 struct PullPack
 {
-   MYSQL            &mysql;
-   Binder           &binder;
-   IPuller_Callback &puller;
+   MYSQL                  &mysql;
+   Binder                 &binder;
+   IPuller_Callback       &puller;
+   uint64_t               row_count;
+   const ISeeker_Callback *seeker;
 
    operator MYSQL&() const { return mysql; }
 
+   bool is_buffered(void) const { return seeker!=nullptr; }
+
+   /** Makes *row* (0-based) the next row pulled.  Returns false if out of range. */
+   bool seek(uint64_t row) const { return seeker && (*seeker)(row); }
+   bool rewind(void) const       { return seek(0); }
+
    void validate(void)
    {
       if (&mysql==nullptr)
@@ -164,6 +196,11 @@ typedef void (*pullpack_callback)(PullPack &p);
  */
 
 void execute_query(MYSQL &mysql, IBinder_Callback &cb, const char *query);
+void execute_query(MYSQL &mysql, IBinder_Callback &cb, const char *query, const MParam *params);
+void execute_prepared_query(MYSQL &mysql,
+                            IBinder_Callback &cb,
+                            const char *query,
+                            const Binder *params=nullptr);
 
 /**
  * Call execute_query callback function.
@@ -176,13 +213,161 @@ inline void execute_query(MYSQL &mysql, binder_callback cb, const char *query)
    execute_query(mysql, bu, query);
 }
 
+/**
+ * What the callback of execute_query_until() wants after each row.
+ *
+ * - ROW_CONTINUE asks for the next row.
+ * - ROW_SKIP_REST ends the callbacks.  The rest of the result is read
+ *   and discarded without being converted into the Binder, which is the
+ *   cheapest way out of a small or nearly finished result.
+ * - ROW_STOP cancels the rest of the transfer.  The statement is reset,
+ *   and if the query has an IQuery_Canceller, the server is first told
+ *   to stop sending rows, which saves reading a huge result to its end.
+ *
+ * Neither ends the transfer at once: mysql_stmt_free_result(),
+ * mysql_stmt_reset() and mysql_free_result() read the rows the server
+ * has already sent, on the client, before the connection is free.
+ * Without a canceller, ROW_STOP drains the whole result like
+ * ROW_SKIP_REST.
+ */
+enum Row_Control
+{
+   ROW_CONTINUE,
+   ROW_SKIP_REST,
+   ROW_STOP
+};
+
+class IRow_Control_Callback
+{
+public:
+   virtual ~IRow_Control_Callback() {}
+   virtual Row_Control operator()(Binder &binder) const = 0;
+};
+
+template <typename Func>
+class Row_Control_User : public IRow_Control_Callback
+{
+protected:
+   const Func &m_f;
+public:
+   Row_Control_User(const Func &f) : m_f(f)                 {}
+   virtual ~Row_Control_User()                              {}
+   virtual Row_Control operator()(Binder &binder) const     { return m_f(binder); }
+};
+
+/**
+ * Stops the running query of the connection with *thread_id*, as from
+ * mysql_thread_id(), for a callback that returns ROW_STOP.  It must
+ * work through another connection, since the query's own connection is
+ * busy with the result, and must not wait for a connection the stopped
+ * query may hold.  See Kill_Query_Canceller in mysqlcb_pool.hpp.
+ */
+class IQuery_Canceller
+{
+public:
+   virtual ~IQuery_Canceller() {}
+   virtual void operator()(unsigned long thread_id) const = 0;
+};
+
+/**
+ * Executes the query like execute_query(), but the callback returns a
+ * Row_Control to end the result early, for existence checks and "first
+ * N rows" consumers.  Without parameters, the query is sent by the text
+ * protocol.
+ *
+ *~~~c++
+bool found = false;
+auto f = [&found](Binder &b) -> Row_Control { found = true; return ROW_STOP; };
+Row_Control_User<decltype(f)> ru(f);
+execute_query_until(mysql, ru, "SELECT id FROM Orders WHERE status='late'");
+ *~~~
+ */
+void execute_query_until(MYSQL &mysql,
+                         IRow_Control_Callback &cb,
+                         const char *query,
+                         const MParam *params=nullptr,
+                         const IQuery_Canceller *canceller=nullptr);
+void execute_prepared_query_until(MYSQL &mysql,
+                                  IRow_Control_Callback &cb,
+                                  const char *query,
+                                  const Binder *params=nullptr,
+                                  const IQuery_Canceller *canceller=nullptr);
+
+/**
+ * How the rows of a pulled query travel from the server.
+ *
+ * - FETCH_STREAM, the default, reads each row from the connection as it is
+ *   pulled.  The connection is busy until the last row is read.
+ * - FETCH_CURSOR opens a read-only server-side cursor and fetches
+ *   *prefetch_rows* rows per round trip, so a large scan can be consumed
+ *   at the caller's pace while the server holds the result.
+ * - FETCH_BUFFERED reads the whole result into client memory with
+ *   mysql_stmt_store_result() before the callback is called.  The PullPack
+ *   then knows the row count and can seek() to any row or rewind(), so a
+ *   result can be paged back and forth without running the query again.
+ */
+enum Fetch_Mode
+{
+   FETCH_STREAM,
+   FETCH_CURSOR,
+   FETCH_BUFFERED
+};
+
+/**
+ * The *sizing* rules apply to the field buffers of uncached queries.
+ * A Stmt_Cache lays out its Binder when the statement is prepared,
+ * before any values are seen, so it ignores them, as does the text
+ * protocol, which leaves the values where they are in the fetched row.
+ */
+struct Pull_Options
+{
+   Fetch_Mode    mode;
+   unsigned long prefetch_rows;   ///< Rows per cursor fetch, ignored for FETCH_STREAM
+   Buffer_Sizing sizing;
+};
+
+const Pull_Options default_pull_options = { FETCH_STREAM, 1, { false, 0, nullptr } };
+
+/** Returns options for a result read into client memory for random access. */
+inline Pull_Options buffered_pull_options(void)
+{
+   Pull_Options po = default_pull_options;
+   po.mode = FETCH_BUFFERED;
+   return po;
+}
+
+/**
+ * Returns options for a buffered result whose variable-length field
+ * buffers are sized to the longest value in each column, up to *limit*
+ * bytes, with optional per-column sizes in *overrides*.
+ */
+inline Pull_Options adaptive_pull_options(unsigned long limit = 65536,
+                                          const Column_Size *overrides = nullptr)
+{
+   Pull_Options po = buffered_pull_options();
+   po.sizing.use_max_length = true;
+   po.sizing.limit = limit;
+   po.sizing.overrides = overrides;
+   return po;
+}
+
+/** Returns options for a read-only cursor fetching *prefetch_rows* at a time. */
+inline Pull_Options cursor_pull_options(unsigned long prefetch_rows)
+{
+   Pull_Options po = default_pull_options;
+   po.mode = FETCH_CURSOR;
+   po.prefetch_rows = prefetch_rows;
+   return po;
+}
+
    /** This is the real function.  All the overrides below massage the
        arguments to conform to and call this function.
    */
    void int_execute_query_pull(MYSQL &mysql,
                                IPullPack_Callback &cb,
                                const char *query,
-                               const Binder *params);
+                               const Binder *params,
+                               const Pull_Options *options=nullptr);
 
    // No-param pulls
    inline void execute_query_pull(MYSQL &mysql,
@@ -267,27 +452,588 @@ inline void execute_query(MYSQL &mysql, binder_callback cb, const char *query)
 
       summon_binder(bu, params);
    }
-      
+
+   // Pulls with Pull_Options
+   template <typename Func>
+   inline void execute_query_pull(MYSQL &mysql,
+                                  Func cb,
+                                  const char *query,
+                                  const Pull_Options &options)
+   {
+      PullPack_User<Func> bu(cb);
+      int_execute_query_pull(mysql, bu, query, nullptr, &options);
+   }
+
+   template <typename Func>
+   inline void execute_query_pull(MYSQL &mysql,
+                                  Func cb,
+                                  const char *query,
+                                  const MParam *params,
+                                  const Pull_Options &options)
+   {
+      auto f = [&mysql, &cb, &query, &options](Binder &b)
+      {
+         PullPack_User<Func> bu(cb);
+         int_execute_query_pull(mysql, bu, query, &b, &options);
+      };
+      Binder_User<decltype(f)> bu(f);
+
+      summon_binder(bu, params);
+   }
+
+
+/**
+ * The phases of a query timed for an IQuery_Observer.  A text-protocol
+ * query has no prepare phase.  For a Stmt_Cache, the prepare phase is
+ * the cache lookup, which prepares the statement on a miss, and there is
+ * no metadata phase.
+ */
+enum Query_Phase
+{
+   PHASE_PREPARE,    ///< Preparing the statement
+   PHASE_EXECUTE,    ///< Sending the query, and storing a FETCH_BUFFERED result
+   PHASE_METADATA,   ///< Reading the result fields and laying out the Binder
+   PHASE_FETCH,      ///< Fetching rows
+   PHASE_CALLBACK,   ///< In the caller's callback, between fetches
+   PHASE_COUNT
+};
+
+/** What an IQuery_Observer learns about a finished query. */
+struct Query_Stats
+{
+   const char    *query;
+   uint64_t      phase_ns[PHASE_COUNT];  ///< Monotonic nanoseconds in each phase
+   unsigned long rows;
+   uint64_t      bytes;                  ///< Total length of the non-NULL values fetched
+   unsigned long truncations;            ///< Values longer than their buffers
+   const char    *error;                 ///< nullptr, or why the query failed
+};
+
+/**
+ * @brief Receives the Query_Stats of each execute_query() and
+ * execute_query_pull() call.
+ *
+ * Install one with set_query_observer().  It is called on the thread
+ * that ran the query, after the query finishes or fails, so it must be
+ * safe to call from several threads at once, and the Query_Stats are
+ * valid only during the call.  With no observer installed, a query
+ * pays for one atomic load.  See Query_Stats_Aggregator in
+ * mysqlcb_stats.hpp for an observer that collects latency histograms.
+ */
+class IQuery_Observer
+{
+public:
+   virtual ~IQuery_Observer() {}
+   virtual void operator()(const Query_Stats &stats) const = 0;
+};
+
+void set_query_observer(const IQuery_Observer *observer);
+const IQuery_Observer *get_query_observer(void);
+
+/**
+ * Times the phases of one query for the installed IQuery_Observer.
+ *
+ * lap() charges the time since the previous lap to a phase.  The
+ * query function calls done() or fail() when the query ends, which
+ * reports to the observer.  When no observer was installed as the probe
+ * was made, every call returns at once.
+ */
+class Query_Probe
+{
+public:
+   Query_Probe(const char *query);
+   ~Query_Probe();
+   Query_Probe(const Query_Probe&) = delete;
+   Query_Probe& operator=(const Query_Probe&) = delete;
+
+   inline bool active(void) const                { return m_observer!=nullptr; }
+   inline void lap(Query_Phase phase)            { if (m_observer) record_lap(phase); }
+   inline void count_row(const Binder &binder)   { if (m_observer) record_row(binder); }
+
+   void done(void);
+   void fail(const char *error);
+
+protected:
+   void record_lap(Query_Phase phase);
+   void record_row(const Binder &binder);
+   void report(const char *error);
+
+   const IQuery_Observer *m_observer;
+   Query_Stats           m_stats;
+   uint64_t              m_mark;
+};
+
+/**
+ * Building blocks shared by the query functions.  Each throws a
+ * std::runtime_error with the MySQL error message on failure.
+ *
+ * t_prepare_statement() prepares a query and invokes the callback with the
+ * statement handle before closing it, and t_execute_statement() does the
+ * same after executing the statement.
+ */
+using IStmt_Callback = IGeneric_Callback<MYSQL_STMT>;
+template <typename Func>
+using Stmt_User = Generic_User<MYSQL_STMT, Func>;
+
+void throw_stmt_error(const char *msg, MYSQL_STMT *stmt);
+void prepare_statement(MYSQL_STMT *stmt, const char *query);
+void set_fetch_mode(MYSQL_STMT *stmt, const Pull_Options &options);
+void execute_statement(MYSQL_STMT *stmt,
+                       const Binder *params,
+                       const Pull_Options *options=nullptr);
+void push_rows(MYSQL_STMT *stmt,
+               Binder &binder,
+               IBinder_Callback &cb,
+               Query_Probe *probe=nullptr);
+void push_rows_until(MYSQL &mysql,
+                     MYSQL_STMT *stmt,
+                     Binder &binder,
+                     IRow_Control_Callback &cb,
+                     const IQuery_Canceller *canceller=nullptr,
+                     Query_Probe *probe=nullptr);
+void pull_rows(MYSQL &mysql,
+               MYSQL_STMT *stmt,
+               Binder &binder,
+               IPullPack_Callback &cb,
+               const Pull_Options *options=nullptr,
+               Query_Probe *probe=nullptr);
+void t_prepare_statement(MYSQL &mysql, IStmt_Callback &cb, const char *query);
+void t_execute_statement(MYSQL &mysql,
+                         IStmt_Callback &cb,
+                         const char *query,
+                         const Binder *params=nullptr,
+                         const Pull_Options *options=nullptr);
+
+/**
+ * Text-protocol versions of execute_query() and int_execute_query_pull()
+ * for queries without parameters.  The rows are sent as text with
+ * mysql_real_query() and read with mysql_use_result() (or
+ * mysql_store_result() for FETCH_BUFFERED), but are presented through a
+ * Binder like those of a prepared statement: each Bind_Data has the
+ * field's BDType and string values point into the fetched row.  Numbers
+ * and dates wait as *pending_text* and are converted to their native
+ * types the first time the value is read through value_of() or the
+ * BDType functions, so columns a callback skips cost nothing.  Code that
+ * reads *bd.data* directly must call ensure_native(bd) first.  The
+ * Binder's *stmt* is nullptr, and no value is ever truncated.
+ */
+void execute_text_query(MYSQL &mysql, IBinder_Callback &cb, const char *query);
+void execute_text_query_until(MYSQL &mysql,
+                              IRow_Control_Callback &cb,
+                              const char *query,
+                              const IQuery_Canceller *canceller=nullptr);
+void execute_text_query_pull(MYSQL &mysql,
+                             IPullPack_Callback &cb,
+                             const char *query,
+                             const Pull_Options *options=nullptr);
+
+/**
+ * Row loop of execute_query_inline().  Like push_rows(), but *f* is
+ * called directly rather than through IBinder_Callback.
+ */
+template <typename Func>
+inline void push_rows_inline(MYSQL_STMT *stmt, Binder &binder, const Func &f)
+{
+   int result;
+   while ((result=mysql_stmt_fetch(stmt))!=MYSQL_NO_DATA)
+   {
+      if (result==0 || result==MYSQL_DATA_TRUNCATED)
+      {
+         mark_truncations(binder, result);
+         f(binder);
+      }
+      else
+         throw_stmt_error("Failed to fetch row", stmt);
+   }
+}
+
+/**
+ * Executes the query and calls *f* with the Binder of each result row,
+ * like execute_query(), but with the row loop compiled into the caller.
+ * Unlike execute_query(), it always prepares the statement, even without
+ * parameters, so a one-off parameterless query pays a prepare round trip
+ * that execute_query() would save by using the text protocol.
+ *
+ * execute_query() makes a virtual call through IBinder_Callback for
+ * every row, which keeps the compiler from seeing into the callback.
+ * Here the loop is a template on the type of *f*, so a short per-row
+ * body, like a sum over a column, can be inlined into the loop.  Pair
+ * it with value_of() to read values without the virtual BDType
+ * functions.
+ *
+ *~~~c++
+int64_t total = 0;
+auto f = [&total](Binder &b) { total += value_of<int32_t>(b.bind_data[0]); };
+execute_query_inline(mysql, f, "SELECT quantity FROM Orders");
+ *~~~
+ */
+template <typename Func>
+inline void execute_query_inline(MYSQL &mysql,
+                                 const Func &f,
+                                 const char *query,
+                                 const Binder *params=nullptr)
+{
+   auto fstmt = [&mysql, &f](MYSQL_STMT &stmt)
+   {
+      auto fbind = [&stmt, &f](Binder &b)
+      {
+         if (mysql_stmt_bind_result(&stmt, b.binds))
+            throw_stmt_error("Failed to bind results", &stmt);
+         push_rows_inline(&stmt, b, f);
+      };
+      Binder_User<decltype(fbind)> bu(fbind);
+
+      get_result_binds(mysql, bu, &stmt);
+   };
+   Stmt_User<decltype(fstmt)> su(fstmt);
+
+   t_execute_statement(mysql, su, query, params);
+}
+
+template <typename Func>
+inline void execute_query_inline(MYSQL &mysql,
+                                 const Func &f,
+                                 const char *query,
+                                 const MParam *params)
+{
+   auto fparams = [&mysql, &f, &query](Binder &b)
+   {
+      execute_query_inline(mysql, f, query, &b);
+   };
+   Binder_User<decltype(fparams)> bu(fparams);
+
+   summon_binder(bu, params);
+}
+
+/**
+ * One column of a Row_Batch, stored as arrays indexed by row.
+ *
+ * - *values* holds *width* bytes per row: the value of a fixed-length
+ *   type, or the text of a variable-length type.  A NULL value is zeroed.
+ * - *lengths* holds the full length of each variable-length value, and
+ *   is nullptr for fixed-length types.  Only *width* bytes of a longer
+ *   value are kept, so a length over *width* marks a truncated value:
+ *   use column_length() for the bytes in *values*, and is_truncated().
+ * - *nulls* is a bitmap with a bit set for each NULL value.
+ */
+struct Column_Batch
+{
+   const MYSQL_FIELD *field;
+   const BDType      *bdtype;
+   size_t            width;
+   char              *values;
+   unsigned long     *lengths;
+   uint8_t           *nulls;
+};
+
+/**
+ * A batch of up to *capacity* result rows, arranged by column so a loop
+ * over one column reads contiguous values.
+ */
+struct Row_Batch
+{
+   uint32_t     row_count;
+   uint32_t     capacity;
+   uint32_t     column_count;
+   Column_Batch *columns;
+};
+
+/** Returns the values of a fixed-length column as an array of T. */
+template <typename T>
+inline const T *column_values(const Column_Batch &col) { return reinterpret_cast<const T*>(col.values); }
+inline const char *column_text(const Column_Batch &col, uint32_t row) { return col.values + row * col.width; }
+inline bool is_null(const Column_Batch &col, uint32_t row) { return (col.nulls[row>>3] >> (row&7)) & 1; }
+inline bool is_truncated(const Column_Batch &col, uint32_t row) { return col.lengths && col.lengths[row] > col.width; }
+inline unsigned long column_length(const Column_Batch &col, uint32_t row)
+{
+   return is_truncated(col, row) ? col.width : col.lengths ? col.lengths[row] : col.width;
+}
+
+using IBatch_Callback = IGeneric_Callback<Row_Batch>;
+template <typename Func>
+using Batch_User = Generic_User<Row_Batch,Func>;
+
+/** Largest number of bytes used for the column arrays of a batch. */
+const size_t max_batch_memory = 1024 * 1024;
+
+void t_execute_query_batch(MYSQL &mysql,
+                           IBatch_Callback &cb,
+                           const char *query,
+                           uint32_t batch_rows=1024,
+                           const Binder *params=nullptr);
+
+/**
+ * Executes the query and calls *f* with batches of up to *batch_rows*
+ * rows in per-column arrays, rather than once per row.
+ *
+ * The batch size is reduced if the column arrays would take more than
+ * max_batch_memory bytes.  Arrays beyond the stack budget of Scratch
+ * are in the thread arena.
+ *
+ *~~~c++
+auto f = [&total](const Row_Batch &batch)
+{
+   const double *prices = column_values<double>(batch.columns[0]);
+   for (uint32_t i=0; i<batch.row_count; ++i)
+      total += prices[i];
+};
+execute_query_batch(mysql, f, "SELECT price FROM Orders");
+ *~~~
+ */
+template <typename Func>
+inline void execute_query_batch(MYSQL &mysql,
+                                const Func &f,
+                                const char *query,
+                                uint32_t batch_rows=1024)
+{
+   Batch_User<Func> bu(f);
+   t_execute_query_batch(mysql, bu, query, batch_rows);
+}
+
+template <typename Func>
+inline void execute_query_batch(MYSQL &mysql,
+                                const Func &f,
+                                const char *query,
+                                const MParam *params,
+                                uint32_t batch_rows=1024)
+{
+   auto fparams = [&mysql, &f, &query, batch_rows](Binder &b)
+   {
+      Batch_User<Func> bu(f);
+      t_execute_query_batch(mysql, bu, query, batch_rows, &b);
+   };
+   Binder_User<decltype(fparams)> bu(fparams);
+
+   summon_binder(bu, params);
+}
+
+/**
+ * Executes a statement once for each row of parameters in *rows*, an
+ * array of *row_count* rows of one MParam per parameter, and returns the
+ * total of affected rows.  See bulk.cpp.
+ */
+uint64_t execute_bulk(MYSQL &mysql, const char *query, const MParam *rows, uint64_t row_count);
+
+/**
+ * Per-connection cache of prepared statements, keyed by query text.
+ *
+ * A cached statement keeps its MYSQL_STMT handle, its result metadata,
+ * and its result Binder, so repeated queries skip the prepare round trip
+ * and the bind setup.  When the cache is full, the least-recently used
+ * statement is closed to make room.
+ *
+ * The cache owns heap memory for its statements and binders, since they
+ * must outlive the stack frame that fills them.  Create it in a
+ * start_mysql() callback and let it go out of scope before the
+ * connection closes.
+ *
+ *~~~c++
+auto f = [](MYSQL &mysql)
+{
+   Stmt_Cache cache(mysql);
+   for (int id : ids)
+   {
+      MParam params[2] = { id };
+      execute_query_pull(cache, use_person, "SELECT * FROM Person WHERE id=?", params);
+   }
+};
+start_mysql(f);
+ *~~~
+ */
+class Stmt_Cache
+{
+public:
+   struct Entry;
+
+   Stmt_Cache(MYSQL &mysql, uint32_t capacity=32);
+   ~Stmt_Cache();
+   Stmt_Cache(const Stmt_Cache&) = delete;
+   Stmt_Cache& operator=(const Stmt_Cache&) = delete;
+
+   inline MYSQL &mysql(void) const            { return m_mysql; }
+   inline uint32_t capacity(void) const       { return m_capacity; }
+   inline unsigned long hits(void) const      { return m_hits; }
+   inline unsigned long misses(void) const    { return m_misses; }
+   inline unsigned long evictions(void) const { return m_evictions; }
+   uint32_t size(void) const;
+
+   /** Closes all cached statements without resetting the counters. */
+   void clear(void);
+
+   /** Returns the entry for *query*, preparing it if not cached. */
+   Entry &acquire(const char *query);
+   /** Closes the entry, as after a failed execute, so it will be prepared again. */
+   void discard(Entry &entry);
+
+   static MYSQL_STMT *stmt(Entry &entry);
+   static Binder &binder(Entry &entry);
+
+protected:
+   MYSQL         &m_mysql;
+   uint32_t      m_capacity;
+   Entry         *m_entries;
+   unsigned long m_tick;
+   unsigned long m_hits;
+   unsigned long m_misses;
+   unsigned long m_evictions;
+};
+
+void execute_query(Stmt_Cache &cache, IBinder_Callback &cb, const char *query);
+
+inline void execute_query(Stmt_Cache &cache, binder_callback cb, const char *query)
+{
+   Binder_User<binder_callback> bu(cb);
+   execute_query(cache, bu, query);
+}
+
+void execute_query_until(Stmt_Cache &cache,
+                         IRow_Control_Callback &cb,
+                         const char *query,
+                         const MParam *params=nullptr,
+                         const IQuery_Canceller *canceller=nullptr);
+
+void int_execute_query_pull(Stmt_Cache &cache,
+                            IPullPack_Callback &cb,
+                            const char *query,
+                            const Binder *params,
+                            const Pull_Options *options=nullptr);
+
+   inline void execute_query_pull(Stmt_Cache &cache,
+                                  IPullPack_Callback &cb,
+                                  const char *query)
+   {
+      int_execute_query_pull(cache,cb,query,nullptr);
+   }
+
+   template <typename Func>
+   inline void execute_query_pull(Stmt_Cache &cache,
+                                  Func cb,
+                                  const char *query)
+   {
+      PullPack_User<Func> bu(cb);
+      int_execute_query_pull(cache, bu, query, nullptr);
+   }
+
+   inline void execute_query_pull(Stmt_Cache &cache,
+                                  IPullPack_Callback &cb,
+                                  const char *query,
+                                  const MParam *params)
+   {
+      auto f = [&cache, &cb, &query](Binder &b)
+         {
+            int_execute_query_pull(cache, cb, query, &b);
+         };
+      Binder_User<decltype(f)> bu(f);
+
+      summon_binder(bu, params);
+   }
+
+   template <typename Func>
+   inline void execute_query_pull(Stmt_Cache &cache,
+                                  Func cb,
+                                  const char *query,
+                                  const MParam *params)
+   {
+      auto f = [&cache, &cb, &query](Binder &b)
+      {
+         PullPack_User<Func> bu(cb);
+         int_execute_query_pull(cache, bu, query, &b);
+      };
+      Binder_User<decltype(f)> bu(f);
+
+      summon_binder(bu, params);
+   }
+
+   template <typename Func>
+   inline void execute_query_pull(Stmt_Cache &cache,
+                                  Func cb,
+                                  const char *query,
+                                  const MParam *params,
+                                  const Pull_Options &options)
+   {
+      auto f = [&cache, &cb, &query, &options](Binder &b)
+      {
+         PullPack_User<Func> bu(cb);
+         int_execute_query_pull(cache, bu, query, &b, &options);
+      };
+      Binder_User<decltype(f)> bu(f);
+
+      summon_binder(bu, params);
+   }
+
 
 using IMySQL_Callback = IGeneric_Callback<MYSQL>;
 template <typename Func>
 using MySQL_User = Generic_User<MYSQL, Func>;
 
+/**
+ * How to connect, beyond the host, user, password and database.
+ *
+ * - *socket* is the path of a Unix socket, used when the host is nullptr
+ *   or "localhost".  A co-located server is faster this way than by TCP.
+ * - *compress* compresses the protocol (MYSQL_OPT_COMPRESS), which costs
+ *   CPU at both ends but helps large results over a slow link.
+ * - *multi_statements* sets CLIENT_MULTI_STATEMENTS, so one text query
+ *   can hold several statements.  The library hands only the first
+ *   result to the callback and reads past the rest.
+ * - *read_timeout* and *write_timeout* are in seconds, 0 for the client
+ *   library's default.
+ * - *skip_option_file* leaves the [client] group of ~/.my.cnf unread.
+ */
+struct Connection_Options
+{
+   const char   *socket;
+   unsigned int port;               ///< TCP port, 0 for the default
+   bool         compress;
+   bool         multi_statements;
+   unsigned int read_timeout;
+   unsigned int write_timeout;
+   bool         skip_option_file;
+};
+
+const Connection_Options default_connection_options = { nullptr, 0, false, false, 0, 0, false };
+
+/** Returns options for a local server at the Unix socket *path*. */
+inline Connection_Options socket_connection_options(const char *path)
+{
+   Connection_Options co = default_connection_options;
+   co.socket = path;
+   return co;
+}
+
+/** Returns options for a compressed connection to the TCP *port*, 0 for the default. */
+inline Connection_Options compressed_connection_options(unsigned int port = 0)
+{
+   Connection_Options co = default_connection_options;
+   co.port = port;
+   co.compress = true;
+   return co;
+}
+
+void connect_mysql(MYSQL &mysql,
+                   const char *host=nullptr,
+                   const char *user=nullptr,
+                   const char *pass=nullptr,
+                   const char *dbase=nullptr,
+                   const Connection_Options *options=nullptr);
+
 void t_start_mysql(IMySQL_Callback &cb,
                    const char *host=nullptr,
                    const char *user=nullptr,
                    const char *pass=nullptr,
-                   const char *dbase=nullptr);
+                   const char *dbase=nullptr,
+                   const Connection_Options *options=nullptr);
 
 template <typename Func>
 void start_mysql(Func &cb,
                  const char *host=nullptr,
                  const char *user=nullptr,
                  const char *pass=nullptr,
-                 const char *dbase=nullptr)
+                 const char *dbase=nullptr,
+                 const Connection_Options *options=nullptr)
 {
    MySQL_User<Func> cu(cb);
-   t_start_mysql(cu,host,user,pass,dbase);
+   t_start_mysql(cu,host,user,pass,dbase,options);
 }
 
 /** **************** */
@@ -309,21 +1055,25 @@ public:
    virtual void operator()(Querier_Pack &qp) const { m_f(qp); }
 };
 
+void run_querier_pack(IQuerier_Callback &cb, MYSQL &mysql);
+
 void t_get_querier_pack(IQuerier_Callback &cb,
                         const char *host = nullptr,
                         const char *user = nullptr,
                         const char *pass = nullptr,
-                        const char *dbase = nullptr);
+                        const char *dbase = nullptr,
+                        const Connection_Options *options = nullptr);
 
 template <typename Func>
 void get_querier_pack(Func &cb,
                       const char *host = nullptr,
                       const char *user = nullptr,
                       const char *pass = nullptr,
-                      const char *dbase = nullptr)
+                      const char *dbase = nullptr,
+                      const Connection_Options *options = nullptr)
 {
    Querier_User<Func> qu(cb);
-   t_get_querier_pack(qu,host,user,pass,dbase);
+   t_get_querier_pack(qu,host,user,pass,dbase,options);
 }
 
 
@@ -0,0 +1,119 @@
+#ifndef MYSQLCB_ARENA_HPP_SOURCE
+#define MYSQLCB_ARENA_HPP_SOURCE
+
+#include <alloca.h>
+#include <stddef.h>  // for size_t
+
+namespace mysqlcb {
+
+/**
+ * @brief Supplies the blocks of memory of an Arena.
+ *
+ * The default uses malloc() and free().  Replace it with
+ * set_arena_allocator() before any thread has used its arena, for
+ * example to take the blocks from a pool or from huge pages.
+ */
+class IArena_Allocator
+{
+public:
+   virtual ~IArena_Allocator() {}
+   virtual void *allocate(size_t bytes) const = 0;
+   virtual void release(void *block, size_t bytes) const = 0;
+};
+
+void set_arena_allocator(const IArena_Allocator *allocator);
+const IArena_Allocator *get_arena_allocator(void);
+
+/**
+ * @brief A bump allocator for memory that would otherwise be taken
+ * with alloca().
+ *
+ * Allocations are carved from blocks in order and are never freed one
+ * by one: rewind() returns the arena to an earlier mark, keeping the
+ * blocks for reuse, so a thread that runs the same queries over and
+ * over allocates nothing after the first.  Blocks are released when
+ * the thread ends, or by trim().
+ */
+class Arena
+{
+public:
+   struct Block;
+
+   struct Mark
+   {
+      Block  *block;
+      size_t used;
+   };
+
+   Arena();
+   ~Arena();
+   Arena(const Arena&) = delete;
+   Arena& operator=(const Arena&) = delete;
+
+   void *allocate(size_t bytes);
+
+   inline Mark mark(void) const           { Mark m = { m_current, m_used }; return m; }
+   void rewind(const Mark &mark);
+
+   /** Releases the blocks not in use. */
+   void trim(void);
+
+   inline size_t reserved(void) const     { return m_reserved; }
+
+protected:
+   Block  *m_first;
+   Block  *m_current;
+   size_t m_used;
+   size_t m_reserved;
+};
+
+/** The calling thread's arena. */
+Arena &thread_arena(void);
+
+/**
+ * The bytes of stack that the library's scratch memory may take in a
+ * thread at one time, including nested calls.  Anything more comes from
+ * the thread's arena.  The default is 64 KB; 0 puts everything in the
+ * arena, for threads with very small stacks.
+ */
+void set_stack_budget(size_t bytes);
+size_t get_stack_budget(void);
+
+/**
+ * @brief Chooses, for each scratch allocation of a function, between
+ * the stack and the thread's arena.
+ *
+ * The choice is made by the SCRATCH_ALLOC macro, since alloca() must be
+ * called in the frame that uses the memory.  Memory from either place
+ * lasts until the Scratch goes out of scope, which gives back its stack
+ * budget and rewinds the arena.
+ *
+ *~~~c++
+Scratch scratch;
+char *buffer = static_cast<char*>(SCRATCH_ALLOC(scratch, len));
+ *~~~
+ */
+class Scratch
+{
+public:
+   Scratch();
+   ~Scratch();
+   Scratch(const Scratch&) = delete;
+   Scratch& operator=(const Scratch&) = delete;
+
+   /** Reserves *bytes* of the stack budget if they fit.  Returns false if they don't. */
+   bool take_stack(size_t bytes);
+   inline void *take_arena(size_t bytes)  { return m_arena.allocate(bytes); }
+
+protected:
+   Arena       &m_arena;
+   Arena::Mark m_mark;
+   size_t      m_stack;
+};
+
+#define SCRATCH_ALLOC(scratch, bytes) \
+   ((scratch).take_stack(bytes) ? alloca(bytes) : (scratch).take_arena(bytes))
+
+}  // end of namespace mysqlcb
+
+#endif
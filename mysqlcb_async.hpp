@@ -0,0 +1,169 @@
+#ifndef MYSQLCB_ASYNC_HPP_SOURCE
+#define MYSQLCB_ASYNC_HPP_SOURCE
+
+#include <chrono>
+#include <string>
+#include "mysqlcb.hpp"
+
+// The non-blocking API is only in MariaDB Connector/C:
+#ifdef LIBMARIADB
+
+namespace mysqlcb {
+
+class Async_Connection;
+class Async_Loop;
+
+using IAsync_Callback = IGeneric_Callback<Async_Connection>;
+template <typename Func>
+using Async_User = Generic_User<Async_Connection, Func>;
+
+/**
+ * @brief A MariaDB connection driven by an Async_Loop.
+ *
+ * The connection is opened with MYSQL_OPT_NONBLOCK, so that each step of
+ * a connect or query returns to the loop whenever it would block on the
+ * socket.  A connection runs one operation at a time; the operation's
+ * callbacks, query text and parameters must outlive it.
+ *
+ * A failed connect or query doesn't throw.  The connection records the
+ * MySQL error in error() and calls the operation's *done* callback, so
+ * one failure doesn't disturb the other connections of the loop.
+ */
+class Async_Connection
+{
+   friend class Async_Loop;
+public:
+   enum State
+   {
+      ASYNC_CLOSED,
+      ASYNC_CONNECTING,
+      ASYNC_IDLE,
+      ASYNC_PREPARING,
+      ASYNC_EXECUTING,
+      ASYNC_FETCHING,
+      ASYNC_CLOSING
+   };
+
+   Async_Connection();
+   ~Async_Connection();
+   Async_Connection(const Async_Connection&) = delete;
+   Async_Connection& operator=(const Async_Connection&) = delete;
+
+   inline MYSQL &mysql(void)                 { return m_mysql; }
+   inline State state(void) const            { return m_state; }
+   inline bool is_open(void) const           { return m_state!=ASYNC_CLOSED && m_state!=ASYNC_CONNECTING; }
+   inline bool is_busy(void) const           { return m_state!=ASYNC_CLOSED && m_state!=ASYNC_IDLE; }
+   inline bool failed(void) const            { return !m_error.empty(); }
+   inline const char *error(void) const      { return m_error.c_str(); }
+
+   /** Rows delivered and rows affected by the last query. */
+   inline unsigned long row_count(void) const   { return m_row_count; }
+   inline uint64_t affected_rows(void) const    { return m_affected_rows; }
+
+   void close(void);
+
+protected:
+   void advance(int status);
+   void proceed(int wait);
+   int  resume(int status);
+   bool complete(int &wait);
+   int  start_close(void);
+   void fail(const char *msg, const char *detail);
+   void release_statement(void);
+
+   Async_Loop             *m_loop;
+   Async_Connection       *m_prev;
+   Async_Connection       *m_next;
+   MYSQL                  m_mysql;
+   MYSQL_STMT             *m_stmt;
+   State                  m_state;
+   MYSQL                  *m_ret_mysql;
+   int                    m_ret_int;
+   my_bool                m_ret_bool;
+   int                    m_wait;
+   bool                   m_registered;
+   std::chrono::steady_clock::time_point m_deadline;
+
+   const IBinder_Callback *m_cb;
+   const IAsync_Callback  *m_done;
+   const Binder           *m_params;
+   char                   *m_memory;
+   MYSQL_RES              *m_meta;
+   Binder                 m_binder;
+
+   std::string            m_error;
+   unsigned long          m_row_count;
+   uint64_t               m_affected_rows;
+};
+
+/**
+ * @brief Runs the connects and queries of many Async_Connections on one thread.
+ *
+ * Each connection waits for its socket in an epoll set, and run() hands
+ * each ready socket back to its connection to continue where it left
+ * off.  Rows are pushed to the query's IBinder_Callback from inside
+ * run(), one connection at a time, so the callbacks need no locking.
+ *
+ *~~~c++
+Async_Loop loop;
+Async_Connection conns[20];
+for (auto &conn : conns)
+   loop.connect(conn, host, user, pass, dbase);
+loop.run();
+
+auto f = [](Binder &b) { ... };
+Binder_User<decltype(f)> bu(f);
+for (auto &conn : conns)
+   loop.execute_query(conn, bu, "SELECT COUNT(*) FROM Orders");
+loop.run();
+ *~~~
+ *
+ * An exception thrown by a row callback closes that query's statement
+ * and leaves run(), which may be called again to finish the others.
+ * Don't destroy a connection from a callback while run() is running.
+ */
+class Async_Loop
+{
+   friend class Async_Connection;
+public:
+   Async_Loop();
+   ~Async_Loop();
+   Async_Loop(const Async_Loop&) = delete;
+   Async_Loop& operator=(const Async_Loop&) = delete;
+
+   void connect(Async_Connection &conn,
+                const char *host=nullptr,
+                const char *user=nullptr,
+                const char *pass=nullptr,
+                const char *dbase=nullptr,
+                const IAsync_Callback *done=nullptr);
+
+   void execute_query(Async_Connection &conn,
+                      IBinder_Callback &cb,
+                      const char *query,
+                      const Binder *params=nullptr,
+                      const IAsync_Callback *done=nullptr);
+
+   bool run_once(int timeout_ms=-1);
+   void run(void);
+
+   /** Connections waiting on their sockets. */
+   inline uint32_t pending(void) const { return m_pending; }
+
+protected:
+   void attach(Async_Connection &conn);
+   void detach(Async_Connection &conn);
+   void wait(Async_Connection &conn, int status);
+   void unwait(Async_Connection &conn);
+   int  next_timeout(int timeout_ms) const;
+
+   int              m_epoll;
+   uint32_t         m_pending;
+   Async_Connection *m_attached;
+};
+
+}  // end of namespace mysqlcb
+
+#endif  // LIBMARIADB
+
+#endif
@@ -6,8 +6,9 @@
 #include <string.h>  // for memcpy()
 #include <assert.h>
 #include <iostream>
-#include <sstream>   // stringstream to size and copy floating values
-#include <iomanip>   // setw, setfill, etc.
+#include <type_traits>
+#include "mysqlcb_format.hpp"
+#include "mysqlcb_arena.hpp"
 
 
 namespace mysqlcb {
@@ -125,6 +126,15 @@ namespace mysqlcb {
 
 /**
  * This struct is alloced to provide targets for MYSQL_BIND pointer members.
+ *
+ * When a fetched value is longer than its buffer, *is_truncated* is set
+ * and *len_data* holds the full length of the value, while only
+ * available_length() bytes are in *data*.  Use stream_column() to read
+ * the whole value.
+ *
+ * A number or date from a text-protocol row stays as text in
+ * *pending_text* until it is read through value_of() or the BDType
+ * functions, which call ensure_native() to convert it into *data*.
  */
    struct Bind_Data
    {
@@ -139,8 +149,19 @@ namespace mysqlcb {
       MYSQL_FIELD   *field;
       MYSQL_BIND    *bind;
       const BDType  *bdtype;
+
+      mutable const char *pending_text;
    };
 
+   /** Converts the *pending_text* of a text-protocol value into *data*.  See text.cpp. */
+   void convert_pending_text(const Bind_Data &bd);
+
+   inline void ensure_native(const Bind_Data &bd)
+   {
+      if (bd.pending_text)
+         convert_pending_text(bd);
+   }
+
    inline std::ostream& operator<<(std::ostream &os, const Bind_Data &obj)
    {
       return obj.bdtype->stream_it(os, obj);
@@ -151,8 +172,19 @@ namespace mysqlcb {
       return obj->bdtype->stream_it(os, *obj);
    }
 
+   /** Returns the number of bytes of the value that are in the buffer. */
+   inline unsigned long available_length(const Bind_Data &bd)
+   {
+      if (bd.bind && bd.len_data > bd.bind->buffer_length)
+         return bd.bind->buffer_length;
+      else
+         return bd.len_data;
+   }
+
    inline bool valid(const Bind_Data &bd) { return bd.field != nullptr; }
    inline bool valid(const Bind_Data *bd) { return bd->field != nullptr; }
+   inline bool is_truncated(const Bind_Data &bd) { return bd.is_truncated; }
+   inline bool is_truncated(const Bind_Data *bd) { return bd->is_truncated; }
    inline bool is_unsupported_type(const Bind_Data& bd) { return bd.bdtype==nullptr; }
    inline uint32_t required_buffer_size(const Bind_Data& bd) { return bd.bdtype->get_data_len(bd); }
 
@@ -186,8 +218,9 @@ namespace mysqlcb {
 
    inline void t_get_string_value(IString_Callback &cb,const Bind_Data *bd)
    {
+      Scratch scratch;
       size_t len = get_string_length(bd);
-      char *buff = static_cast<char*>(alloca(len+1));
+      char *buff = static_cast<char*>(SCRATCH_ALLOC(scratch, len+1));
       memcpy(buff, bd->data, len);
       buff[len]='\0';
       cb(buff);
@@ -200,6 +233,22 @@ namespace mysqlcb {
    inline bool is_null(const Bind_Data &bd) { return bd.is_null; }
    inline bool is_null(const Bind_Data *bd) { return bd->is_null; }
 
+/**
+ * Typed access to a fetched value without the virtual BDType functions.
+ * T must be the type the column is bound to: the integer type of the
+ * column's size and signedness, float, double, or MYSQL_TIME.
+ *
+ * For string and blob columns, text_of() points to the available_length()
+ * bytes in the buffer, which are not \0-terminated.
+ */
+   template <typename T>
+   inline const T &value_of(const Bind_Data &bd)
+   {
+      ensure_native(bd);
+      return *static_cast<const T*>(bd.data);
+   }
+   inline const char *text_of(const Bind_Data &bd) { return static_cast<const char*>(bd.data); }
+
 
 
 /**
@@ -216,8 +265,63 @@ namespace mysqlcb {
       MYSQL_FIELD *fields;
       MYSQL_BIND  *binds;
       Bind_Data   *bind_data;
+      MYSQL_STMT  *stmt;       ///< Statement bound to the results, nullptr for parameters and text results
+   };
+
+   /** Sets or clears Bind_Data::is_truncated for each field after a fetch. */
+   void mark_truncations(Binder &binder, int fetch_result);
+
+   /** Callback for receiving a column value in pieces. */
+   class IChunk_Callback
+   {
+   public:
+      virtual ~IChunk_Callback() { }
+      virtual void operator()(const char *chunk, size_t len) const = 0;
+   };
+
+   template <class Func>
+   class Chunk_User : public IChunk_Callback
+   {
+   protected:
+      const Func &m_f;
+   public:
+      Chunk_User(const Func &f) : m_f(f) { }
+      virtual void operator()(const char *chunk, size_t len) const { m_f(chunk, len); }
    };
 
+   /**
+    * Sends the complete value of a column of the current row to *sink* in
+    * pieces of no more than *chunk_size* bytes, and returns the number of
+    * bytes sent.
+    *
+    * The part of a truncated value that is already in the field buffer is
+    * sent first, then the remainder is read with mysql_stmt_fetch_column()
+    * through a *chunk_size* stack buffer, so a value of any size can be
+    * copied to a file or socket without being held in memory.
+    *
+    *~~~c++
+    auto f = [&out](Binder &binder)
+    {
+       auto sink = [&out](const char *chunk, size_t len) { out.write(chunk, len); };
+       stream_column(binder, 2, sink);
+    };
+    *~~~
+    */
+   size_t t_stream_column(const Binder &binder,
+                          uint32_t index,
+                          IChunk_Callback &sink,
+                          size_t chunk_size=4096);
+
+   template <class Func>
+   inline size_t stream_column(const Binder &binder,
+                               uint32_t index,
+                               const Func &sink,
+                               size_t chunk_size=4096)
+   {
+      Chunk_User<Func> cu(sink);
+      return t_stream_column(binder, index, cu, chunk_size);
+   }
+
 // inline const Bind_Data& get_bind_data(const Binder &b, int index { return b.bind_data[index]; }
 // inline const BDType& get_bdtype(const Binder &b, int index) { return *get_bind_data(b,index).bdtype; }
 // inline const BDType& get_streamable(const Binder &b, int index) { return get_bdtype(b,index); }
@@ -241,8 +345,63 @@ namespace mysqlcb {
    template <typename Func>
    using Binder_User = Generic_User<Binder,Func>;
 
+   /** Largest buffer, in bytes, bound for a variable-length result field. */
+   const uint32_t max_result_buffer = 1024;
+
+   /** Buffer size for a named result column.  End a list with a nullptr name. */
+   struct Column_Size
+   {
+      const char    *name;
+      unsigned long size;
+   };
+
+/**
+ * Rules for sizing the buffers of variable-length result fields.
+ *
+ * - When *use_max_length* is set and the result is buffered (FETCH_BUFFERED),
+ *   each buffer is sized to the longest value actually in the column, as
+ *   reported by STMT_ATTR_UPDATE_MAX_LENGTH, but no more than *limit*
+ *   bytes if *limit* is not 0.  Otherwise the buffer is the declared
+ *   column length clamped to max_result_buffer.
+ * - A column named in *overrides* gets the listed size regardless.
+ *
+ * Values longer than the buffer are truncated and can be read with
+ * stream_column().
+ */
+   struct Buffer_Sizing
+   {
+      bool              use_max_length;
+      unsigned long     limit;
+      const Column_Size *overrides;
+   };
+
+   const Buffer_Sizing default_buffer_sizing = { false, 0, nullptr };
+
+   bool is_fixed_length(enum_field_types type);
    uint32_t get_bind_size(MYSQL_FIELD *fld);
-   void get_result_binds(MYSQL &mysql, IBinder_Callback &cb, MYSQL_STMT *stmt);
+   uint32_t get_field_buffer_length(const MYSQL_FIELD &fld, const Buffer_Sizing *sizing=nullptr);
+   void get_result_binds(MYSQL &mysql,
+                         IBinder_Callback &cb,
+                         MYSQL_STMT *stmt,
+                         const Buffer_Sizing *sizing=nullptr);
+
+/**
+ * The next two functions separate the result-bind layout from its memory so
+ * a Binder can live somewhere other than the stack frame of get_result_binds().
+ * - get_result_binds_size() returns the bytes needed for the MYSQL_BIND array,
+ *   the terminated Bind_Data array, and the field buffers.
+ * - set_result_binds() lays out those items in *memory* and fills *binder*.
+ *
+ * The fields array must outlive the Binder.
+ */
+   size_t get_result_binds_size(const MYSQL_FIELD *fields,
+                                uint32_t num_fields,
+                                const Buffer_Sizing *sizing=nullptr);
+   void set_result_binds(Binder &binder,
+                         void *memory,
+                         MYSQL_FIELD *fields,
+                         uint32_t num_fields,
+                         const Buffer_Sizing *sizing=nullptr);
 
 /**
  * Implementation of BDBase for fixed-length types
@@ -254,6 +413,7 @@ namespace mysqlcb {
       BD_Num(const char *tname) : BDBase<ftype,is_unsign>(tname) { }
       inline virtual std::ostream& stream_it(std::ostream &os, const Bind_Data &bd) const
       {
+         ensure_native(bd);
          os << *static_cast<T*>(bd.data);
          return os;
       }
@@ -263,6 +423,7 @@ namespace mysqlcb {
       }
       inline virtual void set_with_value(const Bind_Data &bd, void* buff, size_t len) const
       {
+         ensure_native(bd);
          memcpy(buff, bd.data, sizeof(T));
       }
    };
@@ -270,96 +431,155 @@ namespace mysqlcb {
    template <typename T, enum_field_types ftype, bool is_unsign=0>
    class BD_Int : public BD_Num<T,ftype,is_unsign>
    {
+   protected:
+      /** Widened to the 64-bit type of the same signedness, so TINYINT prints as a number. */
+      using Wide = typename std::conditional<is_unsign, uint64_t, int64_t>::type;
+      static inline Wide value(const Bind_Data &bd)
+      {
+         ensure_native(bd);
+         return *static_cast<T*>(bd.data);
+      }
+
    public:
       BD_Int(const char *tname) : BD_Num<T,ftype,is_unsign>(tname) { }
 
+      inline virtual std::ostream& stream_it(std::ostream &os, const Bind_Data &bd) const
+      {
+         char buff[max_integer_chars];
+         os.write(buff, format_integer(value(bd), buff));
+         return os;
+      }
+
       /** Makes no accomodation for terminating \0. */
       virtual size_t get_string_length(const Bind_Data &bd) const
       {
-         T val = *static_cast<T*>(bd.data);
-         int sign_add = val < 0 ? 1 : 0;
-         if (sign_add)
-            val = 0-val;
-         return static_cast<size_t>(sign_add + 1 + floor(log10(val)));
+         return integer_length(value(bd));
       }
       virtual void get_string_value(const Bind_Data &bd, char *buff, size_t len) const
       {
-         T val = *static_cast<T*>(bd.data);
-         int sign_add = val < 0 ? 1 : 0;
-
-         char *ptr = &buff[len-1];
-         while (val && ptr >= buff)
-         {
-            *ptr = '0' + val % 10;
-            val /= 10;
-            --ptr;
-         }
-         if (sign_add && ptr<=buff)
-            *ptr = '-';
+         char text[max_integer_chars];
+         copy_formatted(text, format_integer(value(bd), text), buff, len);
       }
    };
 
+/**
+ * Floating values are written with the fewest digits that read back as
+ * the same value.
+ *
+ * get_string_length() has to format the value to measure it, so it keeps
+ * the text for this thread, and the get_string_value() that usually
+ * follows for the same value copies it instead of formatting again.
+ */
    template <typename T, enum_field_types ftype>
    class BD_Float : public BD_Num<T,ftype,0>
    {
+   protected:
+      struct Float_Text
+      {
+         typename Float_Bits<T>::type bits;   ///< Compared as bits, so -0 and 0 differ
+         size_t                       len;    ///< 0 until a value is formatted
+         char                         text[max_float_chars];
+      };
+
+      static inline Float_Text &last_text(void)
+      {
+         static thread_local Float_Text last = { 0, 0, { 0 } };
+         return last;
+      }
+
+      /** Returns the text of the value of *bd*, formatting it only if it isn't the last one. */
+      static inline const Float_Text &text_of(const Bind_Data &bd)
+      {
+         Float_Text &last = last_text();
+         typename Float_Bits<T>::type bits;
+         ensure_native(bd);
+         memcpy(&bits, bd.data, sizeof(bits));
+         if (last.len==0 || bits!=last.bits)
+         {
+            last.bits = bits;
+            last.len = format_float(*static_cast<T*>(bd.data), last.text);
+         }
+         return last;
+      }
+
    public:
       BD_Float(const char *tname) : BD_Num<T,ftype,0>(tname) { }
+
+      inline virtual std::ostream& stream_it(std::ostream &os, const Bind_Data &bd) const
+      {
+         char buff[max_float_chars];
+         ensure_native(bd);
+         os.write(buff, format_float(*static_cast<T*>(bd.data), buff));
+         return os;
+      }
       virtual size_t get_string_length(const Bind_Data &bd) const
       {
-         T val = *static_cast<T*>(bd.data);
-
-         char buff[15];
-         std::stringstream sstr;
-         sstr.precision(5);
-         sstr.rdbuf()->pubsetbuf(buff,15);
-         sstr << val;
-         return sstr.tellp();
+         return text_of(bd).len;
       }
       virtual void get_string_value(const Bind_Data &bd, char *buff, size_t len) const
       {
-         T val = *static_cast<T*>(bd.data);
-         std::stringstream sstr;
-         sstr.precision(5);
-         sstr.rdbuf()->pubsetbuf(buff,len);
-         sstr << val;
+         const Float_Text &ft = text_of(bd);
+         copy_formatted(ft.text, ft.len, buff, len);
       }
    };
 
+/**
+ * Base of the MYSQL_TIME types.  Each derived class supplies format(),
+ * which writes the value into a max_temporal_chars buffer, from which
+ * the streaming and string functions all work.
+ *
+ * Fractions of a second are shown to the number of places declared
+ * for the column, as in DATETIME(3).
+ */
    template <enum_field_types ftype>
    class BD_DateBase : public BDBase<ftype>
    {
    public:
       BD_DateBase(const char *tname) : BDBase<ftype>(tname) { }
-      inline virtual std::ostream& stream_it(std::ostream &os, const Bind_Data &bd) const=0;
+      virtual size_t format(const MYSQL_TIME &t, unsigned decimals, char *buff) const = 0;
+
+      static inline unsigned decimals(const Bind_Data &bd)
+      {
+         return bd.field ? bd.field->decimals : 0;
+      }
+      inline size_t format(const Bind_Data &bd, char *buff) const
+      {
+         ensure_native(bd);
+         return format(*static_cast<const MYSQL_TIME*>(bd.data), decimals(bd), buff);
+      }
+
+      inline virtual std::ostream& stream_it(std::ostream &os, const Bind_Data &bd) const
+      {
+         char buff[max_temporal_chars];
+         os.write(buff, format(bd, buff));
+         return os;
+      }
       inline virtual size_t get_data_len(const Bind_Data &bd) const {return sizeof(MYSQL_TIME);}
       inline virtual void set_with_value(const Bind_Data &bd, void* buff, size_t len) const
       {
+         ensure_native(bd);
          memcpy(buff, bd.data, sizeof(MYSQL_TIME));
       }
+      virtual size_t get_string_length(const Bind_Data &bd) const
+      {
+         char buff[max_temporal_chars];
+         return format(bd, buff);
+      }
+      virtual void get_string_value(const Bind_Data &bd, char *buff, size_t len) const
+      {
+         char text[max_temporal_chars];
+         copy_formatted(text, format(bd, text), buff, len);
+      }
    };
 
    class BD_Date : public BD_DateBase<MYSQL_TYPE_DATE>
    {
    public:
       BD_Date(void) : BD_DateBase<MYSQL_TYPE_DATE>("DATE") { }
-      inline virtual std::ostream& stream_it(std::ostream &os, const Bind_Data &bd) const
-      {
-         const MYSQL_TIME &date = *static_cast<const MYSQL_TIME*>(bd.data);
-         os << std::setfill('0')
-            << std::setw(4) << date.year
-            << "-" << std::setw(2) << date.month
-            << "-" << std::setw(2) << date.day;
-         return os;
-      }
-      virtual size_t get_string_length(const Bind_Data &bd) const   { return 10; }
-      virtual void get_string_value(const Bind_Data &bd, char *buff, size_t len) const
+      using BD_DateBase<MYSQL_TYPE_DATE>::format;
+      virtual size_t format(const MYSQL_TIME &t, unsigned decimals, char *buff) const
       {
-         if (len>=10)
-         {
-            std::stringstream sstr;
-            sstr.rdbuf()->pubsetbuf(buff,len);
-            stream_it(sstr, bd);
-         }
+         return format_date(t, buff);
       }
    };
 
@@ -368,27 +588,10 @@ namespace mysqlcb {
    {
    public:
       BD_DateTimeBase(const char *name) : BD_DateBase<ftype>(name) { }
-      inline virtual std::ostream& stream_it(std::ostream &os, const Bind_Data &bd) const
-      {
-         const MYSQL_TIME &date = *static_cast<const MYSQL_TIME*>(bd.data);
-         os << std::setfill('0')
-            << std::setw(4) << date.year
-            << "-" << std::setw(2) << date.month
-            << "-" << std::setw(2) << date.day
-            << " " << std::setw(2) << date.hour
-            << ":" << std::setw(2) << date.minute
-            << ":" << std::setw(2) << date.second;
-         return os;
-      }
-      virtual size_t get_string_length(const Bind_Data &bd) const { return 19; }
-      virtual void get_string_value(const Bind_Data &bd, char *buff, size_t len) const
+      using BD_DateBase<ftype>::format;
+      virtual size_t format(const MYSQL_TIME &t, unsigned decimals, char *buff) const
       {
-         if (len>=19)
-         {
-            std::stringstream sstr;
-            sstr.rdbuf()->pubsetbuf(buff,len);
-            stream_it(sstr, bd);
-         }
+         return format_datetime(t, decimals, buff);
       }
    };
 
@@ -399,60 +602,43 @@ namespace mysqlcb {
    {
    public:
       BD_Time(void) : BD_DateBase<MYSQL_TYPE_TIME>("TIME") { }
-      inline virtual std::ostream& stream_it(std::ostream &os, const Bind_Data &bd) const
-      {
-         const MYSQL_TIME &date = *static_cast<const MYSQL_TIME*>(bd.data);
-         os << std::setfill('0')
-            << std::setw(2) << date.hour
-            << ":" << std::setw(2) << date.minute
-            << ":" << std::setw(2) << date.second;
-         return os;
-      }
-      virtual size_t get_string_length(const Bind_Data &bd) const { return 8; }
-      virtual void get_string_value(const Bind_Data &bd, char *buff, size_t len) const
+      using BD_DateBase<MYSQL_TYPE_TIME>::format;
+      virtual size_t format(const MYSQL_TIME &t, unsigned decimals, char *buff) const
       {
-         if (len>=8)
-         {
-            std::stringstream sstr;
-            sstr.rdbuf()->pubsetbuf(buff,len);
-            stream_it(sstr, bd);
-         }
+         return format_time(t, decimals, buff);
       }
    };
 
-
-
-
    template <enum_field_types strtype>
    class BD_String : public BDBase<strtype>
    {
    public:
       BD_String(const char *tname) : BDBase<strtype>(tname) { }
+      // These functions use only the part of a truncated value that
+      // is in the buffer.  Use stream_column() for the whole value.
       inline virtual std::ostream& stream_it(std::ostream &os, const Bind_Data &bd) const
       {
-         os.write(static_cast<const char*>(bd.data), bd.len_data);
+         os.write(static_cast<const char*>(bd.data), available_length(bd));
          return os;
       }
 
       inline virtual size_t get_data_len(const Bind_Data &bd) const
       {
-         return bd.len_data;
+         return available_length(bd);
       }
       inline virtual void set_with_value(const Bind_Data &bd, void* buff, size_t len) const
       {
-         memcpy(buff, bd.data, bd.len_data);
-         if (len > bd.len_data)
-         {
-            char *ptr = static_cast<char*>(buff);
-            ptr += bd.len_data;
-            *ptr = '\0';
-            // static_cast<char*>(buff)[bd.len_data] = '\0';
-         }
+         size_t avail = available_length(bd);
+         size_t copylen = len < avail ? len : avail;
+         memcpy(buff, bd.data, copylen);
+         if (len > copylen)
+            static_cast<char*>(buff)[copylen] = '\0';
       }
-      virtual size_t get_string_length(const Bind_Data &bd) const { return bd.len_data; }
+      virtual size_t get_string_length(const Bind_Data &bd) const { return available_length(bd); }
       virtual void get_string_value(const Bind_Data &bd, char *buff, size_t len) const
       {
-         size_t copylen = len < bd.len_data ? len : bd.len_data;
+         size_t avail = available_length(bd);
+         size_t copylen = len < avail ? len : avail;
          memcpy(buff, bd.data, copylen);
          if (copylen < len)
             buff[copylen] = '\0';
@@ -513,6 +699,11 @@ namespace mysqlcb {
    void summon_binder(IBinder_Callback &cb,...);
 
 
+/**
+ * A parameter value for summon_binder() and execute_bulk().  A
+ * default-constructed MParam has no data: it sends NULL in a bulk row
+ * and ends a parameter list.  An empty string is a value like any other.
+ */
    class MParam
    {
    protected:
@@ -525,9 +716,10 @@ namespace mysqlcb {
       MParam(int &val);
       MParam(unsigned int &val);
       MParam(double &val);
+      MParam(MYSQL_TIME &val);
 
-      inline bool         is_null(void) const      { return m_size==0; }
-      inline bool         is_valid(void) const     { return m_size!=0; assert(confirm_bdtype(m_type)); }
+      inline bool         is_null(void) const      { return m_data==nullptr; }
+      inline bool         is_valid(void) const     { return m_data!=nullptr; assert(confirm_bdtype(m_type)); }
       inline size_t       size(void) const         { return m_size; }
       inline const void   *data(void) const        { return m_data; }
       inline const BDType *type(void) const        { return m_type; }
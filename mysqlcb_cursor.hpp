@@ -0,0 +1,199 @@
+#ifndef MYSQLCB_CURSOR_HPP_SOURCE
+#define MYSQLCB_CURSOR_HPP_SOURCE
+
+#include "mysqlcb.hpp"
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#include <utility>
+#define MYSQLCB_COROUTINES 1
+#endif
+
+namespace mysqlcb {
+
+/**
+ * @brief An executed query whose rows are fetched one at a time by next().
+ *
+ * Unlike the PullPack of execute_query_pull(), which lives only as long
+ * as the callback that receives it, a Query_Cursor is an object that can
+ * be kept, so its Binder is laid out in heap memory that lasts as long as
+ * the cursor.  The query runs in the constructor, which throws like
+ * execute_query_pull() if it fails.
+ *
+ *~~~c++
+Query_Cursor cursor(mysql, "SELECT id, name FROM Person");
+while (cursor.next())
+   std::cout << cursor.binder().bind_data[1] << "\n";
+ *~~~
+ *
+ * A FETCH_STREAM cursor holds the connection until its last row is
+ * fetched or it is destroyed.  To read two cursors of one connection
+ * at the same time, open them with FETCH_BUFFERED or FETCH_CURSOR
+ * Pull_Options, or use a connection for each.
+ */
+class Query_Cursor
+{
+public:
+   Query_Cursor(MYSQL &mysql,
+                const char *query,
+                const Binder *params=nullptr,
+                const Pull_Options *options=nullptr);
+   ~Query_Cursor();
+   Query_Cursor(const Query_Cursor&) = delete;
+   Query_Cursor& operator=(const Query_Cursor&) = delete;
+
+   bool next(void);
+
+   /** Makes *row* (0-based) the next row fetched, only for FETCH_BUFFERED. */
+   bool seek(uint64_t row);
+
+   inline Binder &binder(void)                  { return m_binder; }
+   inline MYSQL_STMT &stmt(void)                { return *m_stmt; }
+   inline bool is_buffered(void) const          { return m_buffered; }
+   inline uint64_t row_count(void) const        { return m_row_count; }
+   inline unsigned long rows_fetched(void) const { return m_rows_fetched; }
+
+protected:
+   void release(void);
+
+   MYSQL_STMT    *m_stmt;
+   MYSQL_RES     *m_meta;
+   char          *m_memory;
+   Binder        m_binder;
+   bool          m_buffered;
+   bool          m_done;
+   uint64_t      m_row_count;
+   unsigned long m_rows_fetched;
+};
+
+#ifdef MYSQLCB_COROUTINES
+
+/**
+ * @brief A C++20 coroutine that yields the rows of a query.
+ *
+ * The Query_Cursor is a local variable of the coroutine, so it and its
+ * Binder stay alive in the coroutine frame while the coroutine is
+ * suspended between rows.  The generator can be used in a range-for
+ * loop, or stepped with next() to interleave it with other work:
+ *
+ *~~~c++
+Row_Generator left = query_rows(mysql, "SELECT id FROM A ORDER BY id", nullptr, &buffered);
+Row_Generator right = query_rows(mysql, "SELECT id FROM B ORDER BY id", nullptr, &buffered);
+bool l = left.next(), r = right.next();
+while (l && r)
+{
+   int32_t a = value_of<int32_t>(left.row().bind_data[0]);
+   int32_t b = value_of<int32_t>(right.row().bind_data[0]);
+   if (a==b)
+      std::cout << a << "\n";
+   if (a<=b) l = left.next();
+   if (b<=a) r = right.next();
+}
+ *~~~
+ *
+ * The query runs when the first row is requested, so the query text and
+ * parameters must last until then.  Errors are thrown from next() or
+ * the iterator increment that meets them.
+ */
+class Row_Generator
+{
+public:
+   struct promise_type
+   {
+      Binder             *current = nullptr;
+      std::exception_ptr error = nullptr;
+
+      Row_Generator get_return_object()
+      {
+         return Row_Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+      std::suspend_always initial_suspend() noexcept  { return {}; }
+      std::suspend_always final_suspend() noexcept    { return {}; }
+      std::suspend_always yield_value(Binder &b) noexcept
+      {
+         current = &b;
+         return {};
+      }
+      void return_void()                              { current = nullptr; }
+      void unhandled_exception()                      { error = std::current_exception(); }
+   };
+
+   using Handle = std::coroutine_handle<promise_type>;
+
+   class iterator
+   {
+   public:
+      explicit iterator(Row_Generator *gen) : m_gen(gen) { }
+      Binder &operator*() const                       { return m_gen->row(); }
+      iterator &operator++()
+      {
+         if (!m_gen->next())
+            m_gen = nullptr;
+         return *this;
+      }
+      bool operator==(const iterator &rhs) const      { return m_gen==rhs.m_gen; }
+      bool operator!=(const iterator &rhs) const      { return m_gen!=rhs.m_gen; }
+   protected:
+      Row_Generator *m_gen;
+   };
+
+   explicit Row_Generator(Handle h) : m_handle(h) { }
+   Row_Generator(Row_Generator &&rhs) noexcept : m_handle(rhs.m_handle) { rhs.m_handle = nullptr; }
+   Row_Generator &operator=(Row_Generator &&rhs) noexcept
+   {
+      if (this!=&rhs)
+      {
+         if (m_handle)
+            m_handle.destroy();
+         m_handle = rhs.m_handle;
+         rhs.m_handle = nullptr;
+      }
+      return *this;
+   }
+   ~Row_Generator()
+   {
+      if (m_handle)
+         m_handle.destroy();
+   }
+   Row_Generator(const Row_Generator&) = delete;
+   Row_Generator& operator=(const Row_Generator&) = delete;
+
+   /** Resumes the coroutine for the next row.  Returns false after the last row. */
+   bool next(void)
+   {
+      if (!m_handle || m_handle.done())
+         return false;
+
+      m_handle.resume();
+      if (m_handle.promise().error)
+         std::rethrow_exception(std::exchange(m_handle.promise().error, nullptr));
+      return !m_handle.done();
+   }
+
+   /** The current row, valid until the next call to next(). */
+   Binder &row(void) const { return *m_handle.promise().current; }
+
+   iterator begin()        { return iterator(next() ? this : nullptr); }
+   iterator end()          { return iterator(nullptr); }
+
+protected:
+   Handle m_handle;
+};
+
+/** Returns a Row_Generator for the rows of *query*.  See Query_Cursor for the arguments. */
+inline Row_Generator query_rows(MYSQL &mysql,
+                                const char *query,
+                                const Binder *params=nullptr,
+                                const Pull_Options *options=nullptr)
+{
+   Query_Cursor cursor(mysql, query, params, options);
+   while (cursor.next())
+      co_yield cursor.binder();
+}
+
+#endif  // MYSQLCB_COROUTINES
+
+}  // end of namespace mysqlcb
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef MYSQLCB_FANOUT_HPP_SOURCE
+#define MYSQLCB_FANOUT_HPP_SOURCE
+
+#include <mutex>
+#include "mysqlcb_pool.hpp"
+
+namespace mysqlcb {
+
+/**
+ * One query of a fan-out.  *params* is a list of values for the `?` of
+ * the query, ending with an empty MParam as for summon_binder(), or
+ * nullptr.  *cb* receives the rows of this query when the fan-out has
+ * no merged callback.
+ */
+struct Fanout_Query
+{
+   const char             *query;
+   const MParam           *params;
+   IBinder_Callback       *cb;
+};
+
+/** Callback receiving the rows of all queries, with the index of each row's query. */
+class IFanout_Callback
+{
+public:
+   virtual ~IFanout_Callback() {}
+   virtual void operator()(uint32_t index, Binder &binder) const = 0;
+};
+
+template <typename Func>
+class Fanout_User : public IFanout_Callback
+{
+protected:
+   const Func &m_f;
+public:
+   Fanout_User(const Func &f) : m_f(f)                              {}
+   virtual ~Fanout_User()                                           {}
+   virtual void operator()(uint32_t index, Binder &binder) const    { m_f(index, binder); }
+};
+
+/**
+ * @brief Runs independent queries at the same time over the connections of a pool.
+ *
+ * Each execute() starts up to *max_threads* worker threads, each of which
+ * leases a connection from the pool and runs queries from the list until
+ * none are left, so the call takes about as long as the slowest query
+ * rather than the sum of them.
+ *
+ * The rows of each query go either to the query's own callback, called
+ * only from the thread running that query, or to a merged callback,
+ * whose calls are serialized so it needs no locking of its own.
+ *
+ *~~~c++
+Fanout_Executor fan(pool, 8);
+Fanout_Query queries[] = { { "SELECT COUNT(*) FROM Orders", nullptr, nullptr },
+                           { "SELECT SUM(total) FROM Invoice", nullptr, nullptr } };
+auto f = [](uint32_t index, Binder &b) { ... };
+Fanout_User<decltype(f)> fu(f);
+fan.execute(queries, 2, fu);
+ *~~~
+ *
+ * For one query template with per-shard parameters, give each
+ * Fanout_Query the same query text and its own *params*.
+ *
+ * A failed query doesn't stop the others.  When all have finished,
+ * execute() rethrows the first error, and failures() counts them.
+ */
+class Fanout_Executor
+{
+public:
+   Fanout_Executor(Connection_Pool &pool, uint32_t max_threads=8);
+   Fanout_Executor(const Fanout_Executor&) = delete;
+   Fanout_Executor& operator=(const Fanout_Executor&) = delete;
+
+   void execute(const Fanout_Query *queries, uint32_t count);
+   void execute(const Fanout_Query *queries, uint32_t count, const IFanout_Callback &merged);
+
+   inline uint32_t max_threads(void) const     { return m_max_threads; }
+   inline unsigned long failures(void) const   { return m_failures; }
+
+protected:
+   void run(const Fanout_Query *queries, uint32_t count, const IFanout_Callback *merged);
+
+   Connection_Pool &m_pool;
+   uint32_t        m_max_threads;
+   unsigned long   m_failures;
+   std::mutex      m_merge_mutex;
+};
+
+}  // end of namespace mysqlcb
+
+#endif
@@ -0,0 +1,543 @@
+#ifndef MYSQLCB_FORMAT_HPP_SOURCE
+#define MYSQLCB_FORMAT_HPP_SOURCE
+
+#include <mysql.h>   // for MYSQL_TIME
+#include <stdint.h>  // for uint64_t
+#include <string.h>  // for memcpy(), memset()
+#include <cmath>     // for std::signbit(), std::isnan(), std::isinf()
+#include <limits>
+
+/**
+ * @file mysqlcb_format.hpp
+ * @brief Allocation-free conversion of numeric and date values to text.
+ *
+ * These functions write into a caller-supplied buffer, which must be at
+ * least max_integer_chars, max_float_chars or max_temporal_chars long,
+ * and return the number of characters written, without a terminating \0.
+ */
+
+namespace mysqlcb {
+
+   /** Longest text of a 64-bit integer: "-9223372036854775808" or "18446744073709551615". */
+   const size_t max_integer_chars = 20;
+   /** Longest text of a double, like "-2.2250738585072014e-308", with room to spare. */
+   const size_t max_float_chars = 32;
+   /** Longest text of a date or time, like "2024-01-31 23:59:59.999999", with room to spare. */
+   const size_t max_temporal_chars = 32;
+
+   const char digit_pairs[] =
+      "00010203040506070809"
+      "10111213141516171819"
+      "20212223242526272829"
+      "30313233343536373839"
+      "40414243444546474849"
+      "50515253545556575859"
+      "60616263646566676869"
+      "70717273747576777879"
+      "80818283848586878889"
+      "90919293949596979899";
+
+   const uint64_t powers_of_10[] = {
+      1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+      100000000ull, 1000000000ull, 10000000000ull, 100000000000ull,
+      1000000000000ull, 10000000000000ull, 100000000000000ull,
+      1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+      1000000000000000000ull, 10000000000000000000ull
+   };
+
+   /**
+    * Returns the number of decimal digits in *val*, counting 0 as one digit.
+    *
+    * The bit width times log10(2), approximated by 1233/4096, is the
+    * digit count or one less, which a single comparison settles.
+    */
+   inline unsigned count_digits(uint64_t val)
+   {
+      val |= 1;
+      unsigned guess = ((64 - __builtin_clzll(val)) * 1233) >> 12;
+      return guess + 1 - (val < powers_of_10[guess]);
+   }
+
+   inline size_t integer_length(uint64_t val) { return count_digits(val); }
+   inline size_t integer_length(int64_t val)
+   {
+      return val < 0
+         ? 1 + count_digits(0 - static_cast<uint64_t>(val))
+         : count_digits(static_cast<uint64_t>(val));
+   }
+
+   /** Writes the digits from the right, two at a time, from the digit_pairs table. */
+   inline size_t format_integer(uint64_t val, char *buff)
+   {
+      size_t len = count_digits(val);
+      char *ptr = buff + len;
+      while (val >= 100)
+      {
+         const char *pair = &digit_pairs[(val % 100) * 2];
+         val /= 100;
+         *--ptr = pair[1];
+         *--ptr = pair[0];
+      }
+      if (val >= 10)
+      {
+         const char *pair = &digit_pairs[val * 2];
+         *--ptr = pair[1];
+         *--ptr = pair[0];
+      }
+      else
+         *--ptr = static_cast<char>('0' + val);
+
+      return len;
+   }
+
+   inline size_t format_integer(int64_t val, char *buff)
+   {
+      if (val < 0)
+      {
+         *buff = '-';
+         return 1 + format_integer(0 - static_cast<uint64_t>(val), buff+1);
+      }
+      else
+         return format_integer(static_cast<uint64_t>(val), buff);
+   }
+
+   inline char *put_two_digits(char *ptr, unsigned val)
+   {
+      memcpy(ptr, &digit_pairs[(val % 100) * 2], 2);
+      return ptr + 2;
+   }
+
+   /** A value as f * 2^e, with a 64-bit significand, for format_float(). */
+   struct Diy_Fp
+   {
+      uint64_t f;
+      int      e;
+   };
+
+   /** The high 64 bits of the 128-bit product of the significands, rounded. */
+   inline Diy_Fp diy_multiply(const Diy_Fp &x, const Diy_Fp &y)
+   {
+      uint64_t x_lo = x.f & 0xFFFFFFFFu, x_hi = x.f >> 32;
+      uint64_t y_lo = y.f & 0xFFFFFFFFu, y_hi = y.f >> 32;
+
+      uint64_t lo_lo = x_lo * y_lo;
+      uint64_t lo_hi = x_lo * y_hi;
+      uint64_t hi_lo = x_hi * y_lo;
+      uint64_t hi_hi = x_hi * y_hi;
+
+      uint64_t middle = (lo_lo >> 32) + (lo_hi & 0xFFFFFFFFu) + (hi_lo & 0xFFFFFFFFu) + (1u << 31);
+      Diy_Fp product = { hi_hi + (lo_hi >> 32) + (hi_lo >> 32) + (middle >> 32), x.e + y.e + 64 };
+      return product;
+   }
+
+   inline Diy_Fp diy_normalize(Diy_Fp x)
+   {
+      int shift = __builtin_clzll(x.f);
+      x.f <<= shift;
+      x.e -= shift;
+      return x;
+   }
+
+   /** 10^k as a normalized Diy_Fp. */
+   struct Cached_Power
+   {
+      uint64_t f;
+      int      e;
+      int      k;
+   };
+
+   /** 10^k for every eighth k from -300 to 324, enough for any double. */
+   const Cached_Power cached_powers[] = {
+      { 0xAB70FE17C79AC6CAull, -1060, -300 },
+      { 0xFF77B1FCBEBCDC4Full, -1034, -292 },
+      { 0xBE5691EF416BD60Cull, -1007, -284 },
+      { 0x8DD01FAD907FFC3Cull,  -980, -276 },
+      { 0xD3515C2831559A83ull,  -954, -268 },
+      { 0x9D71AC8FADA6C9B5ull,  -927, -260 },
+      { 0xEA9C227723EE8BCBull,  -901, -252 },
+      { 0xAECC49914078536Dull,  -874, -244 },
+      { 0x823C12795DB6CE57ull,  -847, -236 },
+      { 0xC21094364DFB5637ull,  -821, -228 },
+      { 0x9096EA6F3848984Full,  -794, -220 },
+      { 0xD77485CB25823AC7ull,  -768, -212 },
+      { 0xA086CFCD97BF97F4ull,  -741, -204 },
+      { 0xEF340A98172AACE5ull,  -715, -196 },
+      { 0xB23867FB2A35B28Eull,  -688, -188 },
+      { 0x84C8D4DFD2C63F3Bull,  -661, -180 },
+      { 0xC5DD44271AD3CDBAull,  -635, -172 },
+      { 0x936B9FCEBB25C996ull,  -608, -164 },
+      { 0xDBAC6C247D62A584ull,  -582, -156 },
+      { 0xA3AB66580D5FDAF6ull,  -555, -148 },
+      { 0xF3E2F893DEC3F126ull,  -529, -140 },
+      { 0xB5B5ADA8AAFF80B8ull,  -502, -132 },
+      { 0x87625F056C7C4A8Bull,  -475, -124 },
+      { 0xC9BCFF6034C13053ull,  -449, -116 },
+      { 0x964E858C91BA2655ull,  -422, -108 },
+      { 0xDFF9772470297EBDull,  -396, -100 },
+      { 0xA6DFBD9FB8E5B88Full,  -369,  -92 },
+      { 0xF8A95FCF88747D94ull,  -343,  -84 },
+      { 0xB94470938FA89BCFull,  -316,  -76 },
+      { 0x8A08F0F8BF0F156Bull,  -289,  -68 },
+      { 0xCDB02555653131B6ull,  -263,  -60 },
+      { 0x993FE2C6D07B7FACull,  -236,  -52 },
+      { 0xE45C10C42A2B3B06ull,  -210,  -44 },
+      { 0xAA242499697392D3ull,  -183,  -36 },
+      { 0xFD87B5F28300CA0Eull,  -157,  -28 },
+      { 0xBCE5086492111AEBull,  -130,  -20 },
+      { 0x8CBCCC096F5088CCull,  -103,  -12 },
+      { 0xD1B71758E219652Cull,   -77,   -4 },
+      { 0x9C40000000000000ull,   -50,    4 },
+      { 0xE8D4A51000000000ull,   -24,   12 },
+      { 0xAD78EBC5AC620000ull,     3,   20 },
+      { 0x813F3978F8940984ull,    30,   28 },
+      { 0xC097CE7BC90715B3ull,    56,   36 },
+      { 0x8F7E32CE7BEA5C70ull,    83,   44 },
+      { 0xD5D238A4ABE98068ull,   109,   52 },
+      { 0x9F4F2726179A2245ull,   136,   60 },
+      { 0xED63A231D4C4FB27ull,   162,   68 },
+      { 0xB0DE65388CC8ADA8ull,   189,   76 },
+      { 0x83C7088E1AAB65DBull,   216,   84 },
+      { 0xC45D1DF942711D9Aull,   242,   92 },
+      { 0x924D692CA61BE758ull,   269,  100 },
+      { 0xDA01EE641A708DEAull,   295,  108 },
+      { 0xA26DA3999AEF774Aull,   322,  116 },
+      { 0xF209787BB47D6B85ull,   348,  124 },
+      { 0xB454E4A179DD1877ull,   375,  132 },
+      { 0x865B86925B9BC5C2ull,   402,  140 },
+      { 0xC83553C5C8965D3Dull,   428,  148 },
+      { 0x952AB45CFA97A0B3ull,   455,  156 },
+      { 0xDE469FBD99A05FE3ull,   481,  164 },
+      { 0xA59BC234DB398C25ull,   508,  172 },
+      { 0xF6C69A72A3989F5Cull,   534,  180 },
+      { 0xB7DCBF5354E9BECEull,   561,  188 },
+      { 0x88FCF317F22241E2ull,   588,  196 },
+      { 0xCC20CE9BD35C78A5ull,   614,  204 },
+      { 0x98165AF37B2153DFull,   641,  212 },
+      { 0xE2A0B5DC971F303Aull,   667,  220 },
+      { 0xA8D9D1535CE3B396ull,   694,  228 },
+      { 0xFB9B7CD9A4A7443Cull,   720,  236 },
+      { 0xBB764C4CA7A44410ull,   747,  244 },
+      { 0x8BAB8EEFB6409C1Aull,   774,  252 },
+      { 0xD01FEF10A657842Cull,   800,  260 },
+      { 0x9B10A4E5E9913129ull,   827,  268 },
+      { 0xE7109BFBA19C0C9Dull,   853,  276 },
+      { 0xAC2820D9623BF429ull,   880,  284 },
+      { 0x80444B5E7AA7CF85ull,   907,  292 },
+      { 0xBF21E44003ACDD2Dull,   933,  300 },
+      { 0x8E679C2F5E44FF8Full,   960,  308 },
+      { 0xD433179D9C8CB841ull,   986,  316 },
+      { 0x9E19DB92B4E31BA9ull,  1013,  324 }
+   };
+
+   /**
+    * Returns the cached power of ten that brings a Diy_Fp with binary
+    * exponent *e* to an exponent from -60 to -32, so that its integral
+    * part fits in 32 bits.  ceil((-61 - e) * log10(2)) picks the power,
+    * with log10(2) approximated by 78913 / 2^18.
+    */
+   inline const Cached_Power &cached_power_for(int e)
+   {
+      int f = -61 - e;
+      int k = (f * 78913) / (1 << 18) + (f > 0);
+      return cached_powers[(300 + k + 7) / 8];
+   }
+
+   /**
+    * Moves the last digit down while that stays inside the interval and
+    * comes closer to the scaled value, which is *dist* below its top.
+    */
+   inline void grisu_round(char *digits, int count, uint64_t dist, uint64_t delta,
+                           uint64_t rest, uint64_t ten_k)
+   {
+      while (rest < dist
+             && delta - rest >= ten_k
+             && (rest + ten_k < dist || dist - rest > rest + ten_k - dist))
+      {
+         --digits[count - 1];
+         rest += ten_k;
+      }
+   }
+
+   /**
+    * Writes the fewest digits of a number between *low* and *high*, with
+    * the scaled value *w* in between, and adds the decimal exponent of
+    * the last digit to *exponent*.  Returns the number of digits.
+    */
+   inline int grisu_digits(char *digits, int &exponent, Diy_Fp low, Diy_Fp w, Diy_Fp high)
+   {
+      uint64_t delta = high.f - low.f;
+      uint64_t dist = high.f - w.f;
+      int      shift = -high.e;
+      uint64_t one = 1ull << shift;
+      uint32_t integral = static_cast<uint32_t>(high.f >> shift);
+      uint64_t fraction = high.f & (one - 1);
+      int      count = 0;
+
+      for (int n = count_digits(integral); n > 0; )
+      {
+         uint32_t pow10 = static_cast<uint32_t>(powers_of_10[--n]);
+         digits[count++] = static_cast<char>('0' + integral / pow10);
+         integral %= pow10;
+
+         uint64_t rest = (static_cast<uint64_t>(integral) << shift) + fraction;
+         if (rest <= delta)
+         {
+            exponent += n;
+            grisu_round(digits, count, dist, delta, rest, static_cast<uint64_t>(pow10) << shift);
+            return count;
+         }
+      }
+
+      for (;;)
+      {
+         fraction *= 10;
+         delta *= 10;
+         dist *= 10;
+         digits[count++] = static_cast<char>('0' + (fraction >> shift));
+         fraction &= one - 1;
+         --exponent;
+         if (fraction <= delta)
+            break;
+      }
+
+      grisu_round(digits, count, dist, delta, fraction, one);
+      return count;
+   }
+
+   template <typename T> struct Float_Bits;
+   template <> struct Float_Bits<float>  { typedef uint32_t type; };
+   template <> struct Float_Bits<double> { typedef uint64_t type; };
+
+   /**
+    * Writes the digits of a positive, finite *val* with Grisu2, so that
+    * digits x 10^*exponent* reads back as *val*, and returns the number
+    * of digits.
+    *
+    * The interval of numbers that round to *val* is taken from the
+    * precision of T, so a float gets the digits a float needs, not
+    * those of the double it converts to.  Grisu2 finds the shortest
+    * digits for nearly every value and is one digit long for the rest;
+    * it never needs a round trip through strtod() to check.
+    */
+   template <typename T>
+   inline int float_digits(T val, char *digits, int &exponent)
+   {
+      typedef typename Float_Bits<T>::type Bits;
+      const int  precision = std::numeric_limits<T>::digits;
+      const int  bias = std::numeric_limits<T>::max_exponent - 1 + (precision - 1);
+      const Bits hidden_bit = static_cast<Bits>(1) << (precision - 1);
+
+      Bits bits;
+      memcpy(&bits, &val, sizeof(bits));
+      Bits biased_e = bits >> (precision - 1);
+      Bits mantissa = bits & (hidden_bit - 1);
+
+      Diy_Fp v = biased_e
+         ? Diy_Fp { mantissa + hidden_bit, static_cast<int>(biased_e) - bias }
+         : Diy_Fp { mantissa, 1 - bias };
+
+      // The boundaries halfway to the neighboring values, the lower one
+      // closer when *val* is a power of two:
+      Diy_Fp high = diy_normalize(Diy_Fp { 2 * v.f + 1, v.e - 1 });
+      Diy_Fp low = (mantissa==0 && biased_e > 1)
+         ? Diy_Fp { 4 * v.f - 1, v.e - 2 }
+         : Diy_Fp { 2 * v.f - 1, v.e - 1 };
+      low.f <<= low.e - high.e;
+      low.e = high.e;
+      v = diy_normalize(v);
+
+      const Cached_Power &power = cached_power_for(high.e);
+      Diy_Fp scale = { power.f, power.e };
+      Diy_Fp w = diy_multiply(v, scale);
+      Diy_Fp w_low = diy_multiply(low, scale);
+      Diy_Fp w_high = diy_multiply(high, scale);
+
+      // Shrink the interval by the possible error of the products:
+      ++w_low.f;
+      --w_high.f;
+
+      exponent = -power.k;
+      int count = grisu_digits(digits, exponent, w_low, w, w_high);
+      while (count > 1 && digits[count - 1]=='0')
+      {
+         --count;
+         ++exponent;
+      }
+      return count;
+   }
+
+   /**
+    * Lays out *count* digits times 10^*exponent* like printf("%g") with
+    * the precision just large enough for the digits, at least digits10:
+    * plain below 10^precision and down to 0.0001, exponential otherwise.
+    */
+   template <typename T>
+   inline size_t place_float_digits(const char *digits, int count, int exponent, char *buff)
+   {
+      int  point = count + exponent;      // digits before the decimal point
+      int  precision = std::numeric_limits<T>::digits10;
+      char *ptr = buff;
+
+      if (precision < count)
+         precision = count;
+
+      if (point < -3 || point > precision)
+      {
+         *ptr++ = digits[0];
+         if (count > 1)
+         {
+            *ptr++ = '.';
+            memcpy(ptr, digits + 1, count - 1);
+            ptr += count - 1;
+         }
+
+         int e10 = point - 1;
+         *ptr++ = 'e';
+         *ptr++ = e10 < 0 ? '-' : '+';
+         if (e10 < 0)
+            e10 = -e10;
+         if (e10 >= 100)
+         {
+            *ptr++ = static_cast<char>('0' + e10 / 100);
+            e10 %= 100;
+         }
+         ptr = put_two_digits(ptr, e10);
+      }
+      else if (point <= 0)
+      {
+         *ptr++ = '0';
+         *ptr++ = '.';
+         memset(ptr, '0', -point);
+         ptr += -point;
+         memcpy(ptr, digits, count);
+         ptr += count;
+      }
+      else if (point >= count)
+      {
+         memcpy(ptr, digits, count);
+         memset(ptr + count, '0', point - count);
+         ptr += point;
+      }
+      else
+      {
+         memcpy(ptr, digits, point);
+         ptr += point;
+         *ptr++ = '.';
+         memcpy(ptr, digits + point, count - point);
+         ptr += count - point;
+      }
+
+      return ptr - buff;
+   }
+
+   /**
+    * Writes the shortest text that reads back as exactly *val*, laid out
+    * as printf("%g") would, with the digits from float_digits().
+    */
+   template <typename T>
+   inline size_t format_float(T val, char *buff)
+   {
+      char *ptr = buff;
+      if (std::signbit(val))
+      {
+         *ptr++ = '-';
+         val = -val;
+      }
+
+      if (std::isnan(val) || std::isinf(val))
+      {
+         memcpy(ptr, std::isnan(val) ? "nan" : "inf", 3);
+         return ptr + 3 - buff;
+      }
+      if (val==0)
+      {
+         *ptr++ = '0';
+         return ptr - buff;
+      }
+
+      char digits[24];
+      int  exponent;
+      int  count = float_digits(val, digits, exponent);
+      return ptr - buff + place_float_digits<T>(digits, count, exponent, ptr);
+   }
+
+   /** Writes YYYY-MM-DD. */
+   inline char *put_date(char *ptr, const MYSQL_TIME &t)
+   {
+      ptr = put_two_digits(ptr, t.year / 100);
+      ptr = put_two_digits(ptr, t.year);
+      *ptr++ = '-';
+      ptr = put_two_digits(ptr, t.month);
+      *ptr++ = '-';
+      return put_two_digits(ptr, t.day);
+   }
+
+   /**
+    * Writes MM:SS and, if *decimals* is not 0, the fraction of the second
+    * to *decimals* places (at most 6) from the microseconds in second_part.
+    */
+   inline char *put_minutes_seconds(char *ptr, const MYSQL_TIME &t, unsigned decimals)
+   {
+      ptr = put_two_digits(ptr, t.minute);
+      *ptr++ = ':';
+      ptr = put_two_digits(ptr, t.second);
+      if (decimals)
+      {
+         if (decimals > 6)
+            decimals = 6;
+         unsigned long fraction = t.second_part / powers_of_10[6 - decimals];
+         *ptr++ = '.';
+         for (char *digit = ptr + decimals; digit > ptr; fraction /= 10)
+            *--digit = static_cast<char>('0' + fraction % 10);
+         ptr += decimals;
+      }
+      return ptr;
+   }
+
+   inline size_t format_date(const MYSQL_TIME &t, char *buff)
+   {
+      return put_date(buff, t) - buff;
+   }
+
+   /** Writes YYYY-MM-DD HH:MM:SS, with an optional fraction of a second. */
+   inline size_t format_datetime(const MYSQL_TIME &t, unsigned decimals, char *buff)
+   {
+      char *ptr = put_date(buff, t);
+      *ptr++ = ' ';
+      ptr = put_two_digits(ptr, t.hour);
+      *ptr++ = ':';
+      return put_minutes_seconds(ptr, t, decimals) - buff;
+   }
+
+   /**
+    * Writes a TIME value, which can be negative and can have more than
+    * two digits of hours, as in -838:59:59.
+    */
+   inline size_t format_time(const MYSQL_TIME &t, unsigned decimals, char *buff)
+   {
+      char *ptr = buff;
+      if (t.neg)
+         *ptr++ = '-';
+      if (t.hour < 100)
+         ptr = put_two_digits(ptr, t.hour);
+      else
+         ptr += format_integer(static_cast<uint64_t>(t.hour), ptr);
+      *ptr++ = ':';
+      return put_minutes_seconds(ptr, t, decimals) - buff;
+   }
+
+   /**
+    * Copies formatted text to a caller's buffer of *len* bytes, truncating
+    * if it doesn't fit and adding a \0 if there is room.
+    */
+   inline void copy_formatted(const char *text, size_t text_len, char *buff, size_t len)
+   {
+      size_t copylen = text_len < len ? text_len : len;
+      memcpy(buff, text, copylen);
+      if (copylen < len)
+         buff[copylen] = '\0';
+   }
+
+}  // end of namespace mysqlcb
+
+#endif
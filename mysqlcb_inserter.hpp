@@ -0,0 +1,107 @@
+#ifndef MYSQLCB_INSERTER_HPP_SOURCE
+#define MYSQLCB_INSERTER_HPP_SOURCE
+
+#include <chrono>
+#include <string>
+#include "mysqlcb.hpp"
+
+namespace mysqlcb {
+
+/**
+ * @brief When a Bulk_Inserter sends its accumulated rows.
+ *
+ * The rows are sent when the statement would exceed *max_bytes* (or the
+ * server's max_allowed_packet, if smaller), when *max_rows* rows are
+ * waiting, or when a row is added *max_delay_ms* milliseconds or more
+ * after the first waiting row.  A limit of 0 is ignored.
+ */
+struct Inserter_Settings
+{
+   size_t   max_bytes;
+   uint32_t max_rows;
+   unsigned max_delay_ms;
+};
+
+const Inserter_Settings default_inserter_settings = { 1024 * 1024, 1000, 1000 };
+
+/**
+ * @brief Collects rows for a table and writes them as multi-row INSERT statements.
+ *
+ * Each add() formats a row of MParam values, quoting and escaping
+ * strings with mysql_real_escape_string(), and appends it to a pending
+ * `INSERT INTO table (columns) VALUES (...),(...)` statement, which is
+ * sent when the Inserter_Settings limits are reached or when flush() is
+ * called.  An optional *on_duplicate* clause is appended to each
+ * statement after `ON DUPLICATE KEY UPDATE`.
+ *
+ *~~~c++
+Bulk_Inserter ins(mysql, "Event", "id, kind, note", "note=VALUES(note)");
+int id = 42;
+MParam row[] = { id, "login", MParam() };    // MParam() inserts NULL
+ins.add(row);
+ins.flush();
+ *~~~
+ *
+ * The time limit is checked when a row is added; call flush_if_due()
+ * from an idle loop to send a quiet table's rows on time.
+ *
+ * Like Stmt_Cache, the inserter holds heap memory for the statement text
+ * that outlives a single call.  The destructor sends any pending rows but
+ * cannot report errors, so call flush() before it goes out of scope.
+ */
+class Bulk_Inserter
+{
+public:
+   Bulk_Inserter(MYSQL &mysql,
+                 const char *table,
+                 const char *columns,
+                 const char *on_duplicate=nullptr,
+                 const Inserter_Settings &settings=default_inserter_settings);
+   ~Bulk_Inserter();
+   Bulk_Inserter(const Bulk_Inserter&) = delete;
+   Bulk_Inserter& operator=(const Bulk_Inserter&) = delete;
+
+   /** Adds a row of column_count() values, a default MParam for NULL. */
+   void add(const MParam *row);
+   void flush(void);
+   bool flush_if_due(void);
+
+   inline uint32_t column_count(void) const      { return m_column_count; }
+   inline uint32_t pending_rows(void) const      { return m_pending_rows; }
+   inline size_t   statement_limit(void) const   { return m_limit; }
+
+   inline unsigned long rows_written(void) const { return m_rows_written; }
+   inline unsigned long statements(void) const   { return m_statements; }
+   inline uint64_t affected_rows(void) const     { return m_affected_rows; }
+
+   /** Flush latencies, in microseconds. */
+   inline uint64_t last_flush_us(void) const     { return m_last_flush_us; }
+   inline uint64_t max_flush_us(void) const      { return m_max_flush_us; }
+   inline uint64_t total_flush_us(void) const    { return m_total_flush_us; }
+
+protected:
+   void append_value(const MParam &value);
+   bool is_due(std::chrono::steady_clock::time_point now) const;
+
+   MYSQL                                 &m_mysql;
+   Inserter_Settings                     m_settings;
+   uint32_t                              m_column_count;
+   size_t                                m_limit;
+   std::string                           m_prefix;
+   std::string                           m_suffix;
+   std::string                           m_sql;
+   std::string                           m_row;
+   uint32_t                              m_pending_rows;
+   std::chrono::steady_clock::time_point m_first_pending;
+
+   unsigned long                         m_rows_written;
+   unsigned long                         m_statements;
+   uint64_t                              m_affected_rows;
+   uint64_t                              m_last_flush_us;
+   uint64_t                              m_max_flush_us;
+   uint64_t                              m_total_flush_us;
+};
+
+}  // end of namespace mysqlcb
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef MYSQLCB_POOL_HPP_SOURCE
+#define MYSQLCB_POOL_HPP_SOURCE
+
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include "mysqlcb.hpp"
+
+namespace mysqlcb {
+
+/**
+ * @brief Sizing and timing rules for a Connection_Pool.
+ *
+ * Times are in seconds.
+ */
+struct Pool_Settings
+{
+   uint32_t min_size;      ///< Connections opened up front and never closed for idleness.
+   uint32_t max_size;      ///< Most connections open at once.  Leases wait when all are in use.
+   unsigned idle_timeout;  ///< Idle time after which a connection above min_size is closed.
+   unsigned ping_after;    ///< Idle time after which a leased connection is pinged first.
+};
+
+const Pool_Settings default_pool_settings = { 1, 8, 60, 5 };
+
+/**
+ * @brief Copies of the connect_mysql() arguments, for connections
+ * opened after the caller's strings may be gone.
+ */
+class Connection_Args
+{
+public:
+   Connection_Args(const char *host,
+                   const char *user,
+                   const char *pass,
+                   const char *dbase,
+                   const Connection_Options *options);
+   Connection_Args(const Connection_Args&) = delete;
+   Connection_Args& operator=(const Connection_Args&) = delete;
+
+   void connect(MYSQL &mysql) const;
+
+protected:
+   std::string             m_host;
+   std::string             m_user;
+   std::string             m_pass;
+   std::string             m_dbase;
+   bool                    m_has_host;
+   bool                    m_has_user;
+   bool                    m_has_pass;
+   bool                    m_has_dbase;
+   Connection_Options      m_options;
+   std::string             m_socket;
+};
+
+/**
+ * @brief Keeps open connections for reuse by short-lived requests.
+ *
+ * A connection is leased to a callback with the same shape as the
+ * start_mysql() callback, and returned to the pool when the callback
+ * returns or throws.  Returned connections are cleared of session state
+ * with mysql_reset_connection(), and a connection that has been idle for
+ * longer than Pool_Settings::ping_after is pinged, and reconnected if
+ * necessary, before it is leased again.
+ *
+ * Connections are opened lazily up to max_size, which also caps the
+ * number of connections a burst of requests can open.  Every connection
+ * is opened with the same Connection_Options, copied by the constructor.
+ *
+ *~~~c++
+Connection_Pool pool(default_pool_settings, host, user, pass, dbase);
+
+auto f = [](MYSQL &mysql)
+{
+   execute_query(mysql, cb, query);
+};
+start_mysql(pool, f);
+ *~~~
+ *
+ * The pool is safe to share between threads.  Its constructor calls
+ * mysql_library_init(), so leases on new threads can connect at once.
+ */
+class Connection_Pool
+{
+public:
+   struct Slot;
+
+   Connection_Pool(const Pool_Settings &settings = default_pool_settings,
+                   const char *host=nullptr,
+                   const char *user=nullptr,
+                   const char *pass=nullptr,
+                   const char *dbase=nullptr,
+                   const Connection_Options *options=nullptr);
+   ~Connection_Pool();
+   Connection_Pool(const Connection_Pool&) = delete;
+   Connection_Pool& operator=(const Connection_Pool&) = delete;
+
+   void lease(IMySQL_Callback &cb);
+
+   uint32_t open_count(void) const;
+   inline const Pool_Settings &settings(void) const { return m_settings; }
+   inline unsigned long leases(void) const          { return m_leases; }
+   inline unsigned long connects(void) const        { return m_connects; }
+   inline unsigned long waits(void) const           { return m_waits; }
+
+protected:
+   Slot &acquire(void);
+   void release(Slot &slot);
+   void connect(Slot &slot);
+   void close_idle(std::chrono::steady_clock::time_point now);
+
+   Pool_Settings           m_settings;
+   Connection_Args         m_args;
+
+   Slot                    *m_slots;
+   uint32_t                m_open;
+   std::atomic<unsigned long> m_leases;
+   std::atomic<unsigned long> m_connects;
+   std::atomic<unsigned long> m_waits;
+
+   mutable std::mutex      m_mutex;
+   std::condition_variable m_returned;
+};
+
+inline void t_start_mysql(Connection_Pool &pool, IMySQL_Callback &cb)
+{
+   pool.lease(cb);
+}
+
+template <typename Func>
+void start_mysql(Connection_Pool &pool, Func &cb)
+{
+   MySQL_User<Func> cu(cb);
+   pool.lease(cu);
+}
+
+/**
+ * @brief An IQuery_Canceller that sends `KILL QUERY` through a side
+ * connection of its own.
+ *
+ * The side connection is opened at the first cancel and kept for the
+ * next ones, which take turns on it.  It is never leased from a
+ * Connection_Pool: a query that stops while holding the pool's last
+ * connection would wait forever for a lease to cancel itself.
+ *
+ * The canceller must connect to the server of the query being stopped,
+ * as a user who owns the query's connection or who has the
+ * CONNECTION_ADMIN (or SUPER) privilege.  A query that has already
+ * ended is not an error.
+ *
+ * KILL QUERY only stops the server sending more rows.  Rows already on
+ * their way are still read and dropped by mysql_stmt_reset() or
+ * mysql_free_result() on the query's connection, as for ROW_SKIP_REST.
+ *
+ *~~~c++
+Kill_Query_Canceller killer(host, user, pass);
+execute_query_until(mysql, ru, "SELECT * FROM Huge", nullptr, &killer);
+ *~~~
+ */
+class Kill_Query_Canceller : public IQuery_Canceller
+{
+public:
+   Kill_Query_Canceller(const char *host=nullptr,
+                        const char *user=nullptr,
+                        const char *pass=nullptr,
+                        const char *dbase=nullptr,
+                        const Connection_Options *options=nullptr);
+   virtual ~Kill_Query_Canceller();
+   Kill_Query_Canceller(const Kill_Query_Canceller&) = delete;
+   Kill_Query_Canceller& operator=(const Kill_Query_Canceller&) = delete;
+
+   virtual void operator()(unsigned long thread_id) const;
+
+protected:
+   Connection_Args         m_args;
+   mutable MYSQL           m_mysql;
+   mutable bool            m_open;
+   mutable std::mutex      m_mutex;
+};
+
+template <typename Func>
+void get_querier_pack(Connection_Pool &pool, Func &cb)
+{
+   Querier_User<Func> qu(cb);
+   auto f = [&qu](MYSQL &mysql)
+   {
+      run_querier_pack(qu, mysql);
+   };
+   start_mysql(pool, f);
+}
+
+}  // end of namespace declaration
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef MYSQLCB_REPLAY_HPP_SOURCE
+#define MYSQLCB_REPLAY_HPP_SOURCE
+
+#include <stdint.h>  // for uint64_t
+#include <string>
+
+namespace mysqlcb {
+
+/**
+ * @brief Controls replay.cpp, a stand-in for the client library that
+ * serves result sets from memory.
+ *
+ * Linked in place of libmysqlclient, as the bench target does, or
+ * loaded with LD_PRELOAD in front of it, the stand-in answers every
+ * query without a server: each SELECT (or SHOW, WITH, DESCRIBE,
+ * EXPLAIN) returns the configured columns, by the text protocol or as a
+ * prepared statement, and any other statement succeeds with one
+ * affected row.  That isolates the cost of this library from the cost
+ * of the server and the network.  Like a real connection, one refuses
+ * other commands as out of sync while a prepared statement has
+ * streamed rows still unread or a multi-statement query has results
+ * still to come.
+ *
+ * A column spec is a comma-separated list of `name:type[:length][:u][:null]`
+ * where *type* is one of tinyint, smallint, int, bigint, float, double,
+ * decimal, date, time, datetime, timestamp, char, varchar, text or blob,
+ * `u` makes an integer unsigned, and `null` makes every tenth value NULL:
+ *
+ *~~~c++
+replay_columns("id:int:11:u,name:varchar:40,price:double,made:datetime");
+replay_rows(1000000);
+ *~~~
+ *
+ * Synthetic values vary in length, like real data, from a cycle of
+ * rows made when the columns are set.  A recorded result replaces the
+ * cycle with rows read from a file (see replay_load()).  Without calls
+ * to these functions, the stand-in reads its settings from the
+ * environment variables MYSQLCB_REPLAY_COLUMNS, MYSQLCB_REPLAY_ROWS,
+ * MYSQLCB_REPLAY_WIDTH and MYSQLCB_REPLAY_FILE, which is how an
+ * LD_PRELOADed stand-in is set up.
+ *
+ * Change the settings only while no query is running.
+ */
+void replay_columns(const char *spec);
+void replay_rows(uint64_t rows);
+void replay_width(unsigned long width);
+void replay_load(const char *path);
+
+uint64_t replay_row_count(void);
+
+/** Returns the number of prepared statement executes, to tell row-by-row from array sends. */
+uint64_t replay_execute_count(void);
+
+/** Returns the number of mysql_reset_connection() calls, to see pooled connections cleared. */
+uint64_t replay_reset_count(void);
+
+/** Returns the number of NULL parameter values sent with prepared statement executes. */
+uint64_t replay_null_param_count(void);
+
+/** Returns the text of the last query sent by mysql_real_query(), to see generated SQL. */
+std::string replay_last_query(void);
+
+/**
+ * Returns the options and arguments of the last mysql_real_connect(),
+ * but not the password, as space-separated settings like
+ * `compress read_timeout=5 port=3307 multi_statements`.
+ */
+std::string replay_last_connect(void);
+
+}  // end of namespace mysqlcb
+
+#endif
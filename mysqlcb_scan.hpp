@@ -0,0 +1,61 @@
+#ifndef MYSQLCB_SCAN_HPP_SOURCE
+#define MYSQLCB_SCAN_HPP_SOURCE
+
+#include "mysqlcb_pool.hpp"
+
+namespace mysqlcb {
+
+/**
+ * @brief How scan_table() divides and runs a table scan.
+ *
+ * The key span is split into *shards* ranges, of which up to *threads*
+ * are scanned at once, each on its own pooled connection.  With
+ * *ordered* set, rows are delivered in key order.
+ */
+struct Scan_Settings
+{
+   uint32_t shards;
+   uint32_t threads;
+   bool     ordered;
+};
+
+const Scan_Settings default_scan_settings = { 16, 4, false };
+
+/** An inclusive range of key values. */
+struct Key_Range
+{
+   int64_t low;
+   int64_t high;
+};
+
+uint32_t get_key_ranges(MYSQL &mysql,
+                        Key_Range *ranges,
+                        uint32_t max_ranges,
+                        const char *table,
+                        const char *key,
+                        const char *where=nullptr);
+
+void t_scan_table(Connection_Pool &pool,
+                  IBinder_Callback &cb,
+                  const char *table,
+                  const char *key,
+                  const char *columns=nullptr,
+                  const char *where=nullptr,
+                  const Scan_Settings &settings=default_scan_settings);
+
+template <typename Func>
+inline void scan_table(Connection_Pool &pool,
+                       const Func &f,
+                       const char *table,
+                       const char *key,
+                       const char *columns=nullptr,
+                       const char *where=nullptr,
+                       const Scan_Settings &settings=default_scan_settings)
+{
+   Binder_User<Func> bu(f);
+   t_scan_table(pool, bu, table, key, columns, where, settings);
+}
+
+}  // end of namespace mysqlcb
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef MYSQLCB_STATS_HPP_SOURCE
+#define MYSQLCB_STATS_HPP_SOURCE
+
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include "mysqlcb.hpp"
+
+namespace mysqlcb {
+
+std::string normalize_query(const char *query);
+
+/**
+ * @brief Counts values in log-linear buckets, like an HDR histogram.
+ *
+ * Each power of two is divided into 16 buckets, so any recorded value
+ * is reported within 1/16 (about 6%) of its true value, from 1 ns up
+ * to the full range of uint64_t, in a fixed 8 KB of counters.
+ */
+class Latency_Histogram
+{
+public:
+   enum
+   {
+      SUB_BITS = 4,
+      SUB_COUNT = 1 << SUB_BITS,
+      BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_COUNT
+   };
+
+   Latency_Histogram();
+
+   void record(uint64_t value);
+   void merge(const Latency_Histogram &rhs);
+   uint64_t value_at_percentile(double percentile) const;
+
+   inline uint64_t count(void) const    { return m_count; }
+   inline uint64_t min(void) const      { return m_count ? m_min : 0; }
+   inline uint64_t max(void) const      { return m_max; }
+   inline double mean(void) const       { return m_count ? m_sum / m_count : 0.0; }
+
+   static uint32_t bucket_of(uint64_t value);
+   static uint64_t highest_in_bucket(uint32_t bucket);
+
+protected:
+   uint64_t m_buckets[BUCKET_COUNT];
+   uint64_t m_count;
+   uint64_t m_min;
+   uint64_t m_max;
+   double   m_sum;
+};
+
+/**
+ * @brief An IQuery_Observer that keeps a latency histogram and totals
+ * for each normalized query.
+ *
+ * Queries are grouped by normalize_query(), so the same statement with
+ * different literal values is counted together.  Once *max_queries*
+ * groups exist, further queries are counted under "(other)", which keeps
+ * an application that builds many distinct queries from growing the
+ * map without bound.
+ *
+ *~~~c++
+Query_Stats_Aggregator stats;
+set_query_observer(&stats);
+...
+set_query_observer(nullptr);
+stats.report(std::cerr);
+ *~~~
+ */
+class Query_Stats_Aggregator : public IQuery_Observer
+{
+public:
+   struct Entry
+   {
+      Latency_Histogram latency;                 ///< Total nanoseconds of each call
+      uint64_t          phase_ns[PHASE_COUNT];   ///< Nanoseconds in each phase, summed
+      unsigned long     calls;
+      unsigned long     errors;
+      uint64_t          rows;
+      uint64_t          bytes;
+      uint64_t          truncations;
+      std::string       last_error;
+
+      Entry() : latency(), phase_ns(), calls(0), errors(0),
+                rows(0), bytes(0), truncations(0), last_error() { }
+   };
+
+   Query_Stats_Aggregator(size_t max_queries=1000);
+   virtual ~Query_Stats_Aggregator() {}
+   Query_Stats_Aggregator(const Query_Stats_Aggregator&) = delete;
+   Query_Stats_Aggregator& operator=(const Query_Stats_Aggregator&) = delete;
+
+   virtual void operator()(const Query_Stats &stats) const;
+
+   void report(std::ostream &os) const;
+   void clear(void);
+
+   /** Calls *f* with the normalized text and Entry of each query, holding the lock. */
+   template <typename Func>
+   void for_each(const Func &f) const
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (const auto &pair : m_entries)
+         f(pair.first, pair.second);
+   }
+
+protected:
+   size_t                               m_max_queries;
+   mutable std::mutex                   m_mutex;
+   mutable std::map<std::string, Entry> m_entries;
+};
+
+}  // end of namespace mysqlcb
+
+#endif
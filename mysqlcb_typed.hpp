@@ -0,0 +1,470 @@
+#ifndef MYSQLCB_TYPED_HPP_SOURCE
+#define MYSQLCB_TYPED_HPP_SOURCE
+
+#include <string.h>  // for memset()
+#include <tuple>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include "mysqlcb.hpp"
+
+/**
+ * @file mysqlcb_typed.hpp
+ * @brief Reading result rows directly into typed variables.
+ *
+ * execute_query_as() and execute_query_into() bind the result columns
+ * straight to the members of a std::tuple or a struct, so each fetch
+ * writes the values where the callback reads them, without the field
+ * buffers of a Binder or the virtual BDType functions.
+ *
+ *~~~c++
+auto f = [](int32_t id, const Fixed_String<64> &name, const Nullable<MYSQL_TIME> &born)
+{
+   std::cout << id << ": " << name.str() << '\n';
+};
+execute_query_as<int32_t, Fixed_String<64>, Nullable<MYSQL_TIME>>(mysql, f, "SELECT id, name, born FROM Person");
+
+struct Person { int32_t id; Fixed_String<64> name; };
+MYSQLCB_STRUCT_FIELDS(Person, s.id, s.name)
+
+auto g = [](const Person &p) { std::cout << p.id << '\n'; };
+execute_query_into<Person>(mysql, g, "SELECT id, name FROM Person");
+ *~~~
+ *
+ * The column count and the column types are checked against the result
+ * metadata before the first fetch, and a mismatch throws a
+ * std::runtime_error naming the column.
+ */
+
+namespace mysqlcb {
+
+/**
+ * A string column read into a fixed buffer.  *length* is the full length
+ * of the value, which may exceed N if the value was truncated.
+ */
+   template <size_t N>
+   struct Fixed_String
+   {
+      char          data[N];
+      unsigned long length;
+
+      inline size_t size(void) const         { return length < N ? length : N; }
+      inline bool is_truncated(void) const   { return length > N; }
+      inline std::string str(void) const     { return std::string(data, size()); }
+   };
+
+/** A value that can be NULL, for columns that allow NULL. */
+   template <typename T>
+   struct Nullable
+   {
+      T       value;
+      my_bool is_null;
+   };
+
+/**
+ * How a C++ type is bound to a result column.  The specializations below
+ * cover integers, float, double, MYSQL_TIME, Fixed_String and Nullable.
+ *
+ * - bind() points a MYSQL_BIND at a value.
+ * - accepts() checks, against the result metadata, that the column can
+ *   be read into the type without losing values.
+ * - clear() sets a value for a NULL column.  Only Nullable reports NULL;
+ *   other types are set to their default value.
+ * - *truncation_ok* is true for types that report truncation themselves.
+ */
+   template <typename T, typename Enable=void>
+   struct Column_Traits;
+
+   /** Size of a fetched integer column, or 0 if the column is not an integer. */
+   inline unsigned integer_column_size(enum_field_types type)
+   {
+      switch(type)
+      {
+         case MYSQL_TYPE_TINY:     return 1;
+         case MYSQL_TYPE_SHORT:
+         case MYSQL_TYPE_YEAR:     return 2;
+         case MYSQL_TYPE_INT24:
+         case MYSQL_TYPE_LONG:     return 4;
+         case MYSQL_TYPE_LONGLONG: return 8;
+         default:                  return 0;
+      }
+   }
+
+   template <typename T>
+   struct Column_Traits<T, typename std::enable_if<std::is_integral<T>::value
+                                                   && !std::is_same<T,bool>::value>::type>
+   {
+      static const bool truncation_ok = false;
+
+      static inline void bind(MYSQL_BIND &bind, T &value)
+      {
+         bind.buffer_type = sizeof(T)==1 ? MYSQL_TYPE_TINY
+            : sizeof(T)==2 ? MYSQL_TYPE_SHORT
+            : sizeof(T)==4 ? MYSQL_TYPE_LONG
+            : MYSQL_TYPE_LONGLONG;
+         bind.buffer = &value;
+         bind.buffer_length = sizeof(T);
+         bind.is_unsigned = std::is_unsigned<T>::value;
+      }
+
+      /** Signed columns need a signed type, and unsigned columns a wider signed type. */
+      static inline bool accepts(const MYSQL_FIELD &fld)
+      {
+         unsigned size = integer_column_size(fld.type);
+         bool col_unsigned = (fld.flags & UNSIGNED_FLAG)!=0;
+         if (size==0)
+            return false;
+         else if (std::is_unsigned<T>::value)
+            return col_unsigned && sizeof(T) >= size;
+         else
+            return sizeof(T) > size || (sizeof(T)==size && !col_unsigned);
+      }
+
+      static inline void clear(T &value) { value = 0; }
+   };
+
+   template <typename T>
+   struct Column_Traits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+   {
+      static const bool truncation_ok = false;
+
+      static inline void bind(MYSQL_BIND &bind, T &value)
+      {
+         bind.buffer_type = sizeof(T)==sizeof(float) ? MYSQL_TYPE_FLOAT : MYSQL_TYPE_DOUBLE;
+         bind.buffer = &value;
+         bind.buffer_length = sizeof(T);
+      }
+
+      /**
+       * A float only holds FLOAT columns exactly.  A double also holds
+       * DOUBLE and integers of up to 32 bits.  BIGINT and DECIMAL values
+       * can have more digits than a double keeps, so read them as
+       * int64_t or Fixed_String.
+       */
+      static inline bool accepts(const MYSQL_FIELD &fld)
+      {
+         switch(fld.type)
+         {
+            case MYSQL_TYPE_FLOAT:
+               return true;
+            case MYSQL_TYPE_DOUBLE:
+               return sizeof(T) > sizeof(float);
+            default:
+            {
+               unsigned size = integer_column_size(fld.type);
+               return sizeof(T) > sizeof(float) && size!=0 && size <= 4;
+            }
+         }
+      }
+
+      static inline void clear(T &value) { value = 0; }
+   };
+
+   template <>
+   struct Column_Traits<MYSQL_TIME>
+   {
+      static const bool truncation_ok = false;
+
+      static inline void bind(MYSQL_BIND &bind, MYSQL_TIME &value)
+      {
+         bind.buffer_type = MYSQL_TYPE_DATETIME;
+         bind.buffer = &value;
+         bind.buffer_length = sizeof(MYSQL_TIME);
+      }
+
+      static inline bool accepts(const MYSQL_FIELD &fld)
+      {
+         switch(fld.type)
+         {
+            case MYSQL_TYPE_DATE:
+            case MYSQL_TYPE_TIME:
+            case MYSQL_TYPE_DATETIME:
+            case MYSQL_TYPE_TIMESTAMP:
+               return true;
+            default:
+               return false;
+         }
+      }
+
+      static inline void clear(MYSQL_TIME &value) { memset(&value, 0, sizeof(MYSQL_TIME)); }
+   };
+
+   /** Any column can be read as text. */
+   template <size_t N>
+   struct Column_Traits<Fixed_String<N>>
+   {
+      static const bool truncation_ok = true;
+
+      static inline void bind(MYSQL_BIND &bind, Fixed_String<N> &value)
+      {
+         bind.buffer_type = MYSQL_TYPE_STRING;
+         bind.buffer = value.data;
+         bind.buffer_length = N;
+         bind.length = &value.length;
+      }
+
+      static inline bool accepts(const MYSQL_FIELD &fld) { return true; }
+      static inline void clear(Fixed_String<N> &value)   { value.length = 0; }
+   };
+
+   template <typename T>
+   struct Column_Traits<Nullable<T>>
+   {
+      static const bool truncation_ok = Column_Traits<T>::truncation_ok;
+
+      static inline void bind(MYSQL_BIND &bind, Nullable<T> &value)
+      {
+         Column_Traits<T>::bind(bind, value.value);
+         bind.is_null = &value.is_null;
+      }
+
+      static inline bool accepts(const MYSQL_FIELD &fld) { return Column_Traits<T>::accepts(fld); }
+      static inline void clear(Nullable<T> &value)       { Column_Traits<T>::clear(value.value); }
+   };
+
+/**
+ * Compile-time lists of tuple indexes, standing in for C++14's
+ * std::index_sequence.
+ */
+   template <size_t... I>
+   struct Index_List { };
+
+   template <size_t N, size_t... I>
+   struct Make_Index_List : Make_Index_List<N-1, N-1, I...> { };
+
+   template <size_t... I>
+   struct Make_Index_List<0, I...> : Index_List<I...> { };
+
+   inline void throw_column_error(const char *msg, uint32_t index, const char *name)
+   {
+      char num[max_integer_chars];
+      std::string err(msg);
+      err += " (column ";
+      err.append(num, format_integer(static_cast<uint64_t>(index), num));
+      if (name)
+      {
+         err += ", \"";
+         err += name;
+         err += "\"";
+      }
+      err += ")";
+      throw std::runtime_error(err);
+   }
+
+   /** Returns 0 so it can be expanded in an array initializer. */
+   template <typename T>
+   inline int check_column(const MYSQL_FIELD *fields, uint32_t index)
+   {
+      if (!Column_Traits<T>::accepts(fields[index]))
+         throw_column_error("Column type cannot be read into the requested type",
+                            index,
+                            fields[index].name);
+      return 0;
+   }
+
+   template <typename T>
+   inline int bind_column(MYSQL_BIND &bind, my_bool &is_null, my_bool &is_error, T &value)
+   {
+      Column_Traits<T>::bind(bind, value);
+      if (!bind.is_null)
+         bind.is_null = &is_null;
+      bind.error = &is_error;
+      return 0;
+   }
+
+   /** Clears a NULL value and rejects a truncated value after a fetch. */
+   template <typename T>
+   inline int settle_column(T &value, const MYSQL_BIND &bind, uint32_t index)
+   {
+      if (*bind.is_null)
+         Column_Traits<T>::clear(value);
+      else if (*bind.error && !Column_Traits<T>::truncation_ok)
+         throw_column_error("Value does not fit the requested type", index, nullptr);
+      return 0;
+   }
+
+   /** Confirms the result columns match the requested types. */
+   template <typename... Ts, size_t... I>
+   void check_columns(MYSQL_STMT *stmt, Index_List<I...>)
+   {
+      MYSQL_RES *meta = mysql_stmt_result_metadata(stmt);
+      if (!meta)
+         throw std::runtime_error("Query does not return a result.");
+
+      try
+      {
+         if (mysql_num_fields(meta)!=sizeof...(Ts))
+            throw std::runtime_error("Result column count does not match the requested types.");
+
+         const MYSQL_FIELD *fields = mysql_fetch_fields(meta);
+         int checks[] = { check_column<Ts>(fields, I)... };
+         (void)checks;
+      }
+      catch(...)
+      {
+         mysql_free_result(meta);
+         throw;
+      }
+
+      mysql_free_result(meta);
+   }
+
+/**
+ * Binds the result columns of an executed statement to the referenced
+ * values and calls *on_row* after each fetch.
+ */
+   template <typename Func, typename... Ts, size_t... I>
+   void fetch_typed_rows(MYSQL_STMT *stmt,
+                         std::tuple<Ts&...> refs,
+                         Index_List<I...> indexes,
+                         const Func &on_row)
+   {
+      static_assert(sizeof...(Ts) > 0, "A typed query needs at least one column.");
+
+      check_columns<Ts...>(stmt, indexes);
+
+      const size_t count = sizeof...(Ts);
+      MYSQL_BIND binds[count];
+      my_bool    nulls[count];
+      my_bool    errors[count];
+      memset(binds, 0, sizeof(binds));
+
+      int bound[] = { bind_column(binds[I], nulls[I], errors[I], std::get<I>(refs))... };
+      (void)bound;
+
+      if (mysql_stmt_bind_result(stmt, binds))
+         throw_stmt_error("Failed to bind results", stmt);
+
+      int result;
+      while ((result=mysql_stmt_fetch(stmt))!=MYSQL_NO_DATA)
+      {
+         if (result!=0 && result!=MYSQL_DATA_TRUNCATED)
+            throw_stmt_error("Failed to fetch row", stmt);
+
+         int settled[] = { settle_column(std::get<I>(refs), binds[I], I)... };
+         (void)settled;
+
+         on_row();
+      }
+   }
+
+   template <typename Func, typename... Ts>
+   inline void fetch_typed_rows(MYSQL_STMT *stmt, std::tuple<Ts&...> refs, const Func &on_row)
+   {
+      fetch_typed_rows(stmt, refs, Make_Index_List<sizeof...(Ts)>(), on_row);
+   }
+
+   template <typename... Ts, size_t... I>
+   inline std::tuple<Ts&...> tie_tuple(std::tuple<Ts...> &row, Index_List<I...>)
+   {
+      return std::tie(std::get<I>(row)...);
+   }
+
+   template <typename Func, typename... Ts, size_t... I>
+   inline void call_with_tuple(const Func &f, const std::tuple<Ts...> &row, Index_List<I...>)
+   {
+      f(std::get<I>(row)...);
+   }
+
+/**
+ * Executes the query and calls *f* with the values of each row, read as
+ * the types Ts, which must match the result columns in number and kind.
+ *
+ * @param mysql  Handle to an open MySQL connection
+ * @param f      Callback function taking one argument of each type in Ts
+ * @param query  Text of the query
+ * @param params Parameters for the query, or nullptr
+ */
+   template <typename... Ts, typename Func>
+   void execute_query_as(MYSQL &mysql,
+                         const Func &f,
+                         const char *query,
+                         const Binder *params=nullptr)
+   {
+      std::tuple<Ts...> row;
+
+      auto fstmt = [&f, &row](MYSQL_STMT &stmt)
+      {
+         Make_Index_List<sizeof...(Ts)> indexes;
+         auto on_row = [&f, &row, &indexes]() { call_with_tuple(f, row, indexes); };
+         fetch_typed_rows(&stmt, tie_tuple(row, indexes), indexes, on_row);
+      };
+      Stmt_User<decltype(fstmt)> su(fstmt);
+
+      t_execute_statement(mysql, su, query, params);
+   }
+
+   template <typename... Ts, typename Func>
+   void execute_query_as(MYSQL &mysql,
+                         const Func &f,
+                         const char *query,
+                         const MParam *params)
+   {
+      auto fparams = [&mysql, &f, &query](Binder &b)
+      {
+         execute_query_as<Ts...>(mysql, f, query, &b);
+      };
+      Binder_User<decltype(fparams)> bu(fparams);
+
+      summon_binder(bu, params);
+   }
+
+/**
+ * Names the members of a struct, in result column order, for
+ * execute_query_into().  Refer to the struct as *s*:
+ *
+ *~~~c++
+MYSQLCB_STRUCT_FIELDS(Person, s.id, s.name, s.born)
+ *~~~
+ *
+ * Use the macro at namespace scope in the namespace of the struct.
+ */
+#define MYSQLCB_STRUCT_FIELDS(Type, ...) \
+   inline auto mysqlcb_fields(Type &s) -> decltype(std::tie(__VA_ARGS__)) \
+   { return std::tie(__VA_ARGS__); }
+
+/**
+ * Executes the query and calls *f* with a struct of type T holding the
+ * values of each row.  The members are named with MYSQLCB_STRUCT_FIELDS.
+ *
+ * @param mysql  Handle to an open MySQL connection
+ * @param f      Callback function of type `void funcname(const T &row)`
+ * @param query  Text of the query
+ * @param params Parameters for the query, or nullptr
+ */
+   template <typename T, typename Func>
+   void execute_query_into(MYSQL &mysql,
+                           const Func &f,
+                           const char *query,
+                           const Binder *params=nullptr)
+   {
+      T row = T();
+
+      auto fstmt = [&f, &row](MYSQL_STMT &stmt)
+      {
+         auto on_row = [&f, &row]() { f(static_cast<const T&>(row)); };
+         fetch_typed_rows(&stmt, mysqlcb_fields(row), on_row);
+      };
+      Stmt_User<decltype(fstmt)> su(fstmt);
+
+      t_execute_statement(mysql, su, query, params);
+   }
+
+   template <typename T, typename Func>
+   void execute_query_into(MYSQL &mysql,
+                           const Func &f,
+                           const char *query,
+                           const MParam *params)
+   {
+      auto fparams = [&mysql, &f, &query](Binder &b)
+      {
+         execute_query_into<T>(mysql, f, query, &b);
+      };
+      Binder_User<decltype(fparams)> bu(fparams);
+
+      summon_binder(bu, params);
+   }
+
+}  // end of namespace mysqlcb
+
+#endif
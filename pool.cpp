@@ -0,0 +1,296 @@
+#include <mysql.h>
+#include <mysqld_error.h>  // for ER_NO_SUCH_THREAD
+#include <stdio.h>   // for snprintf()
+#include <iostream>
+#include <stdexcept>
+#include <stdint.h>  // for uint32_t
+#include "mysqlcb_pool.hpp"
+
+namespace mysqlcb {
+
+using Clock = std::chrono::steady_clock;
+
+/** A connection in the pool.  *mysql* is only valid while *open* is true. */
+struct Connection_Pool::Slot
+{
+   MYSQL             mysql;
+   bool              open;
+   bool              leased;
+   Clock::time_point last_used;
+
+   Slot(void) : mysql(), open(false), leased(false), last_used() { }
+};
+
+inline const char *opt_str(bool has, const std::string &str) { return has ? str.c_str() : nullptr; }
+inline std::string str_opt(const char *str) { return str ? str : ""; }
+
+Connection_Args::Connection_Args(const char *host,
+                                 const char *user,
+                                 const char *pass,
+                                 const char *dbase,
+                                 const Connection_Options *options)
+   : m_host(str_opt(host)), m_user(str_opt(user)),
+     m_pass(str_opt(pass)), m_dbase(str_opt(dbase)),
+     m_has_host(host!=nullptr), m_has_user(user!=nullptr),
+     m_has_pass(pass!=nullptr), m_has_dbase(dbase!=nullptr),
+     m_options(options ? *options : default_connection_options),
+     m_socket(str_opt(m_options.socket))
+{
+   // Keep the socket path here, since the caller's may not last:
+   if (m_options.socket)
+      m_options.socket = m_socket.c_str();
+}
+
+void Connection_Args::connect(MYSQL &mysql) const
+{
+   connect_mysql(mysql,
+                 opt_str(m_has_host, m_host),
+                 opt_str(m_has_user, m_user),
+                 opt_str(m_has_pass, m_pass),
+                 opt_str(m_has_dbase, m_dbase),
+                 &m_options);
+}
+
+Connection_Pool::Connection_Pool(const Pool_Settings &settings,
+                                 const char *host,
+                                 const char *user,
+                                 const char *pass,
+                                 const char *dbase,
+                                 const Connection_Options *options)
+   : m_settings(settings),
+     m_args(host, user, pass, dbase, options),
+     m_slots(nullptr),
+     m_open(0), m_leases(0), m_connects(0), m_waits(0),
+     m_mutex(), m_returned()
+{
+   // Leases connect outside the lock, so initialize the client library
+   // here, before any two threads can race to do it in mysql_init():
+   mysql_library_init(0, nullptr, nullptr);
+
+   if (m_settings.max_size==0)
+      m_settings.max_size = 1;
+   if (m_settings.min_size > m_settings.max_size)
+      m_settings.min_size = m_settings.max_size;
+
+   m_slots = new Slot[m_settings.max_size];
+
+   try
+   {
+      for (uint32_t i=0; i<m_settings.min_size; ++i)
+      {
+         connect(m_slots[i]);
+         ++m_open;
+      }
+   }
+   catch(...)
+   {
+      for (uint32_t i=0; i<m_settings.max_size; ++i)
+         if (m_slots[i].open)
+            mysql_close(&m_slots[i].mysql);
+      delete [] m_slots;
+      throw;
+   }
+}
+
+Connection_Pool::~Connection_Pool()
+{
+   for (uint32_t i=0; i<m_settings.max_size; ++i)
+      if (m_slots[i].open)
+         mysql_close(&m_slots[i].mysql);
+   delete [] m_slots;
+}
+
+uint32_t Connection_Pool::open_count(void) const
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   return m_open;
+}
+
+void Connection_Pool::connect(Slot &slot)
+{
+   m_args.connect(slot.mysql);
+   slot.open = true;
+   slot.last_used = Clock::now();
+   ++m_connects;
+}
+
+/** Closes connections above min_size that have idled past the timeout.  Call with the lock held. */
+void Connection_Pool::close_idle(Clock::time_point now)
+{
+   auto timeout = std::chrono::seconds(m_settings.idle_timeout);
+   for (uint32_t i=0; i<m_settings.max_size && m_open > m_settings.min_size; ++i)
+   {
+      Slot &slot = m_slots[i];
+      if (!slot.leased && slot.open && now - slot.last_used > timeout)
+      {
+         mysql_close(&slot.mysql);
+         slot.open = false;
+         --m_open;
+      }
+   }
+}
+
+/**
+ * Reserves a slot, preferring the most-recently used idle connection,
+ * then an unopened slot, and waiting for a returned connection when
+ * max_size connections are all leased.
+ *
+ * The ping or connect is done outside the lock so a slow server does
+ * not stall other leases.
+ */
+Connection_Pool::Slot &Connection_Pool::acquire(void)
+{
+   Slot *slot = nullptr;
+   bool needs_ping = false;
+
+   {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      Clock::time_point now = Clock::now();
+      close_idle(now);
+
+      while (true)
+      {
+         Slot *unopened = nullptr;
+         for (uint32_t i=0; i<m_settings.max_size; ++i)
+         {
+            Slot &cur = m_slots[i];
+            if (cur.leased)
+               continue;
+            else if (cur.open)
+            {
+               if (!slot || cur.last_used > slot->last_used)
+                  slot = &cur;
+            }
+            else if (!unopened)
+               unopened = &cur;
+         }
+
+         if (!slot && unopened)
+         {
+            slot = unopened;
+            ++m_open;
+         }
+
+         if (slot)
+            break;
+
+         ++m_waits;
+         m_returned.wait(lock);
+      }
+
+      slot->leased = true;
+      ++m_leases;
+      needs_ping = slot->open
+         && now - slot->last_used > std::chrono::seconds(m_settings.ping_after);
+   }
+
+   try
+   {
+      if (needs_ping && mysql_ping(&slot->mysql))
+      {
+         mysql_close(&slot->mysql);
+         slot->open = false;
+      }
+
+      if (!slot->open)
+         connect(*slot);
+   }
+   catch(...)
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      slot->leased = false;
+      --m_open;
+      m_returned.notify_one();
+      throw;
+   }
+
+   return *slot;
+}
+
+/**
+ * Clears the session state of a returned connection so the next lease
+ * starts fresh.  A connection that fails the reset is closed.
+ */
+void Connection_Pool::release(Slot &slot)
+{
+   bool failed = mysql_reset_connection(&slot.mysql)!=0;
+   if (failed)
+   {
+      mysql_close(&slot.mysql);
+      slot.open = false;
+   }
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+   Clock::time_point now = Clock::now();
+
+   slot.leased = false;
+   slot.last_used = now;
+   if (failed)
+      --m_open;
+
+   close_idle(now);
+   m_returned.notify_one();
+}
+
+void Connection_Pool::lease(IMySQL_Callback &cb)
+{
+   Slot &slot = acquire();
+
+   try
+   {
+      cb(slot.mysql);
+   }
+   catch(...)
+   {
+      release(slot);
+      throw;
+   }
+
+   release(slot);
+}
+
+Kill_Query_Canceller::Kill_Query_Canceller(const char *host,
+                                           const char *user,
+                                           const char *pass,
+                                           const char *dbase,
+                                           const Connection_Options *options)
+   : m_args(host, user, pass, dbase, options),
+     m_mysql(), m_open(false), m_mutex()
+{
+}
+
+Kill_Query_Canceller::~Kill_Query_Canceller()
+{
+   if (m_open)
+      mysql_close(&m_mysql);
+}
+
+/**
+ * Sends the KILL on the side connection, opening it first if needed.
+ * A side connection that has gone stale is reopened once.
+ */
+void Kill_Query_Canceller::operator()(unsigned long thread_id) const
+{
+   char query[48];
+   int  len = snprintf(query, sizeof(query), "KILL QUERY %lu", thread_id);
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   if (m_open && mysql_ping(&m_mysql))
+   {
+      mysql_close(&m_mysql);
+      m_open = false;
+   }
+
+   if (!m_open)
+   {
+      m_args.connect(m_mysql);
+      m_open = true;
+   }
+
+   // The query may have finished since its callback asked to stop:
+   if (mysql_real_query(&m_mysql, query, len) && mysql_errno(&m_mysql)!=ER_NO_SUCH_THREAD)
+      throw std::runtime_error(mysql_error(&m_mysql));
+}
+
+}  // namespace
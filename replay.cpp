@@ -0,0 +1,1291 @@
+#include <mysql.h>
+#include <stdint.h>  // for uint32_t, uint64_t
+#include <stdio.h>   // for snprintf(), sscanf()
+#include <stdlib.h>  // for getenv(), strtoll(), strtod(), calloc(), free()
+#include <string.h>  // for memset(), memcpy(), strlen(), strncasecmp()
+#include <ctype.h>   // for isspace(), isdigit()
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mysqlcb_replay.hpp"
+
+/**
+ * The stand-in client library described in mysqlcb_replay.hpp.
+ *
+ * Everything is served from a Replay_Set: the fields of the result and
+ * a cycle of rows, each value kept both as the text the text protocol
+ * returns and in the native form a prepared statement returns, so a
+ * fetch costs little more than copying the values.  Row *r* of a result
+ * is row *r* modulo the cycle length.
+ */
+
+namespace mysqlcb {
+
+struct Replay_Column
+{
+   std::string      name;
+   enum_field_types type;
+   unsigned int     flags;
+   unsigned long    length;
+   bool             nullable;
+};
+
+struct Replay_Value
+{
+   bool        is_null;
+   std::string text;
+   int64_t     integer;
+   double      real;
+   MYSQL_TIME  time;
+
+   Replay_Value() : is_null(false), text(), integer(0), real(0.0), time() { }
+};
+
+struct Replay_Type
+{
+   const char       *name;
+   enum_field_types type;
+   unsigned long    length;
+   unsigned int     flags;
+};
+
+const Replay_Type replay_types[] = {
+   { "tinyint",   MYSQL_TYPE_TINY,        4,     0 },
+   { "smallint",  MYSQL_TYPE_SHORT,       6,     0 },
+   { "int",       MYSQL_TYPE_LONG,        11,    0 },
+   { "bigint",    MYSQL_TYPE_LONGLONG,    20,    0 },
+   { "float",     MYSQL_TYPE_FLOAT,       12,    0 },
+   { "double",    MYSQL_TYPE_DOUBLE,      22,    0 },
+   { "decimal",   MYSQL_TYPE_NEWDECIMAL,  12,    0 },
+   { "date",      MYSQL_TYPE_DATE,        10,    0 },
+   { "time",      MYSQL_TYPE_TIME,        10,    0 },
+   { "datetime",  MYSQL_TYPE_DATETIME,    19,    0 },
+   { "timestamp", MYSQL_TYPE_TIMESTAMP,   19,    0 },
+   { "char",      MYSQL_TYPE_STRING,      20,    0 },
+   { "varchar",   MYSQL_TYPE_VAR_STRING,  255,   0 },
+   { "text",      MYSQL_TYPE_BLOB,        65535, BLOB_FLAG },
+   { "blob",      MYSQL_TYPE_BLOB,        65535, BLOB_FLAG | BINARY_FLAG },
+   { nullptr,     MYSQL_TYPE_NULL,        0,     0 }
+};
+
+const char default_replay_columns[] = "id:int:11:u,name:varchar:40,price:double,made:datetime";
+const uint32_t synthetic_cycle_rows = 1024;
+
+bool is_integer_type(enum_field_types type)
+{
+   switch(type)
+   {
+      case MYSQL_TYPE_TINY:
+      case MYSQL_TYPE_SHORT:
+      case MYSQL_TYPE_INT24:
+      case MYSQL_TYPE_LONG:
+      case MYSQL_TYPE_LONGLONG:
+         return true;
+      default:
+         return false;
+   }
+}
+
+bool is_time_type(enum_field_types type)
+{
+   switch(type)
+   {
+      case MYSQL_TYPE_DATE:
+      case MYSQL_TYPE_TIME:
+      case MYSQL_TYPE_DATETIME:
+      case MYSQL_TYPE_TIMESTAMP:
+         return true;
+      default:
+         return false;
+   }
+}
+
+/** Parses a column spec, as described in mysqlcb_replay.hpp. */
+std::vector<Replay_Column> parse_replay_columns(const char *spec)
+{
+   std::vector<Replay_Column> columns;
+
+   std::string all(spec);
+   size_t      pos = 0;
+   while (pos < all.length())
+   {
+      size_t end = all.find(',', pos);
+      if (end==std::string::npos)
+         end = all.length();
+
+      std::vector<std::string> parts;
+      std::string item = all.substr(pos, end - pos);
+      size_t ppos = 0;
+      while (true)
+      {
+         size_t pend = item.find(':', ppos);
+         parts.push_back(item.substr(ppos, pend==std::string::npos ? pend : pend - ppos));
+         if (pend==std::string::npos)
+            break;
+         ppos = pend + 1;
+      }
+
+      if (parts.size() < 2)
+         throw std::runtime_error("Replay column \"" + item + "\" has no type.");
+
+      const Replay_Type *rt = replay_types;
+      while (rt->name && parts[1]!=rt->name)
+         ++rt;
+      if (!rt->name)
+         throw std::runtime_error("Unknown replay column type \"" + parts[1] + "\".");
+
+      Replay_Column col = { parts[0], rt->type, rt->flags, rt->length, false };
+      for (size_t i=2; i<parts.size(); ++i)
+      {
+         if (parts[i]=="u")
+            col.flags |= UNSIGNED_FLAG;
+         else if (parts[i]=="null")
+            col.nullable = true;
+         else if (!parts[i].empty() && isdigit(static_cast<unsigned char>(parts[i][0])))
+            col.length = strtoul(parts[i].c_str(), nullptr, 10);
+         else
+            throw std::runtime_error("Unknown replay column option \"" + parts[i] + "\".");
+      }
+      if (!col.nullable)
+         col.flags |= NOT_NULL_FLAG;
+
+      columns.push_back(col);
+      pos = end + 1;
+   }
+
+   return columns;
+}
+
+/** Scrambles a row and column number into a repeatable pseudo-random value. */
+uint64_t replay_mix(uint64_t row, uint64_t column)
+{
+   uint64_t z = row * 0x9E3779B97F4A7C15ull + column * 0xBF58476D1CE4E5B9ull + 1;
+   z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+   z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+   return z ^ (z >> 31);
+}
+
+/** Fills *value*'s native form from its text, as the server would convert it. */
+void parse_replay_value(Replay_Value &value, const Replay_Column &col)
+{
+   const char *text = value.text.c_str();
+   if (is_integer_type(col.type))
+   {
+      if (col.flags & UNSIGNED_FLAG)
+         value.integer = static_cast<int64_t>(strtoull(text, nullptr, 10));
+      else
+         value.integer = strtoll(text, nullptr, 10);
+   }
+   else if (col.type==MYSQL_TYPE_FLOAT || col.type==MYSQL_TYPE_DOUBLE)
+      value.real = strtod(text, nullptr);
+   else if (is_time_type(col.type))
+   {
+      MYSQL_TIME &t = value.time;
+      if (col.type==MYSQL_TYPE_TIME)
+      {
+         sscanf(text, "%u:%u:%u", &t.hour, &t.minute, &t.second);
+         t.time_type = MYSQL_TIMESTAMP_TIME;
+      }
+      else
+      {
+         sscanf(text, "%u-%u-%u %u:%u:%u", &t.year, &t.month, &t.day, &t.hour, &t.minute, &t.second);
+         t.time_type = col.type==MYSQL_TYPE_DATE ? MYSQL_TIMESTAMP_DATE : MYSQL_TIMESTAMP_DATETIME;
+      }
+   }
+}
+
+/** Makes the text of a synthetic value, varying its size from row to row. */
+std::string make_replay_text(const Replay_Column &col, uint32_t row, uint32_t column, unsigned long width)
+{
+   uint64_t mix = replay_mix(row, column);
+   char     buff[64];
+   bool     negative = !(col.flags & UNSIGNED_FLAG) && (mix & 1);
+
+   if (is_integer_type(col.type))
+   {
+      uint64_t limit;
+      switch(col.type)
+      {
+         case MYSQL_TYPE_TINY:  limit = 127;        break;
+         case MYSQL_TYPE_SHORT: limit = 32767;      break;
+         case MYSQL_TYPE_INT24: limit = 8388607;    break;
+         case MYSQL_TYPE_LONG:  limit = 2147483647; break;
+         default:               limit = 9223372036854775807ull;
+      }
+
+      // Spread the digit counts evenly rather than the values, like ids and counts:
+      uint64_t magnitude = 1;
+      for (uint64_t digits = (mix >> 8) % 19; digits; --digits)
+         magnitude *= 10;
+      uint64_t val = (mix >> 16) % magnitude;
+      if (val > limit)
+         val %= limit;
+
+      if (negative)
+         snprintf(buff, sizeof(buff), "-%llu", static_cast<unsigned long long>(val));
+      else
+         snprintf(buff, sizeof(buff), "%llu", static_cast<unsigned long long>(val));
+      return buff;
+   }
+
+   switch(col.type)
+   {
+      case MYSQL_TYPE_FLOAT:
+      case MYSQL_TYPE_DOUBLE:
+      {
+         double scale = 1.0;
+         for (uint64_t places = (mix >> 8) % 7; places; --places)
+            scale *= 10.0;
+         double val = static_cast<double>((mix >> 16) % 100000000) / scale;
+         if (negative)
+            val = -val;
+
+         if (col.type==MYSQL_TYPE_FLOAT)
+            snprintf(buff, sizeof(buff), "%.9g", static_cast<double>(static_cast<float>(val)));
+         else
+            snprintf(buff, sizeof(buff), "%.17g", val);
+         return buff;
+      }
+
+      case MYSQL_TYPE_NEWDECIMAL:
+         snprintf(buff, sizeof(buff), "%s%llu.%02u",
+                  negative ? "-" : "",
+                  static_cast<unsigned long long>((mix >> 16) % 10000000),
+                  static_cast<unsigned>((mix >> 8) % 100));
+         return buff;
+
+      case MYSQL_TYPE_DATE:
+         snprintf(buff, sizeof(buff), "%04u-%02u-%02u",
+                  1970 + row % 60, 1 + row % 12, 1 + row % 28);
+         return buff;
+
+      case MYSQL_TYPE_TIME:
+         snprintf(buff, sizeof(buff), "%02u:%02u:%02u", row % 24, (row * 7) % 60, (row * 13) % 60);
+         return buff;
+
+      case MYSQL_TYPE_DATETIME:
+      case MYSQL_TYPE_TIMESTAMP:
+         snprintf(buff, sizeof(buff), "%04u-%02u-%02u %02u:%02u:%02u",
+                  1970 + row % 60, 1 + row % 12, 1 + row % 28,
+                  row % 24, (row * 7) % 60, (row * 13) % 60);
+         return buff;
+
+      default:
+      {
+         // Between half and all of *width* characters, but no longer than the column:
+         unsigned long len = width / 2 + (width ? mix % (width - width / 2 + 1) : 0);
+         if (len > col.length)
+            len = col.length;
+
+         std::string text = "row" + std::to_string(row) + "-" + col.name;
+         if (text.length() > len)
+            text.resize(len);
+         while (text.length() < len)
+            text += static_cast<char>('a' + text.length() % 26);
+         return text;
+      }
+   }
+}
+
+/**
+ * The columns and rows that every query returns, with the MYSQL_FIELD
+ * array and the text-protocol row arrays built from them.
+ */
+class Replay_Set
+{
+public:
+   Replay_Set();
+
+   void set_columns(const char *spec);
+   void set_width(unsigned long width);
+   void load(const char *path);
+   inline void set_rows(uint64_t rows)              { m_row_count = rows; }
+
+   inline uint32_t column_count(void) const         { return static_cast<uint32_t>(m_columns.size()); }
+   inline uint64_t row_count(void) const            { return m_cycle_rows ? m_row_count : 0; }
+   inline const std::vector<MYSQL_FIELD> &fields(void) const { return m_fields; }
+   inline unsigned long max_length(uint32_t column) const    { return m_max_lengths[column]; }
+
+   inline const Replay_Value &value(uint64_t row, uint32_t column) const
+   {
+      return m_values[(row % m_cycle_rows) * m_columns.size() + column];
+   }
+
+   inline MYSQL_ROW text_row(uint64_t row)
+   {
+      return &m_row_ptrs[(row % m_cycle_rows) * m_columns.size()];
+   }
+
+   inline unsigned long *text_lengths(uint64_t row)
+   {
+      return &m_row_lengths[(row % m_cycle_rows) * m_columns.size()];
+   }
+
+protected:
+   void generate(void);
+   void index(void);
+
+   std::vector<Replay_Column> m_columns;
+   std::vector<Replay_Value>  m_values;
+   std::vector<MYSQL_FIELD>   m_fields;
+   std::vector<char*>         m_row_ptrs;
+   std::vector<unsigned long> m_row_lengths;
+   std::vector<unsigned long> m_max_lengths;
+   uint32_t                   m_cycle_rows;
+   uint64_t                   m_row_count;
+   unsigned long              m_width;
+};
+
+Replay_Set::Replay_Set()
+   : m_columns(),
+     m_values(),
+     m_fields(),
+     m_row_ptrs(),
+     m_row_lengths(),
+     m_max_lengths(),
+     m_cycle_rows(0),
+     m_row_count(1000),
+     m_width(16)
+{
+   const char *env = getenv("MYSQLCB_REPLAY_WIDTH");
+   if (env)
+      m_width = strtoul(env, nullptr, 10);
+
+   env = getenv("MYSQLCB_REPLAY_FILE");
+   if (env)
+      load(env);
+   else
+   {
+      env = getenv("MYSQLCB_REPLAY_COLUMNS");
+      set_columns(env ? env : default_replay_columns);
+   }
+
+   env = getenv("MYSQLCB_REPLAY_ROWS");
+   if (env)
+      m_row_count = strtoull(env, nullptr, 10);
+}
+
+void Replay_Set::set_columns(const char *spec)
+{
+   m_columns = parse_replay_columns(spec);
+   generate();
+}
+
+void Replay_Set::set_width(unsigned long width)
+{
+   m_width = width;
+   if (!m_columns.empty())
+      generate();
+}
+
+/** Makes a cycle of synthetic rows. */
+void Replay_Set::generate(void)
+{
+   m_cycle_rows = synthetic_cycle_rows;
+   m_values.assign(static_cast<size_t>(m_cycle_rows) * m_columns.size(), Replay_Value());
+
+   Replay_Value *value = m_values.data();
+   for (uint32_t r=0; r<m_cycle_rows; ++r)
+      for (uint32_t c=0; c<m_columns.size(); ++c, ++value)
+      {
+         const Replay_Column &col = m_columns[c];
+         value->is_null = col.nullable && r % 10==9;
+         if (!value->is_null)
+         {
+            value->text = make_replay_text(col, r, c, m_width);
+            parse_replay_value(*value, col);
+         }
+      }
+
+   index();
+}
+
+/**
+ * Reads a recorded result: a column spec on the first line, then a
+ * row per line with tab-separated values, where `\N` is NULL and
+ * `\t`, `\n`, `\0` and `\\` stand for their characters, as in the
+ * output of `mysql --batch`.  The result has as many rows as the file
+ * until replay_rows() changes it.
+ */
+void Replay_Set::load(const char *path)
+{
+   std::ifstream in(path);
+   if (!in)
+      throw std::runtime_error(std::string("Failed to open replay file \"") + path + "\".");
+
+   std::string line;
+   if (!std::getline(in, line))
+      throw std::runtime_error(std::string("Replay file \"") + path + "\" has no column spec.");
+
+   m_columns = parse_replay_columns(line.c_str());
+   m_values.clear();
+
+   uint32_t rows = 0;
+   while (std::getline(in, line))
+   {
+      size_t pos = 0;
+      for (uint32_t c=0; c<m_columns.size(); ++c)
+      {
+         Replay_Value value;
+         size_t end = line.find('\t', pos);
+         std::string field = line.substr(pos, end==std::string::npos ? end : end - pos);
+         pos = end==std::string::npos ? line.length() : end + 1;
+
+         if (field=="\\N")
+            value.is_null = true;
+         else
+         {
+            for (size_t i=0; i<field.length(); ++i)
+            {
+               char ch = field[i];
+               if (ch=='\\' && i+1<field.length())
+               {
+                  switch(field[++i])
+                  {
+                     case 't': ch = '\t'; break;
+                     case 'n': ch = '\n'; break;
+                     case '0': ch = '\0'; break;
+                     default:  ch = field[i];
+                  }
+               }
+               value.text += ch;
+            }
+            parse_replay_value(value, m_columns[c]);
+         }
+
+         m_values.push_back(value);
+      }
+      ++rows;
+   }
+
+   m_cycle_rows = rows;
+   m_row_count = rows;
+   index();
+}
+
+/** Builds the fields and the text-protocol rows for the current values. */
+void Replay_Set::index(void)
+{
+   size_t count = m_columns.size();
+
+   m_fields.assign(count, MYSQL_FIELD());
+   for (size_t c=0; c<count; ++c)
+   {
+      MYSQL_FIELD   &f = m_fields[c];
+      Replay_Column &col = m_columns[c];
+
+      memset(&f, 0, sizeof(f));
+      f.name = f.org_name = &col.name[0];
+      f.name_length = f.org_name_length = static_cast<unsigned int>(col.name.length());
+      f.table = f.org_table = const_cast<char*>("replay");
+      f.table_length = f.org_table_length = 6;
+      f.db = const_cast<char*>("");
+      f.catalog = const_cast<char*>("def");
+      f.catalog_length = 3;
+      f.def = nullptr;
+      f.length = col.length;
+      f.flags = col.flags;
+      f.type = col.type;
+      f.charsetnr = (col.flags & BINARY_FLAG) || is_integer_type(col.type) ? 63 : 33;
+      f.decimals = col.type==MYSQL_TYPE_NEWDECIMAL ? 2 : 0;
+   }
+
+   m_row_ptrs.resize(m_values.size());
+   m_row_lengths.resize(m_values.size());
+   m_max_lengths.assign(count, 0);
+   for (size_t i=0; i<m_values.size(); ++i)
+   {
+      Replay_Value &value = m_values[i];
+      m_row_ptrs[i] = value.is_null ? nullptr : &value.text[0];
+      m_row_lengths[i] = value.is_null ? 0 : value.text.length();
+      if (m_row_lengths[i] > m_max_lengths[i % count])
+         m_max_lengths[i % count] = m_row_lengths[i];
+   }
+}
+
+/**
+ * The Replay_Set is made on first use, from the environment, and never
+ * destroyed, so it outlives any static object of a preloaded program.
+ */
+Replay_Set &replay_set(void)
+{
+   static Replay_Set *set = new Replay_Set;
+   return *set;
+}
+
+void replay_columns(const char *spec)   { replay_set().set_columns(spec); }
+void replay_rows(uint64_t rows)         { replay_set().set_rows(rows); }
+void replay_width(unsigned long width)  { replay_set().set_width(width); }
+void replay_load(const char *path)      { replay_set().load(path); }
+uint64_t replay_row_count(void)         { return replay_set().row_count(); }
+
+std::atomic<uint64_t> replay_executes(0);
+
+uint64_t replay_execute_count(void)     { return replay_executes.load(); }
+
+std::atomic<uint64_t> replay_resets(0);
+
+std::atomic<uint64_t> replay_null_params(0);
+
+std::string replay_last_query_text;
+std::string replay_last_connect_text;
+
+uint64_t replay_null_param_count(void)  { return replay_null_params.load(); }
+
+uint64_t replay_reset_count(void)       { return replay_resets.load(); }
+
+/** True if *query* would return rows from a server. */
+bool returns_rows(const char *query)
+{
+   while (isspace(static_cast<unsigned char>(*query)) || *query=='(')
+      ++query;
+
+   static const char *verbs[] = { "SELECT", "SHOW", "WITH", "DESC", "EXPLAIN", nullptr };
+   for (const char **verb=verbs; *verb; ++verb)
+      if (0==strncasecmp(query, *verb, strlen(*verb)))
+         return true;
+
+   return false;
+}
+
+/** A result set handle, for the text protocol or for statement metadata. */
+struct Replay_Result
+{
+   std::vector<MYSQL_FIELD> fields;
+   unsigned long            *lengths;
+   uint64_t                 row;
+   uint64_t                 row_count;
+
+   Replay_Result() : fields(), lengths(nullptr), row(0), row_count(0) { }
+   Replay_Result(const Replay_Result&) = delete;
+   Replay_Result& operator=(const Replay_Result&) = delete;
+};
+
+struct Replay_Stmt
+{
+   MYSQL                    *mysql;
+   std::vector<MYSQL_FIELD> fields;
+   MYSQL_BIND               *results;
+   const MYSQL_BIND         *params;
+   unsigned long            param_count;
+   unsigned long            array_size;
+   uint64_t                 row;
+   uint64_t                 row_count;
+   uint64_t                 affected;
+   bool                     update_max_length;
+   bool                     cursor;
+   unsigned int             error;
+
+   explicit Replay_Stmt(MYSQL *m)
+      : mysql(m), fields(), results(nullptr), params(nullptr), param_count(0), array_size(0),
+        row(0), row_count(0), affected(0), update_max_length(false), cursor(false), error(0) { }
+   Replay_Stmt(const Replay_Stmt&) = delete;
+   Replay_Stmt& operator=(const Replay_Stmt&) = delete;
+};
+
+/** What the stand-in remembers about a connection. */
+struct Replay_Conn
+{
+   Replay_Result            *pending;
+   unsigned int             field_count;
+   uint64_t                 affected;
+   bool                     allocated;
+   std::vector<std::string> more;        ///< Statements whose results follow the current one
+   Replay_Stmt              *streaming;  ///< Statement with unread rows not stored in the client
+   unsigned int             error;
+   std::string              settings;   ///< Options set for the connect, for replay_last_connect()
+
+   Replay_Conn()
+      : pending(nullptr), field_count(0), affected(0), allocated(false), more(), streaming(nullptr), error(0),
+        settings() { }
+   Replay_Conn(const Replay_Conn&) = delete;
+   Replay_Conn& operator=(const Replay_Conn&) = delete;
+};
+
+/** The client error for a query sent while results are still pending. */
+const unsigned int replay_out_of_sync = 2014;   // CR_COMMANDS_OUT_OF_SYNC
+const char *const  replay_out_of_sync_text = "Commands out of sync; you can't run this command now";
+
+/**
+ * Splits a multi-statement query at the semicolons outside quotes.  A
+ * CALL is followed by the status result a server sends after the
+ * results of a procedure, here an empty statement.
+ */
+std::vector<std::string> split_statements(const char *query, unsigned long length)
+{
+   std::vector<std::string> statements;
+   std::string              cur;
+   char                     quote = 0;
+
+   for (const char *ptr=query, *end=query+length; ptr<end; ++ptr)
+   {
+      if (quote)
+      {
+         cur += *ptr;
+         if (*ptr=='\\' && ptr+1<end)
+            cur += *++ptr;
+         else if (*ptr==quote)
+            quote = 0;
+      }
+      else if (*ptr==';')
+      {
+         statements.push_back(cur);
+         cur.clear();
+      }
+      else
+      {
+         if (*ptr=='\'' || *ptr=='"' || *ptr=='`')
+            quote = *ptr;
+         cur += *ptr;
+      }
+   }
+   statements.push_back(cur);
+
+   std::vector<std::string> results;
+   for (const std::string &stmt : statements)
+   {
+      size_t start = stmt.find_first_not_of(" \t\r\n");
+      if (start==std::string::npos)
+         continue;
+      results.push_back(stmt.substr(start));
+      if (0==strncasecmp(results.back().c_str(), "CALL", 4))
+         results.push_back(std::string());
+   }
+   if (results.empty())
+      results.push_back(std::string());
+   return results;
+}
+
+/** Makes *statement* the connection's current result.  Call with the lock held. */
+void start_replay_result(Replay_Conn &conn, const std::string &statement)
+{
+   Replay_Set    &set = replay_set();
+   Replay_Result *res = nullptr;
+
+   const char *text = statement.c_str();
+   if (returns_rows(text) || 0==strncasecmp(text, "CALL", 4))
+   {
+      res = new Replay_Result();
+      res->fields = set.fields();
+      res->row_count = set.row_count();
+   }
+
+   delete conn.pending;
+   conn.pending = res;
+   conn.field_count = res ? set.column_count() : 0;
+   conn.affected = res ? 0 : 1;
+}
+
+std::mutex &replay_conn_mutex(void)
+{
+   static std::mutex *mutex = new std::mutex;
+   return *mutex;
+}
+
+std::map<const MYSQL*, Replay_Conn> &replay_conns(void)
+{
+   static std::map<const MYSQL*, Replay_Conn> *conns = new std::map<const MYSQL*, Replay_Conn>;
+   return *conns;
+}
+
+std::string replay_last_query(void)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   return replay_last_query_text;
+}
+
+std::string replay_last_connect(void)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   return replay_last_connect_text;
+}
+
+inline Replay_Stmt *replay_stmt(MYSQL_STMT *stmt)
+{
+   return reinterpret_cast<Replay_Stmt*>(stmt);
+}
+
+inline Replay_Result *replay_result(MYSQL_RES *res)
+{
+   return reinterpret_cast<Replay_Result*>(res);
+}
+
+/**
+ * Copies a value into a result bind as mysql_stmt_fetch() does,
+ * converting to the bind's buffer type and reporting truncation.
+ * *offset* is for mysql_stmt_fetch_column().
+ */
+int store_replay_value(MYSQL_BIND &bind, const Replay_Value &value, unsigned long offset)
+{
+   if (bind.is_null)
+      *bind.is_null = value.is_null;
+   if (bind.error)
+      *bind.error = 0;
+   if (value.is_null)
+      return 0;
+
+   unsigned long size = 0;
+   switch(bind.buffer_type)
+   {
+      case MYSQL_TYPE_TINY:
+         *static_cast<int8_t*>(bind.buffer) = static_cast<int8_t>(value.integer);
+         size = sizeof(int8_t);
+         break;
+      case MYSQL_TYPE_SHORT:
+         *static_cast<int16_t*>(bind.buffer) = static_cast<int16_t>(value.integer);
+         size = sizeof(int16_t);
+         break;
+      case MYSQL_TYPE_INT24:
+      case MYSQL_TYPE_LONG:
+         *static_cast<int32_t*>(bind.buffer) = static_cast<int32_t>(value.integer);
+         size = sizeof(int32_t);
+         break;
+      case MYSQL_TYPE_LONGLONG:
+         *static_cast<int64_t*>(bind.buffer) = value.integer;
+         size = sizeof(int64_t);
+         break;
+      case MYSQL_TYPE_FLOAT:
+         *static_cast<float*>(bind.buffer) = static_cast<float>(value.real);
+         size = sizeof(float);
+         break;
+      case MYSQL_TYPE_DOUBLE:
+         *static_cast<double*>(bind.buffer) = value.real;
+         size = sizeof(double);
+         break;
+      case MYSQL_TYPE_DATE:
+      case MYSQL_TYPE_TIME:
+      case MYSQL_TYPE_DATETIME:
+      case MYSQL_TYPE_TIMESTAMP:
+         memcpy(bind.buffer, &value.time, sizeof(MYSQL_TIME));
+         size = sizeof(MYSQL_TIME);
+         break;
+      default:
+      {
+         unsigned long len = value.text.length();
+         unsigned long avail = offset < len ? len - offset : 0;
+         unsigned long copy = avail < bind.buffer_length ? avail : bind.buffer_length;
+         memcpy(bind.buffer, value.text.data() + offset, copy);
+         if (copy < bind.buffer_length)
+            static_cast<char*>(bind.buffer)[copy] = '\0';
+         if (bind.length)
+            *bind.length = len;
+
+         if (avail > bind.buffer_length)
+         {
+            if (bind.error)
+               *bind.error = 1;
+            return MYSQL_DATA_TRUNCATED;
+         }
+         return 0;
+      }
+   }
+
+   if (bind.length)
+      *bind.length = size;
+   return 0;
+}
+
+}  // namespace
+
+using namespace mysqlcb;
+
+extern "C" {
+
+int mysql_library_init(int, char **, char **)  { replay_set(); return 0; }
+void mysql_library_end(void)                   { }
+my_bool mysql_thread_init(void)                { return 0; }
+void mysql_thread_end(void)                    { }
+
+MYSQL *mysql_init(MYSQL *mysql)
+{
+   bool allocated = mysql==nullptr;
+   if (allocated)
+      mysql = static_cast<MYSQL*>(calloc(1, sizeof(MYSQL)));
+   else
+      memset(mysql, 0, sizeof(MYSQL));
+
+   if (mysql)
+   {
+      std::lock_guard<std::mutex> lock(replay_conn_mutex());
+      replay_conns().erase(mysql);
+      replay_conns()[mysql].allocated = allocated;
+   }
+   return mysql;
+}
+
+/** Remembers the options that shape a connection, for replay_last_connect(). */
+int mysql_options(MYSQL *mysql, enum mysql_option option, const void *arg)
+{
+   std::string setting;
+   switch(option)
+   {
+      case MYSQL_READ_DEFAULT_FILE:
+         setting = std::string("read_default_file=") + static_cast<const char*>(arg);
+         break;
+      case MYSQL_READ_DEFAULT_GROUP:
+         setting = std::string("read_default_group=") + static_cast<const char*>(arg);
+         break;
+      case MYSQL_OPT_COMPRESS:
+         setting = "compress";
+         break;
+      case MYSQL_OPT_READ_TIMEOUT:
+         setting = "read_timeout=" + std::to_string(*static_cast<const unsigned int*>(arg));
+         break;
+      case MYSQL_OPT_WRITE_TIMEOUT:
+         setting = "write_timeout=" + std::to_string(*static_cast<const unsigned int*>(arg));
+         break;
+      default:
+         return 0;
+   }
+
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   replay_conns()[mysql].settings += setting + " ";
+   return 0;
+}
+
+/** Connects at once, recording the options and arguments but never the password. */
+MYSQL *mysql_real_connect(MYSQL *mysql, const char *host, const char *user, const char *,
+                          const char *dbase, unsigned int port, const char *socket,
+                          unsigned long client_flag)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   std::string &text = replay_last_connect_text;
+   text = replay_conns()[mysql].settings;
+   if (host)
+      text += std::string("host=") + host + " ";
+   if (user)
+      text += std::string("user=") + user + " ";
+   if (dbase)
+      text += std::string("dbase=") + dbase + " ";
+   if (port)
+      text += "port=" + std::to_string(port) + " ";
+   if (socket)
+      text += std::string("socket=") + socket + " ";
+   if (client_flag & CLIENT_MULTI_STATEMENTS)
+      text += "multi_statements ";
+   if (!text.empty())
+      text.erase(text.length() - 1);
+   return mysql;
+}
+
+void mysql_close(MYSQL *mysql)
+{
+   bool allocated = false;
+   {
+      std::lock_guard<std::mutex> lock(replay_conn_mutex());
+      auto it = replay_conns().find(mysql);
+      if (it!=replay_conns().end())
+      {
+         delete it->second.pending;
+         allocated = it->second.allocated;
+         replay_conns().erase(it);
+      }
+   }
+
+   if (allocated)
+      free(mysql);
+}
+
+const char *mysql_error(MYSQL *mysql)
+{
+   return mysql_errno(mysql)==replay_out_of_sync ? replay_out_of_sync_text : "";
+}
+
+unsigned int mysql_errno(MYSQL *mysql)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   auto it = replay_conns().find(mysql);
+   return it==replay_conns().end() ? 0 : it->second.error;
+}
+
+int mysql_ping(MYSQL *)                         { return 0; }
+int mysql_reset_connection(MYSQL *)             { ++replay_resets; return 0; }
+unsigned long mysql_thread_id(MYSQL *)          { return 1; }
+
+my_ulonglong mysql_affected_rows(MYSQL *mysql)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   return replay_conns()[mysql].affected;
+}
+
+unsigned long mysql_real_escape_string(MYSQL *, char *to, const char *from, unsigned long length)
+{
+   char *start = to;
+   for (const char *end=from+length; from<end; ++from)
+   {
+      switch(*from)
+      {
+         case '\0':   *to++ = '\\'; *to++ = '0';  break;
+         case '\n':   *to++ = '\\'; *to++ = 'n';  break;
+         case '\r':   *to++ = '\\'; *to++ = 'r';  break;
+         case '\032': *to++ = '\\'; *to++ = 'Z';  break;
+         case '\\':
+         case '\'':
+         case '"':    *to++ = '\\'; *to++ = *from; break;
+         default:     *to++ = *from;
+      }
+   }
+   *to = '\0';
+   return static_cast<unsigned long>(to - start);
+}
+
+/**
+ * Answers each statement of a multi-statement query in turn, the first
+ * now and the rest through mysql_next_result().  Like a server, it
+ * refuses a query while results of the last one, or the streamed rows
+ * of a prepared statement, are still to be read.
+ */
+int mysql_real_query(MYSQL *mysql, const char *query, unsigned long length)
+{
+   std::vector<std::string> statements = split_statements(query, length);
+
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   Replay_Conn &conn = replay_conns()[mysql];
+   if (!conn.more.empty() || conn.streaming)
+   {
+      conn.error = replay_out_of_sync;
+      return 1;
+   }
+
+   replay_last_query_text.assign(query, length);
+   conn.error = 0;
+   conn.more.assign(statements.begin() + 1, statements.end());
+   start_replay_result(conn, statements[0]);
+   return 0;
+}
+
+my_bool mysql_more_results(MYSQL *mysql)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   return !replay_conns()[mysql].more.empty();
+}
+
+int mysql_next_result(MYSQL *mysql)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   Replay_Conn &conn = replay_conns()[mysql];
+   if (conn.more.empty())
+      return -1;
+
+   std::string statement = conn.more.front();
+   conn.more.erase(conn.more.begin());
+   start_replay_result(conn, statement);
+   return 0;
+}
+
+MYSQL_RES *mysql_use_result(MYSQL *mysql)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   Replay_Conn &conn = replay_conns()[mysql];
+   Replay_Result *res = conn.pending;
+   conn.pending = nullptr;
+   return reinterpret_cast<MYSQL_RES*>(res);
+}
+
+/** A stored result knows the longest value of each column. */
+MYSQL_RES *mysql_store_result(MYSQL *mysql)
+{
+   MYSQL_RES *res = mysql_use_result(mysql);
+   if (res)
+   {
+      std::vector<MYSQL_FIELD> &fields = replay_result(res)->fields;
+      for (uint32_t i=0; i<fields.size(); ++i)
+         fields[i].max_length = replay_set().max_length(i);
+   }
+   return res;
+}
+
+unsigned int mysql_field_count(MYSQL *mysql)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   return replay_conns()[mysql].field_count;
+}
+
+unsigned int mysql_num_fields(MYSQL_RES *res)
+{
+   return static_cast<unsigned int>(replay_result(res)->fields.size());
+}
+
+MYSQL_FIELD *mysql_fetch_fields(MYSQL_RES *res)
+{
+   return replay_result(res)->fields.data();
+}
+
+MYSQL_ROW mysql_fetch_row(MYSQL_RES *res)
+{
+   Replay_Result &r = *replay_result(res);
+   if (r.row >= r.row_count)
+      return nullptr;
+
+   Replay_Set &set = replay_set();
+   r.lengths = set.text_lengths(r.row);
+   return set.text_row(r.row++);
+}
+
+unsigned long *mysql_fetch_lengths(MYSQL_RES *res)      { return replay_result(res)->lengths; }
+my_ulonglong mysql_num_rows(MYSQL_RES *res)             { return replay_result(res)->row_count; }
+void mysql_data_seek(MYSQL_RES *res, my_ulonglong row)  { replay_result(res)->row = row; }
+void mysql_free_result(MYSQL_RES *res)                  { delete replay_result(res); }
+
+MYSQL_STMT *mysql_stmt_init(MYSQL *mysql)
+{
+   Replay_Stmt *stmt = new Replay_Stmt(mysql);
+   return reinterpret_cast<MYSQL_STMT*>(stmt);
+}
+
+/**
+ * Readies *s* to send a command, failing it as out of sync if its
+ * connection has results of another command still to be read.  Rows of
+ * *s* itself that are left unread are discarded.
+ */
+bool replay_stmt_command(Replay_Stmt &s)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   auto it = replay_conns().find(s.mysql);
+   if (it==replay_conns().end())
+      return true;
+
+   Replay_Conn &conn = it->second;
+   if (conn.streaming==&s)
+      conn.streaming = nullptr;
+   s.error = (conn.streaming || !conn.more.empty()) ? replay_out_of_sync : 0;
+   return s.error==0;
+}
+
+/** Marks the rows of *s* read, or kept by the client, freeing its connection for other commands. */
+void replay_stmt_done(Replay_Stmt &s)
+{
+   std::lock_guard<std::mutex> lock(replay_conn_mutex());
+   auto it = replay_conns().find(s.mysql);
+   if (it!=replay_conns().end() && it->second.streaming==&s)
+      it->second.streaming = nullptr;
+}
+
+int mysql_stmt_prepare(MYSQL_STMT *stmt, const char *query, unsigned long length)
+{
+   Replay_Stmt &s = *replay_stmt(stmt);
+   if (!replay_stmt_command(s))
+      return 1;
+
+   s.param_count = 0;
+   for (const char *p=query, *end=query+length; p<end; ++p)
+      if (*p=='?')
+         ++s.param_count;
+
+   if (returns_rows(query))
+      s.fields = replay_set().fields();
+   else
+      s.fields.clear();
+
+   s.row = s.row_count = 0;
+   return 0;
+}
+
+my_bool mysql_stmt_bind_param(MYSQL_STMT *stmt, MYSQL_BIND *binds)   { replay_stmt(stmt)->params = binds; return 0; }
+my_bool mysql_stmt_bind_result(MYSQL_STMT *stmt, MYSQL_BIND *binds)  { replay_stmt(stmt)->results = binds; return 0; }
+unsigned long mysql_stmt_param_count(MYSQL_STMT *stmt)               { return replay_stmt(stmt)->param_count; }
+
+unsigned int mysql_stmt_field_count(MYSQL_STMT *stmt)
+{
+   return static_cast<unsigned int>(replay_stmt(stmt)->fields.size());
+}
+
+my_bool mysql_stmt_attr_set(MYSQL_STMT *stmt, enum enum_stmt_attr_type attr, const void *value)
+{
+   Replay_Stmt &s = *replay_stmt(stmt);
+   if (attr==STMT_ATTR_UPDATE_MAX_LENGTH)
+      s.update_max_length = *static_cast<const my_bool*>(value)!=0;
+   else if (attr==STMT_ATTR_CURSOR_TYPE)
+      s.cursor = *static_cast<const unsigned long*>(value)!=CURSOR_TYPE_NO_CURSOR;
+#ifdef LIBMARIADB
+   else if (attr==STMT_ATTR_ARRAY_SIZE)
+      s.array_size = *static_cast<const unsigned int*>(value);
+#endif
+   return 0;
+}
+
+my_bool mysql_stmt_attr_get(MYSQL_STMT *, enum enum_stmt_attr_type, void *)  { return 0; }
+
+/** Returns the number of NULL values in the bound parameters of *s*. */
+uint64_t count_null_params(const Replay_Stmt &s)
+{
+   uint64_t nulls = 0;
+   for (unsigned long i=0; s.params && i<s.param_count; ++i)
+   {
+      const MYSQL_BIND &bind = s.params[i];
+#ifdef LIBMARIADB
+      if (s.array_size && bind.u.indicator)
+      {
+         for (unsigned long r=0; r<s.array_size; ++r)
+            if (bind.u.indicator[r]==STMT_INDICATOR_NULL)
+               ++nulls;
+         continue;
+      }
+#endif
+      if (bind.buffer_type==MYSQL_TYPE_NULL || (bind.is_null && *bind.is_null))
+         nulls += s.array_size ? s.array_size : 1;
+   }
+   return nulls;
+}
+
+int mysql_stmt_execute(MYSQL_STMT *stmt)
+{
+   Replay_Stmt &s = *replay_stmt(stmt);
+   if (!replay_stmt_command(s))
+      return 1;
+
+   ++replay_executes;
+   replay_null_params += count_null_params(s);
+   s.row = 0;
+   if (s.fields.empty())
+   {
+      s.row_count = 0;
+      s.affected = s.array_size ? s.array_size : 1;
+   }
+   else
+   {
+      s.row_count = replay_set().row_count();
+      s.affected = 0;
+
+      // Until they are read, streamed rows hold the connection:
+      if (s.row_count && !s.cursor)
+      {
+         std::lock_guard<std::mutex> lock(replay_conn_mutex());
+         auto it = replay_conns().find(s.mysql);
+         if (it!=replay_conns().end())
+            it->second.streaming = &s;
+      }
+   }
+   return 0;
+}
+
+int mysql_stmt_store_result(MYSQL_STMT *stmt)
+{
+   Replay_Stmt &s = *replay_stmt(stmt);
+   replay_stmt_done(s);
+   if (s.update_max_length)
+      for (uint32_t i=0; i<s.fields.size(); ++i)
+         s.fields[i].max_length = replay_set().max_length(i);
+   return 0;
+}
+
+int mysql_stmt_fetch(MYSQL_STMT *stmt)
+{
+   Replay_Stmt &s = *replay_stmt(stmt);
+   if (s.row >= s.row_count)
+   {
+      replay_stmt_done(s);
+      return MYSQL_NO_DATA;
+   }
+
+   Replay_Set &set = replay_set();
+   int result = 0;
+   for (uint32_t i=0; i<s.fields.size(); ++i)
+      if (store_replay_value(s.results[i], set.value(s.row, i), 0)==MYSQL_DATA_TRUNCATED)
+         result = MYSQL_DATA_TRUNCATED;
+
+   ++s.row;
+   return result;
+}
+
+int mysql_stmt_fetch_column(MYSQL_STMT *stmt, MYSQL_BIND *bind, unsigned int column, unsigned long offset)
+{
+   Replay_Stmt &s = *replay_stmt(stmt);
+   if (s.row==0 || column >= s.fields.size())
+      return 1;
+
+   store_replay_value(*bind, replay_set().value(s.row - 1, column), offset);
+   return 0;
+}
+
+MYSQL_RES *mysql_stmt_result_metadata(MYSQL_STMT *stmt)
+{
+   Replay_Stmt &s = *replay_stmt(stmt);
+   if (s.fields.empty())
+      return nullptr;
+
+   Replay_Result *res = new Replay_Result();
+   res->fields = s.fields;
+   return reinterpret_cast<MYSQL_RES*>(res);
+}
+
+void mysql_stmt_data_seek(MYSQL_STMT *stmt, my_ulonglong row)   { replay_stmt(stmt)->row = row; }
+my_ulonglong mysql_stmt_num_rows(MYSQL_STMT *stmt)             { return replay_stmt(stmt)->row_count; }
+my_ulonglong mysql_stmt_affected_rows(MYSQL_STMT *stmt)        { return replay_stmt(stmt)->affected; }
+
+my_bool mysql_stmt_free_result(MYSQL_STMT *stmt)
+{
+   Replay_Stmt &s = *replay_stmt(stmt);
+   replay_stmt_done(s);
+   s.row = s.row_count;
+   return 0;
+}
+
+my_bool mysql_stmt_reset(MYSQL_STMT *stmt)                     { return mysql_stmt_free_result(stmt); }
+
+my_bool mysql_stmt_close(MYSQL_STMT *stmt)
+{
+   replay_stmt_done(*replay_stmt(stmt));
+   delete replay_stmt(stmt);
+   return 0;
+}
+
+unsigned int mysql_stmt_errno(MYSQL_STMT *stmt)                { return replay_stmt(stmt)->error; }
+
+const char *mysql_stmt_error(MYSQL_STMT *stmt)
+{
+   return replay_stmt(stmt)->error==replay_out_of_sync ? replay_out_of_sync_text : "";
+}
+
+#ifdef LIBMARIADB
+
+/** Claims parameter arrays, as a MariaDB server from 10.2 does, for execute_bulk(). */
+my_bool mariadb_get_infov(MYSQL *, enum mariadb_value value, void *arg)
+{
+   if (value!=MARIADB_CONNECTION_EXTENDED_SERVER_CAPABILITIES)
+      return 1;
+   *static_cast<unsigned long*>(arg) = MARIADB_CLIENT_STMT_BULK_OPERATIONS >> 32;
+   return 0;
+}
+
+/*
+ * Each non-blocking call finishes at once, so an Async_Loop never waits
+ * on the socket, which doesn't exist.
+ */
+my_socket mysql_get_socket(MYSQL *)                           { return -1; }
+unsigned int mysql_get_timeout_value_ms(const MYSQL *)        { return 0; }
+
+int mysql_real_connect_start(MYSQL **ret, MYSQL *mysql, const char *, const char *, const char *,
+                             const char *, unsigned int, const char *, unsigned long)
+{
+   *ret = mysql;
+   return 0;
+}
+
+int mysql_real_connect_cont(MYSQL **ret, MYSQL *mysql, int)
+{
+   *ret = mysql;
+   return 0;
+}
+
+int mysql_stmt_prepare_start(int *ret, MYSQL_STMT *stmt, const char *query, unsigned long length)
+{
+   *ret = mysql_stmt_prepare(stmt, query, length);
+   return 0;
+}
+
+int mysql_stmt_prepare_cont(int *ret, MYSQL_STMT *, int)      { *ret = 0; return 0; }
+int mysql_stmt_execute_start(int *ret, MYSQL_STMT *stmt)      { *ret = mysql_stmt_execute(stmt); return 0; }
+int mysql_stmt_execute_cont(int *ret, MYSQL_STMT *, int)      { *ret = 0; return 0; }
+int mysql_stmt_fetch_start(int *ret, MYSQL_STMT *stmt)        { *ret = mysql_stmt_fetch(stmt); return 0; }
+int mysql_stmt_fetch_cont(int *ret, MYSQL_STMT *stmt, int)    { *ret = mysql_stmt_fetch(stmt); return 0; }
+int mysql_stmt_close_start(my_bool *ret, MYSQL_STMT *stmt)    { *ret = mysql_stmt_close(stmt); return 0; }
+int mysql_stmt_close_cont(my_bool *ret, MYSQL_STMT *, int)    { *ret = 0; return 0; }
+
+#endif  // LIBMARIADB
+
+}  // extern "C"
@@ -0,0 +1,329 @@
+#include <mysql.h>
+#include <stdint.h>  // for uint32_t
+#include <string.h>  // for strlen
+#include <stdlib.h>  // for strtoll
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mysqlcb_scan.hpp"
+#include "mysqlcb_fanout.hpp"
+#include "mysqlcb_cursor.hpp"
+
+namespace mysqlcb {
+
+/**
+ * Reads MIN(*key*) and MAX(*key*) of *table*, filtered by *where*, and
+ * splits the span into up to *max_ranges* ranges of nearly equal width.
+ * Returns the number of ranges written, 0 if no row matches.
+ *
+ * The split assumes the key values are spread evenly over the span, as
+ * they are for an AUTO_INCREMENT key with few gaps.  The key must be a
+ * signed integer column.
+ */
+uint32_t get_key_ranges(MYSQL &mysql,
+                        Key_Range *ranges,
+                        uint32_t max_ranges,
+                        const char *table,
+                        const char *key,
+                        const char *where)
+{
+   if (max_ranges==0)
+      return 0;
+
+   std::string query = "SELECT MIN(";
+   query += key;
+   query += "), MAX(";
+   query += key;
+   query += ") FROM ";
+   query += table;
+   if (where)
+   {
+      query += " WHERE ";
+      query += where;
+   }
+
+   if (mysql_real_query(&mysql, query.c_str(), query.length()))
+      throw std::runtime_error(std::string("Failed to read the key range: ") + mysql_error(&mysql));
+
+   MYSQL_RES *res = mysql_store_result(&mysql);
+   if (!res)
+      throw std::runtime_error(std::string("Failed to read the key range: ") + mysql_error(&mysql));
+
+   bool    found = false;
+   int64_t low = 0, high = 0;
+
+   MYSQL_ROW row = mysql_fetch_row(res);
+   if (row && row[0] && row[1])
+   {
+      low = strtoll(row[0], nullptr, 10);
+      high = strtoll(row[1], nullptr, 10);
+      found = true;
+   }
+   mysql_free_result(res);
+
+   if (!found)
+      return 0;
+
+   // Count in unsigned values so the span of any two int64_t values fits:
+   uint64_t span = static_cast<uint64_t>(high) - static_cast<uint64_t>(low);
+   uint64_t width = span / max_ranges;
+   uint64_t extra = span % max_ranges;
+
+   uint64_t next = static_cast<uint64_t>(low);
+   uint32_t count = 0;
+   for (uint32_t i=0; i<max_ranges; ++i)
+   {
+      // The first extra+1 ranges are one value wider, making span+1 values in all:
+      if (width==0 && i > extra)
+         break;
+
+      uint64_t last = next + width - (i <= extra ? 0 : 1);
+      ranges[count].low = static_cast<int64_t>(next);
+      ranges[count].high = static_cast<int64_t>(last);
+      ++count;
+      next = last + 1;
+   }
+
+   return count;
+}
+
+/** Makes the query for one range of the scan. */
+std::string make_range_query(const char *table,
+                             const char *key,
+                             const char *columns,
+                             const char *where,
+                             const Key_Range &range,
+                             bool ordered)
+{
+   std::string query = "SELECT ";
+   query += columns ? columns : "*";
+   query += " FROM ";
+   query += table;
+   query += " WHERE ";
+   query += key;
+   query += " BETWEEN ";
+   query += std::to_string(range.low);
+   query += " AND ";
+   query += std::to_string(range.high);
+   if (where)
+   {
+      query += " AND (";
+      query += where;
+      query += ")";
+   }
+   if (ordered)
+   {
+      query += " ORDER BY ";
+      query += key;
+   }
+
+   return query;
+}
+
+/** Rows per fetch of an ordered scan's range cursors. */
+const unsigned long scan_prefetch_rows = 1024;
+
+/**
+ * Scans the ranges in key order.  Because the ranges don't overlap,
+ * the rows are in key order when each range's rows, sorted by the
+ * server, are delivered one range after another, so no merge is needed,
+ * only that the ranges be read ahead.
+ *
+ * Each worker claims the next range and opens it as a read-only server
+ * cursor, so the server sorts the range ahead of its turn, then holds
+ * its connection until the calling thread has fetched the rows and sent
+ * them to the callback.  The client holds only *scan_prefetch_rows* rows
+ * of a range at a time, not the range itself.  Claims are made in order,
+ * so at most *thread_count* ranges are open at once.
+ */
+void scan_ordered(Connection_Pool &pool,
+                  IBinder_Callback &cb,
+                  const std::vector<std::string> &queries,
+                  uint32_t thread_count)
+{
+   struct Shard
+   {
+      Query_Cursor       *cursor;
+      std::exception_ptr error;
+      bool               ready;
+      bool               consumed;
+   };
+
+   uint32_t                count = static_cast<uint32_t>(queries.size());
+   std::vector<Shard>      shards(count, Shard{ nullptr, nullptr, false, false });
+   std::mutex              mutex;
+   std::condition_variable cv;
+   uint32_t                next = 0;
+   bool                    abandoned = false;
+
+   auto worker = [&]()
+   {
+      mysql_thread_init();
+
+      while (true)
+      {
+         uint32_t index;
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (abandoned || next >= count)
+               break;
+            index = next++;
+         }
+
+         Shard &shard = shards[index];
+
+         auto fquery = [&](MYSQL &mysql)
+         {
+            Pull_Options options = cursor_pull_options(scan_prefetch_rows);
+            Query_Cursor cursor(mysql, queries[index].c_str(), nullptr, &options);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            shard.cursor = &cursor;
+            shard.ready = true;
+            cv.notify_all();
+            cv.wait(lock, [&shard, &abandoned]() { return shard.consumed || abandoned; });
+            shard.cursor = nullptr;
+         };
+
+         try
+         {
+            start_mysql(pool, fquery);
+         }
+         catch(...)
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!shard.ready)
+            {
+               shard.error = std::current_exception();
+               shard.ready = true;
+               cv.notify_all();
+            }
+         }
+      }
+
+      mysql_thread_end();
+   };
+
+   auto abandon = [&]()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      abandoned = true;
+      cv.notify_all();
+   };
+
+   std::vector<std::thread> threads;
+   try
+   {
+      threads.reserve(thread_count);
+      for (uint32_t i=0; i<thread_count; ++i)
+         threads.emplace_back(worker);
+   }
+   catch(...)
+   {
+      if (threads.empty())
+         throw;
+   }
+
+   try
+   {
+      for (uint32_t i=0; i<count; ++i)
+      {
+         Shard &shard = shards[i];
+         Query_Cursor *cursor;
+         {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&shard]() { return shard.ready; });
+            if (shard.error)
+               std::rethrow_exception(shard.error);
+            cursor = shard.cursor;
+         }
+
+         // The worker waits with the connection while its rows are read here:
+         while (cursor->next())
+            cb(cursor->binder());
+
+         std::lock_guard<std::mutex> lock(mutex);
+         shard.consumed = true;
+         cv.notify_all();
+      }
+   }
+   catch(...)
+   {
+      abandon();
+      for (auto &t : threads)
+         t.join();
+      throw;
+   }
+
+   for (auto &t : threads)
+      t.join();
+}
+
+/**
+ * Scans the rows of *table* whose integer *key* falls within its
+ * current MIN and MAX, reading the ranges of get_key_ranges() in
+ * parallel on connections leased from *pool*.  *columns* defaults to
+ * "*", and *where*, if given, further filters the rows.
+ *
+ * Calls to *cb* are serialized, so it needs no locking.  Without
+ * Scan_Settings::ordered the rows arrive in no particular order, from the
+ * worker threads.  With it, they arrive in key order on the calling
+ * thread, while the workers read the following ranges ahead.
+ *
+ * The number of threads is capped at the pool's max_size.  An ordered
+ * scan holds a connection for each range read ahead, so the pool should
+ * not be short of connections for other users while it runs.
+ */
+void t_scan_table(Connection_Pool &pool,
+                  IBinder_Callback &cb,
+                  const char *table,
+                  const char *key,
+                  const char *columns,
+                  const char *where,
+                  const Scan_Settings &settings)
+{
+   uint32_t max_ranges = settings.shards ? settings.shards : 1;
+   std::vector<Key_Range> ranges(max_ranges);
+   uint32_t count = 0;
+
+   auto franges = [&](MYSQL &mysql)
+   {
+      count = get_key_ranges(mysql, ranges.data(), max_ranges, table, key, where);
+   };
+   start_mysql(pool, franges);
+
+   if (count==0)
+      return;
+
+   std::vector<std::string> queries;
+   queries.reserve(count);
+   for (uint32_t i=0; i<count; ++i)
+      queries.push_back(make_range_query(table, key, columns, where, ranges[i], settings.ordered));
+
+   uint32_t thread_count = settings.threads ? settings.threads : 1;
+   if (thread_count > count)
+      thread_count = count;
+   if (thread_count > pool.settings().max_size)
+      thread_count = pool.settings().max_size;
+
+   if (settings.ordered)
+      scan_ordered(pool, cb, queries, thread_count);
+   else
+   {
+      std::vector<Fanout_Query> fqueries(count);
+      for (uint32_t i=0; i<count; ++i)
+         fqueries[i] = Fanout_Query{ queries[i].c_str(), nullptr, nullptr };
+
+      auto fmerged = [&cb](uint32_t, Binder &b) { cb(b); };
+      Fanout_User<decltype(fmerged)> fu(fmerged);
+
+      Fanout_Executor fan(pool, thread_count);
+      fan.execute(fqueries.data(), count, fu);
+   }
+}
+
+}  // namespace
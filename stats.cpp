@@ -0,0 +1,294 @@
+#include <ctype.h>   // for isspace(), isdigit(), isxdigit(), isalnum()
+#include <string.h>  // for strlen(), strchr()
+#include <stdint.h>  // for uint32_t
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+#include "mysqlcb_stats.hpp"
+
+namespace mysqlcb {
+
+inline bool is_word_char(char c)
+{
+   return isalnum(static_cast<unsigned char>(c)) || c=='_' || c=='$' || c=='@';
+}
+
+/**
+ * Adds a `?` for a literal, unless it continues a list of literals,
+ * so `IN (1, 2, 3)` and `IN (4, 5)` both become `IN (?)`.
+ */
+void append_placeholder(std::string &out)
+{
+   size_t len = out.length();
+   if (len && out[len-1]==' ')
+      --len;
+   if (len>=2 && out[len-1]==',' && out[len-2]=='?')
+      out.resize(len-1);
+   else
+      out += '?';
+}
+
+/**
+ * Returns *query* with its string and number literals replaced by `?`,
+ * lists of literals reduced to one `?`, and runs of white space reduced
+ * to a single space, so queries that differ only in their values
+ * compare equal.  Identifiers, including quoted ones, are left alone.
+ */
+std::string normalize_query(const char *query)
+{
+   std::string out;
+   out.reserve(strlen(query));
+
+   const char *p = query;
+   bool       space = false;
+   while (*p)
+   {
+      char c = *p;
+      if (isspace(static_cast<unsigned char>(c)))
+      {
+         space = true;
+         ++p;
+         continue;
+      }
+
+      if (space && !out.empty())
+         out += ' ';
+      space = false;
+
+      if (c=='\'' || c=='"')
+      {
+         ++p;
+         while (*p)
+         {
+            if (*p=='\\' && p[1])
+               p += 2;
+            else if (*p==c && p[1]==c)
+               p += 2;
+            else if (*p++==c)
+               break;
+         }
+         append_placeholder(out);
+      }
+      else if (c=='`')
+      {
+         const char *end = strchr(p+1, '`');
+         const char *stop = end ? end+1 : p+strlen(p);
+         out.append(p, stop);
+         p = stop;
+      }
+      else if (isdigit(static_cast<unsigned char>(c)) && (out.empty() || !is_word_char(out.back())))
+      {
+         if (c=='0' && (p[1]=='x' || p[1]=='X'))
+            for (p+=2; isxdigit(static_cast<unsigned char>(*p)); ++p)
+               ;
+         else
+         {
+            while (isdigit(static_cast<unsigned char>(*p)) || *p=='.')
+               ++p;
+            if (*p=='e' || *p=='E')
+            {
+               ++p;
+               if (*p=='+' || *p=='-')
+                  ++p;
+               while (isdigit(static_cast<unsigned char>(*p)))
+                  ++p;
+            }
+         }
+         append_placeholder(out);
+      }
+      else
+      {
+         out += c;
+         ++p;
+      }
+   }
+
+   return out;
+}
+
+Latency_Histogram::Latency_Histogram()
+   : m_buckets(),
+     m_count(0),
+     m_min(UINT64_MAX),
+     m_max(0),
+     m_sum(0.0)
+{
+}
+
+/**
+ * Values below SUB_COUNT have a bucket each.  Above that, the bucket
+ * is found from the position of the value's highest bit and the
+ * SUB_BITS bits that follow it.
+ */
+uint32_t Latency_Histogram::bucket_of(uint64_t value)
+{
+   if (value < SUB_COUNT)
+      return static_cast<uint32_t>(value);
+
+   uint32_t top_bit = 63 - __builtin_clzll(value);
+   uint32_t shift = top_bit - SUB_BITS;
+   uint32_t sub = static_cast<uint32_t>(value >> shift) & (SUB_COUNT-1);
+   return (shift+1) * SUB_COUNT + sub;
+}
+
+uint64_t Latency_Histogram::highest_in_bucket(uint32_t bucket)
+{
+   if (bucket < SUB_COUNT)
+      return bucket;
+
+   uint32_t shift = bucket / SUB_COUNT - 1;
+   uint64_t low = static_cast<uint64_t>(SUB_COUNT + bucket % SUB_COUNT) << shift;
+   return low + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+void Latency_Histogram::record(uint64_t value)
+{
+   ++m_buckets[bucket_of(value)];
+   ++m_count;
+   m_sum += static_cast<double>(value);
+   if (value < m_min)
+      m_min = value;
+   if (value > m_max)
+      m_max = value;
+}
+
+void Latency_Histogram::merge(const Latency_Histogram &rhs)
+{
+   for (uint32_t i=0; i<BUCKET_COUNT; ++i)
+      m_buckets[i] += rhs.m_buckets[i];
+   m_count += rhs.m_count;
+   m_sum += rhs.m_sum;
+   if (rhs.m_min < m_min)
+      m_min = rhs.m_min;
+   if (rhs.m_max > m_max)
+      m_max = rhs.m_max;
+}
+
+/**
+ * Returns the value below which *percentile* (0 to 100) percent of the
+ * recorded values fall, as the highest value of its bucket, but never
+ * more than the largest value recorded.
+ */
+uint64_t Latency_Histogram::value_at_percentile(double percentile) const
+{
+   if (m_count==0)
+      return 0;
+
+   if (percentile > 100.0)
+      percentile = 100.0;
+
+   uint64_t target = static_cast<uint64_t>(percentile / 100.0 * m_count + 0.5);
+   if (target==0)
+      target = 1;
+
+   uint64_t seen = 0;
+   for (uint32_t i=0; i<BUCKET_COUNT; ++i)
+   {
+      seen += m_buckets[i];
+      if (seen >= target)
+         return std::min(highest_in_bucket(i), m_max);
+   }
+
+   return m_max;
+}
+
+Query_Stats_Aggregator::Query_Stats_Aggregator(size_t max_queries)
+   : m_max_queries(max_queries),
+     m_mutex(),
+     m_entries()
+{
+}
+
+void Query_Stats_Aggregator::operator()(const Query_Stats &stats) const
+{
+   std::string key = normalize_query(stats.query ? stats.query : "");
+
+   uint64_t total = 0;
+   for (uint32_t i=0; i<PHASE_COUNT; ++i)
+      total += stats.phase_ns[i];
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   if (m_entries.size() >= m_max_queries && m_entries.find(key)==m_entries.end())
+      key = "(other)";
+
+   Entry &entry = m_entries[key];
+   entry.latency.record(total);
+   for (uint32_t i=0; i<PHASE_COUNT; ++i)
+      entry.phase_ns[i] += stats.phase_ns[i];
+   ++entry.calls;
+   entry.rows += stats.rows;
+   entry.bytes += stats.bytes;
+   entry.truncations += stats.truncations;
+   if (stats.error)
+   {
+      ++entry.errors;
+      entry.last_error = stats.error;
+   }
+}
+
+void Query_Stats_Aggregator::clear(void)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_entries.clear();
+}
+
+/**
+ * Writes a summary of each query, those with the most total time
+ * first.  Times are in microseconds.
+ */
+void Query_Stats_Aggregator::report(std::ostream &os) const
+{
+   static const char *phase_names[PHASE_COUNT] =
+      { "prepare", "execute", "metadata", "fetch", "callback" };
+
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   std::vector<const std::pair<const std::string, Entry>*> order;
+   order.reserve(m_entries.size());
+   for (const auto &pair : m_entries)
+      order.push_back(&pair);
+
+   std::sort(order.begin(),
+             order.end(),
+             [](const std::pair<const std::string, Entry> *a,
+                const std::pair<const std::string, Entry> *b)
+             {
+                return a->second.latency.mean() * a->second.calls
+                   > b->second.latency.mean() * b->second.calls;
+             });
+
+   std::ios_base::fmtflags flags = os.flags();
+   std::streamsize precision = os.precision();
+   os << std::fixed << std::setprecision(1);
+
+   for (auto pair : order)
+   {
+      const Entry &e = pair->second;
+      const Latency_Histogram &h = e.latency;
+
+      os << pair->first << "\n"
+         << "   calls " << e.calls
+         << "  errors " << e.errors
+         << "  rows " << e.rows
+         << "  bytes " << e.bytes
+         << "  truncated " << e.truncations << "\n"
+         << "   latency us: min " << h.min() / 1000.0
+         << "  p50 " << h.value_at_percentile(50) / 1000.0
+         << "  p90 " << h.value_at_percentile(90) / 1000.0
+         << "  p99 " << h.value_at_percentile(99) / 1000.0
+         << "  max " << h.max() / 1000.0 << "\n"
+         << "   mean us:";
+      for (uint32_t i=0; i<PHASE_COUNT; ++i)
+         os << " " << phase_names[i] << " " << (e.calls ? e.phase_ns[i] / 1000.0 / e.calls : 0.0);
+      os << "\n";
+
+      if (e.errors)
+         os << "   last error: " << e.last_error << "\n";
+   }
+
+   os.flags(flags);
+   os.precision(precision);
+}
+
+}  // namespace
@@ -0,0 +1,317 @@
+#include <mysql.h>
+#include <iostream>
+#include <string.h>  // For strlen(), strcmp()
+#include <stdint.h>  // for uint32_t
+#include <stdexcept>
+#include "mysqlcb_binder.hpp"
+#include "mysqlcb.hpp"
+
+namespace mysqlcb {
+
+/**
+ * A slot in the statement cache.  A slot is empty when *stmt* is nullptr.
+ *
+ * *memory* holds the copy of the query text followed by the memory
+ * laid out by set_result_binds() for the Binder.
+ */
+struct Stmt_Cache::Entry
+{
+   unsigned long last_used;
+   uint32_t      hash;
+   const char    *query;
+   MYSQL_STMT    *stmt;
+   MYSQL_RES     *meta;
+   char          *memory;
+   Binder        binder;
+};
+
+/** FNV-1a hash of the query text to avoid most string comparisons. */
+static uint32_t hash_query(const char *query)
+{
+   uint32_t hash = 2166136261u;
+   while (*query)
+   {
+      hash ^= static_cast<unsigned char>(*query++);
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+static void release_entry(Stmt_Cache::Entry &entry)
+{
+   if (entry.meta)
+      mysql_free_result(entry.meta);
+   if (entry.stmt)
+      mysql_stmt_close(entry.stmt);
+   delete [] entry.memory;
+
+   memset(&entry, 0, sizeof(Stmt_Cache::Entry));
+}
+
+/**
+ * Prepares the query into an empty entry, allocating a single block for
+ * the query text and the Binder layout.
+ */
+static void fill_entry(MYSQL &mysql, Stmt_Cache::Entry &entry, const char *query, uint32_t hash)
+{
+   entry.stmt = mysql_stmt_init(&mysql);
+   if (!entry.stmt)
+      throw std::runtime_error("Failed to initialize statement: insufficient memory?");
+
+   try
+   {
+      prepare_statement(entry.stmt, query);
+
+      size_t   len_query = strlen(query) + 1;
+      uint32_t num_fields = mysql_stmt_field_count(entry.stmt);
+      MYSQL_FIELD *fields = nullptr;
+
+      if (num_fields)
+      {
+         entry.meta = mysql_stmt_result_metadata(entry.stmt);
+         if (!entry.meta)
+            throw std::runtime_error("Error getting result metadata.");
+         fields = mysql_fetch_fields(entry.meta);
+      }
+
+      // Keep the binds aligned by placing them ahead of the query text:
+      size_t len_binds = num_fields ? get_result_binds_size(fields, num_fields) : 0;
+      entry.memory = new char[len_binds + len_query];
+
+      char *query_copy = entry.memory + len_binds;
+      memcpy(query_copy, query, len_query);
+      entry.query = query_copy;
+      entry.hash = hash;
+
+      if (num_fields)
+      {
+         set_result_binds(entry.binder, entry.memory, fields, num_fields);
+         entry.binder.stmt = entry.stmt;
+         if (mysql_stmt_bind_result(entry.stmt, entry.binder.binds))
+            throw_stmt_error("Failed to bind results", entry.stmt);
+      }
+   }
+   catch(...)
+   {
+      release_entry(entry);
+      throw;
+   }
+}
+
+Stmt_Cache::Stmt_Cache(MYSQL &mysql, uint32_t capacity)
+   : m_mysql(mysql),
+     m_capacity(capacity ? capacity : 1),
+     m_entries(nullptr),
+     m_tick(0),
+     m_hits(0),
+     m_misses(0),
+     m_evictions(0)
+{
+   m_entries = new Entry[m_capacity];
+   memset(m_entries, 0, sizeof(Entry) * m_capacity);
+}
+
+Stmt_Cache::~Stmt_Cache()
+{
+   clear();
+   delete [] m_entries;
+}
+
+uint32_t Stmt_Cache::size(void) const
+{
+   uint32_t count = 0;
+   for (uint32_t i=0; i<m_capacity; ++i)
+      if (m_entries[i].stmt)
+         ++count;
+   return count;
+}
+
+void Stmt_Cache::clear(void)
+{
+   for (uint32_t i=0; i<m_capacity; ++i)
+      release_entry(m_entries[i]);
+}
+
+/**
+ * The cache is small, so a linear scan, mostly comparing hashes, beats
+ * the bookkeeping of a linked LRU list.  The same pass finds the victim
+ * in case of a miss: an empty slot or else the least-recently used one.
+ */
+Stmt_Cache::Entry &Stmt_Cache::acquire(const char *query)
+{
+   uint32_t hash = hash_query(query);
+   Entry    *victim = m_entries;
+
+   for (uint32_t i=0; i<m_capacity; ++i)
+   {
+      Entry &entry = m_entries[i];
+      if (entry.stmt)
+      {
+         if (entry.hash==hash && 0==strcmp(entry.query, query))
+         {
+            ++m_hits;
+            entry.last_used = ++m_tick;
+            return entry;
+         }
+         else if (victim->stmt && entry.last_used < victim->last_used)
+            victim = &entry;
+      }
+      else if (victim->stmt)
+         victim = &entry;
+   }
+
+   ++m_misses;
+   if (victim->stmt)
+   {
+      ++m_evictions;
+      release_entry(*victim);
+   }
+
+   fill_entry(m_mysql, *victim, query, hash);
+   victim->last_used = ++m_tick;
+   return *victim;
+}
+
+void Stmt_Cache::discard(Entry &entry)
+{
+   release_entry(entry);
+}
+
+MYSQL_STMT *Stmt_Cache::stmt(Entry &entry)  { return entry.stmt; }
+Binder &Stmt_Cache::binder(Entry &entry)    { return entry.binder; }
+
+/**
+ * Executes a cached statement and calls *f* with it.  The pending result
+ * is released even if *f* throws, leaving the statement ready for the
+ * next execution.  A failed execute closes the statement since the
+ * error may have invalidated it, like a lost connection.
+ *
+ * The fetch mode is always set because a cached statement keeps the
+ * cursor attributes of its previous execution.
+ *
+ * The outcome is reported to *probe*, which *f* may also time.
+ */
+template <typename Func>
+void run_cached(Stmt_Cache &cache,
+                const char *query,
+                const Binder *params,
+                const Pull_Options *options,
+                Query_Probe &probe,
+                const Func &f)
+{
+   try
+   {
+      Stmt_Cache::Entry &entry = cache.acquire(query);
+      probe.lap(PHASE_PREPARE);
+      try
+      {
+         execute_statement(entry.stmt, params, options ? options : &default_pull_options);
+      }
+      catch(...)
+      {
+         cache.discard(entry);
+         throw;
+      }
+      probe.lap(PHASE_EXECUTE);
+
+      try
+      {
+         f(entry);
+      }
+      catch(...)
+      {
+         mysql_stmt_free_result(entry.stmt);
+         throw;
+      }
+      mysql_stmt_free_result(entry.stmt);
+   }
+   catch(const std::exception &e)
+   {
+      probe.fail(e.what());
+      throw;
+   }
+   probe.done();
+}
+
+/**
+ * Executes a cached query, calling the callback function with each result row.
+ *
+ * @param cache Statement cache of an open MySQL connection
+ * @param cb    Callback function of type `void funcname(Binder &binder)`
+ * @param query Text of the query
+ */
+void execute_query(Stmt_Cache &cache, IBinder_Callback &cb, const char *query)
+{
+   Query_Probe probe(query);
+   auto f = [&cb, &probe](Stmt_Cache::Entry &entry)
+   {
+      if (entry.binder.field_count)
+         push_rows(entry.stmt, entry.binder, cb, &probe);
+   };
+   run_cached(cache, query, nullptr, nullptr, probe, f);
+}
+
+/**
+ * Executes a cached query, calling the callback with each row until it
+ * returns ROW_SKIP_REST or ROW_STOP, as for push_rows_until().  The
+ * statement stays cached either way.
+ *
+ * @param cache     Statement cache of an open MySQL connection
+ * @param cb        Callback function of type `Row_Control funcname(Binder &binder)`
+ * @param query     Text of the query
+ * @param params    Parameter values, or nullptr
+ * @param canceller Stops the server's side of a ROW_STOP query, or nullptr
+ */
+void execute_query_until(Stmt_Cache &cache,
+                         IRow_Control_Callback &cb,
+                         const char *query,
+                         const MParam *params,
+                         const IQuery_Canceller *canceller)
+{
+   auto run = [&cache, &cb, query, canceller](const Binder *binder)
+   {
+      Query_Probe probe(query);
+      auto f = [&cache, &cb, canceller, &probe](Stmt_Cache::Entry &entry)
+      {
+         if (entry.binder.field_count)
+            push_rows_until(cache.mysql(), entry.stmt, entry.binder, cb, canceller, &probe);
+      };
+      run_cached(cache, query, binder, nullptr, probe, f);
+   };
+
+   if (params)
+   {
+      auto fparams = [&run](Binder &b) { run(&b); };
+      Binder_User<decltype(fparams)> bu(fparams);
+
+      summon_binder(bu, params);
+   }
+   else
+      run(nullptr);
+}
+
+/**
+ * Executes a cached query, then hands back a PullPack for pulling the rows.
+ *
+ * @param cache  Statement cache of an open MySQL connection
+ * @param cb     Callback function of type `void funcname(PullPack &pp)
+ * @param query  Text of the query
+ * @param params Parameters for the query, or nullptr
+ * @param options Fetch mode for the query, or nullptr for default_pull_options
+ */
+void int_execute_query_pull(Stmt_Cache &cache,
+                            IPullPack_Callback &cb,
+                            const char *query,
+                            const Binder *params,
+                            const Pull_Options *options)
+{
+   Query_Probe probe(query);
+   auto f = [&cache, &cb, &options, &probe](Stmt_Cache::Entry &entry)
+   {
+      if (entry.binder.field_count)
+         pull_rows(cache.mysql(), entry.stmt, entry.binder, cb, options, &probe);
+   };
+   run_cached(cache, query, params, options, probe, f);
+}
+
+} // namespace
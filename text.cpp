@@ -0,0 +1,533 @@
+#include <mysql.h>
+#include <alloca.h>
+#include <stdlib.h>  // for strtol(), strtoull(), strtod()
+#include <string.h>  // For memset(), strlen()
+#include <stdint.h>  // for uint32_t
+#include <stdexcept>
+#include <string>
+#include "mysqlcb_binder.hpp"
+#include "mysqlcb_arena.hpp"
+#include "mysqlcb.hpp"
+
+namespace mysqlcb {
+
+static void throw_mysql_error(const char *msg, MYSQL &mysql)
+{
+   std::string err(msg);
+   err += " \"";
+   err += mysql_error(&mysql);
+   err += "\"\n";
+   throw std::runtime_error(err);
+}
+
+static inline bool is_temporal_type(enum_field_types type)
+{
+   return type==MYSQL_TYPE_DATE || type==MYSQL_TYPE_TIME
+      || type==MYSQL_TYPE_DATETIME || type==MYSQL_TYPE_TIMESTAMP;
+}
+
+/**
+ * Bytes of native buffer for a text-protocol field, the size of its
+ * native type, as a prepared statement would report it.  String values
+ * are used where they lie in the MYSQL_ROW, so only fixed-length fields,
+ * which are converted, need a buffer.
+ */
+static inline size_t get_text_buffer_length(const MYSQL_FIELD &fld)
+{
+   return is_fixed_length(fld.type) ? get_field_buffer_length(fld) : 0;
+}
+
+static inline size_t align_text_buffer(size_t len) { return (len + 7) & ~static_cast<size_t>(7); }
+
+static size_t get_text_binds_size(const MYSQL_FIELD *fields, uint32_t num_fields)
+{
+   size_t total = sizeof(MYSQL_BIND) * num_fields + sizeof(Bind_Data) * (num_fields+1);
+   for (uint32_t i=0; i<num_fields; ++i)
+      total += align_text_buffer(get_text_buffer_length(fields[i]));
+   return total;
+}
+
+/**
+ * Lays out a Binder for a text-protocol result like set_result_binds()
+ * does for a statement, with the same BDType for each field.
+ */
+static void set_text_binds(Binder &binder, void *memory, MYSQL_FIELD *fields, uint32_t num_fields)
+{
+   char        *ptr = static_cast<char*>(memory);
+   MYSQL_BIND  *binds = reinterpret_cast<MYSQL_BIND*>(ptr);
+   ptr += sizeof(MYSQL_BIND) * num_fields;
+   Bind_Data   *bdata = reinterpret_cast<Bind_Data*>(ptr);
+   ptr += sizeof(Bind_Data) * (num_fields+1);
+
+   memset(binds, 0, sizeof(MYSQL_BIND)*num_fields);
+   memset(bdata, 0, sizeof(Bind_Data)*(num_fields+1));
+
+   for (uint32_t i=0; i<num_fields; ++i)
+   {
+      Bind_Data   &bd = bdata[i];
+      MYSQL_FIELD &field = fields[i];
+      MYSQL_BIND  &bind = binds[i];
+
+      bind.buffer_type = field.type;
+      bind.is_unsigned = (field.flags & UNSIGNED_FLAG)!=0;
+      bind.length = &bd.len_data;
+      bind.is_null = &bd.is_null;
+      bind.error = &bd.is_error;
+
+      bd.field = &field;
+      bd.bind = &bind;
+      bd.bdtype = get_bdtype(field);
+
+      if (is_unsupported_type(bd))
+         throw std::runtime_error(std::string(field.name) + " unprepared field type.");
+
+      size_t buffer_length = get_text_buffer_length(field);
+      if (buffer_length)
+      {
+         bind.buffer = bd.data = static_cast<void*>(ptr);
+         bind.buffer_length = buffer_length;
+         ptr += align_text_buffer(buffer_length);
+      }
+   }
+
+   binder.field_count = num_fields;
+   binder.fields = fields;
+   binder.binds = binds;
+   binder.bind_data = bdata;
+   binder.stmt = nullptr;
+}
+
+/** Reads up to *max_digits* digits, advancing *ptr*. */
+static unsigned long read_digits(const char *&ptr, const char *end, int max_digits)
+{
+   unsigned long value = 0;
+   for (; ptr<end && max_digits && *ptr>='0' && *ptr<='9'; ++ptr, --max_digits)
+      value = value * 10 + (*ptr - '0');
+   return value;
+}
+
+/** Reads `hh:mm:ss[.ffffff]`, with hours up to 838 for a TIME. */
+static void read_time_of_day(MYSQL_TIME &mt, const char *&ptr, const char *end)
+{
+   mt.hour = read_digits(ptr, end, 3);
+   if (ptr<end && *ptr==':')
+      mt.minute = read_digits(++ptr, end, 2);
+   if (ptr<end && *ptr==':')
+      mt.second = read_digits(++ptr, end, 2);
+
+   if (ptr<end && *ptr=='.')
+   {
+      const char *start = ++ptr;
+      mt.second_part = read_digits(ptr, end, 6);
+      for (long scale = ptr - start; scale<6; ++scale)
+         mt.second_part *= 10;
+   }
+}
+
+/**
+ * Converts the text of a DATE (`YYYY-MM-DD`), TIME (`[-]hhh:mm:ss`),
+ * or DATETIME/TIMESTAMP (`YYYY-MM-DD hh:mm:ss`) value to a MYSQL_TIME.
+ */
+static void parse_temporal(MYSQL_TIME &mt, enum_field_types type, const char *str, unsigned long len)
+{
+   const char *ptr = str;
+   const char *end = str + len;
+
+   memset(&mt, 0, sizeof(MYSQL_TIME));
+
+   if (type==MYSQL_TYPE_TIME)
+   {
+      mt.time_type = MYSQL_TIMESTAMP_TIME;
+      if (ptr<end && *ptr=='-')
+      {
+         mt.neg = 1;
+         ++ptr;
+      }
+      read_time_of_day(mt, ptr, end);
+      return;
+   }
+
+   mt.year = read_digits(ptr, end, 4);
+   if (ptr<end && *ptr=='-')
+      mt.month = read_digits(++ptr, end, 2);
+   if (ptr<end && *ptr=='-')
+      mt.day = read_digits(++ptr, end, 2);
+
+   if (type==MYSQL_TYPE_DATE)
+      mt.time_type = MYSQL_TIMESTAMP_DATE;
+   else
+   {
+      mt.time_type = MYSQL_TIMESTAMP_DATETIME;
+      if (ptr<end && *ptr==' ')
+         read_time_of_day(mt, ++ptr, end);
+   }
+}
+
+template <typename T>
+static inline void set_native(void *data, T value) { *static_cast<T*>(data) = value; }
+
+/**
+ * Converts the text of a fixed-length value into the native buffer of
+ * *bd*, where its BDType expects to find it.  The MYSQL_ROW text is
+ * terminated by a \0, so the conversions can read it in place.
+ */
+static void convert_text_value(const Bind_Data &bd, const char *text)
+{
+   bool uns = (bd.field->flags & UNSIGNED_FLAG)!=0;
+
+   switch(bd.field->type)
+   {
+      case MYSQL_TYPE_TINY:
+         if (uns)
+            set_native(bd.data, static_cast<uint8_t>(strtoul(text, nullptr, 10)));
+         else
+            set_native(bd.data, static_cast<int8_t>(strtol(text, nullptr, 10)));
+         break;
+      case MYSQL_TYPE_SHORT:
+         if (uns)
+            set_native(bd.data, static_cast<uint16_t>(strtoul(text, nullptr, 10)));
+         else
+            set_native(bd.data, static_cast<int16_t>(strtol(text, nullptr, 10)));
+         break;
+      case MYSQL_TYPE_LONG:
+         if (uns)
+            set_native(bd.data, static_cast<uint32_t>(strtoul(text, nullptr, 10)));
+         else
+            set_native(bd.data, static_cast<int32_t>(strtol(text, nullptr, 10)));
+         break;
+      case MYSQL_TYPE_LONGLONG:
+         if (uns)
+            set_native(bd.data, static_cast<uint64_t>(strtoull(text, nullptr, 10)));
+         else
+            set_native(bd.data, static_cast<int64_t>(strtoll(text, nullptr, 10)));
+         break;
+
+      case MYSQL_TYPE_FLOAT:
+         set_native(bd.data, strtof(text, nullptr));
+         break;
+      case MYSQL_TYPE_DOUBLE:
+         set_native(bd.data, strtod(text, nullptr));
+         break;
+
+      case MYSQL_TYPE_DATE:
+      case MYSQL_TYPE_TIME:
+      case MYSQL_TYPE_DATETIME:
+      case MYSQL_TYPE_TIMESTAMP:
+         parse_temporal(*static_cast<MYSQL_TIME*>(bd.data), bd.field->type, text, strlen(text));
+         break;
+
+      default:
+         break;
+   }
+}
+
+/**
+ * Converts a text-protocol value the first time it is read, through
+ * ensure_native().  Columns a callback never reads are never converted.
+ */
+void convert_pending_text(const Bind_Data &bd)
+{
+   const char *text = bd.pending_text;
+   bd.pending_text = nullptr;
+   convert_text_value(bd, text);
+}
+
+/**
+ * Points the Binder at a fetched text row.  String values are not copied:
+ * their Bind_Data points into the row, which stays valid until the next
+ * fetch.  Fixed-length values are left as pending text, converted only
+ * if they are read, and get the *len_data* of their native type.
+ */
+static void set_text_row(Binder &binder, MYSQL_ROW row, const unsigned long *lengths)
+{
+   for (uint32_t i=0; i<binder.field_count; ++i)
+   {
+      Bind_Data  &bd = binder.bind_data[i];
+      MYSQL_BIND &bind = *bd.bind;
+
+      bd.is_null = row[i]==nullptr;
+      bd.is_error = 0;
+      bd.is_truncated = false;
+      bd.pending_text = nullptr;
+
+      if (bd.is_null)
+      {
+         bd.len_data = 0;
+         if (!bind.buffer)
+            bd.data = nullptr;
+      }
+      else if (bind.buffer)
+      {
+         bd.len_data = bind.buffer_length;
+         bd.pending_text = row[i];
+      }
+      else
+      {
+         bd.len_data = bind.buffer_length = lengths[i];
+         bd.data = row[i];
+      }
+   }
+}
+
+/** Fetches the next row into the Binder, returning false after the last row. */
+static bool fetch_text_row(MYSQL &mysql, MYSQL_RES *res, Binder &binder)
+{
+   MYSQL_ROW row = mysql_fetch_row(res);
+   if (row)
+   {
+      set_text_row(binder, row, mysql_fetch_lengths(res));
+      return true;
+   }
+   else if (mysql_errno(&mysql))
+      throw_mysql_error("Failed to fetch row", mysql);
+
+   return false;
+}
+
+/** A text-protocol result and the Binder laid out for its rows. */
+struct Text_Result
+{
+   MYSQL_RES *res;
+   Binder    &binder;
+};
+
+using IText_Callback = IGeneric_Callback<Text_Result>;
+template <typename Func>
+using Text_User = Generic_User<Text_Result, Func>;
+
+/**
+ * Reads and frees the results that follow the first, like the status
+ * result after a CALL or the later statements of a multi-statement
+ * query.  Until they are read the connection refuses further commands.
+ */
+static void discard_more_results(MYSQL &mysql)
+{
+   while (mysql_more_results(&mysql))
+   {
+      if (mysql_next_result(&mysql) > 0)
+         throw_mysql_error("Failed to read next result", mysql);
+
+      MYSQL_RES *more = mysql_use_result(&mysql);
+      if (more)
+         mysql_free_result(more);
+   }
+}
+
+/**
+ * Sends a query by the text protocol, then calls the callback with the
+ * result and a Binder laid out for it.  The result is freed when the
+ * callback returns, which discards any rows it didn't read, and so are
+ * any results after the first.  A query without a result, like an
+ * UPDATE, doesn't call the callback.  The execute and metadata phases
+ * are timed for *probe*.
+ */
+static void t_text_query(MYSQL &mysql,
+                         IText_Callback &cb,
+                         const char *query,
+                         bool buffered,
+                         Query_Probe &probe)
+{
+   if (mysql_real_query(&mysql, query, strlen(query)))
+      throw_mysql_error("Failed to execute query", mysql);
+
+   MYSQL_RES *res = buffered ? mysql_store_result(&mysql) : mysql_use_result(&mysql);
+   probe.lap(PHASE_EXECUTE);
+   if (!res)
+   {
+      if (mysql_field_count(&mysql))
+         throw_mysql_error("Failed to read result", mysql);
+      discard_more_results(mysql);
+      return;
+   }
+
+   try
+   {
+      uint32_t    num_fields = mysql_num_fields(res);
+      MYSQL_FIELD *fields = mysql_fetch_fields(res);
+
+      Scratch scratch;
+      size_t  memlen = get_text_binds_size(fields, num_fields);
+      Binder  binder;
+      set_text_binds(binder, SCRATCH_ALLOC(scratch, memlen), fields, num_fields);
+      probe.lap(PHASE_METADATA);
+
+      Text_Result tr = {res, binder};
+      cb(tr);
+   }
+   catch(...)
+   {
+      mysql_free_result(res);
+      try
+      {
+         discard_more_results(mysql);
+      }
+      catch(...)
+      {
+         // The callback's exception is the one to report.
+      }
+      throw;
+   }
+
+   mysql_free_result(res);
+   discard_more_results(mysql);
+}
+
+/**
+ * Runs a parameterless query by the text protocol, calling the callback
+ * with each row.  execute_query() uses this for uncached queries, saving
+ * the prepare round trip.
+ *
+ * @param mysql Handle to an open MySQL connection
+ * @param cb    Callback function of type `void funcname(Binder &binder)`
+ * @param query Text of the query
+ */
+void execute_text_query(MYSQL &mysql, IBinder_Callback &cb, const char *query)
+{
+   Query_Probe probe(query);
+
+   auto f = [&mysql, &cb, &probe](Text_Result &tr)
+   {
+      while (fetch_text_row(mysql, tr.res, tr.binder))
+      {
+         probe.count_row(tr.binder);
+         probe.lap(PHASE_FETCH);
+         cb(tr.binder);
+         probe.lap(PHASE_CALLBACK);
+      }
+      probe.lap(PHASE_FETCH);
+   };
+   Text_User<decltype(f)> tu(f);
+
+   try
+   {
+      t_text_query(mysql, tu, query, false, probe);
+   }
+   catch(const std::exception &e)
+   {
+      probe.fail(e.what());
+      throw;
+   }
+   probe.done();
+}
+
+/**
+ * Like execute_text_query(), but the callback can end the result early.
+ * Either way the rest of the result is discarded when t_text_query()
+ * frees it, and ROW_STOP first calls the *canceller*, if any, so the
+ * server stops sending rows.
+ */
+void execute_text_query_until(MYSQL &mysql,
+                              IRow_Control_Callback &cb,
+                              const char *query,
+                              const IQuery_Canceller *canceller)
+{
+   Query_Probe probe(query);
+
+   auto f = [&mysql, &cb, canceller, &probe](Text_Result &tr)
+   {
+      Row_Control control = ROW_CONTINUE;
+      while (control==ROW_CONTINUE && fetch_text_row(mysql, tr.res, tr.binder))
+      {
+         probe.count_row(tr.binder);
+         probe.lap(PHASE_FETCH);
+         control = cb(tr.binder);
+         probe.lap(PHASE_CALLBACK);
+      }
+
+      if (control==ROW_STOP && canceller)
+         (*canceller)(mysql_thread_id(&mysql));
+      probe.lap(PHASE_FETCH);
+   };
+   Text_User<decltype(f)> tu(f);
+
+   try
+   {
+      t_text_query(mysql, tu, query, false, probe);
+   }
+   catch(const std::exception &e)
+   {
+      probe.fail(e.what());
+      throw;
+   }
+   probe.done();
+}
+
+/**
+ * Runs a parameterless query by the text protocol and hands back a
+ * PullPack, as int_execute_query_pull() does.  A FETCH_BUFFERED query
+ * stores its result with mysql_store_result(), so the PullPack can seek.
+ * FETCH_CURSOR needs a prepared statement and is not accepted here.
+ */
+void execute_text_query_pull(MYSQL &mysql,
+                             IPullPack_Callback &cb,
+                             const char *query,
+                             const Pull_Options *options)
+{
+   if (options && options->mode==FETCH_CURSOR)
+      throw std::runtime_error("Text-protocol queries can't use a cursor.");
+
+   bool        buffered = options && options->mode==FETCH_BUFFERED;
+   Query_Probe probe(query);
+
+   auto f = [&mysql, &cb, buffered, &probe](Text_Result &tr)
+   {
+      MYSQL_RES *result = tr.res;
+      Binder    &b = tr.binder;
+      int       persist = 1;
+
+      auto puller = [&mysql, &result, &b, &persist, &probe](int go_on) -> int
+      {
+         probe.lap(PHASE_CALLBACK);
+         do
+         {
+            persist = fetch_text_row(mysql, result, b);
+            if (persist)
+               probe.count_row(b);
+         }
+         while(go_on && persist);
+         probe.lap(PHASE_FETCH);
+
+         return persist;
+      };
+      Puller_User<decltype(puller)> pu(puller);
+
+      if (buffered)
+      {
+         uint64_t row_count = mysql_num_rows(result);
+
+         auto seeker = [&result, &persist, &row_count](uint64_t row) -> int
+         {
+            if (row >= row_count)
+               return 0;
+
+            mysql_data_seek(result, row);
+            persist = 1;
+            return 1;
+         };
+         Seeker_User<decltype(seeker)> su(seeker);
+
+         PullPack pp = {mysql, b, pu, row_count, &su};
+         cb(pp);
+      }
+      else
+      {
+         PullPack pp = {mysql, b, pu, 0, nullptr};
+         cb(pp);
+      }
+      probe.lap(PHASE_CALLBACK);
+   };
+   Text_User<decltype(f)> tu(f);
+
+   try
+   {
+      t_text_query(mysql, tu, query, buffered, probe);
+   }
+   catch(const std::exception &e)
+   {
+      probe.fail(e.what());
+      throw;
+   }
+   probe.done();
+}
+
+}  // namespace